@@ -2,6 +2,8 @@
 #include <inttypes.h> // PRIuPTR
 #include <stdint.h>
 #include <stdio.h>
+#include <assert.h>
+#include <pthread.h>
 
 // ---- Debug ----
 #ifdef ARENA_DEBUG
@@ -15,19 +17,177 @@ static void dbg(struct block* b, size_t align, size_t used_align, void* p) {
 }
 #endif
 
+// ---- Block pool ----
+
+// this thread's blocks, all from one pool; see arena.h
+static _Thread_local struct {
+    struct block_pool* pool;
+    struct block* blocks;
+    size_t n;
+    unsigned slot; // where to look first
+} cache;
+
+static pthread_key_t cache_key;
+static pthread_once_t cache_once = PTHREAD_ONCE_INIT;
+
+static void free_chain(struct block* b) {
+    while (b) {
+        struct block* next = b->next;
+        freeBlock(b);
+        b = next;
+    }
+}
+
+// a chain of n <= POOL_CACHE blocks into an empty slot, freed when there is none
+static void pool_push_batch(struct block_pool* pool, struct block* first, size_t n) {
+    first->used = n;
+    for ( unsigned k = 0 ; k < POOL_SLOTS ; ++k ) {
+        unsigned i = (cache.slot + k) % POOL_SLOTS;
+        struct block* empty = NULL;
+        if (atomic_compare_exchange_strong_explicit(&pool->slots[i], &empty, first,
+                                                    memory_order_release,
+                                                    memory_order_relaxed)) {
+            cache.slot = i;
+            return;
+        }
+    }
+    free_chain(first);
+}
+
+// some batch, NULL when the pool is empty
+static struct block* pool_pop_batch(struct block_pool* pool, size_t* n) {
+    for ( unsigned k = 0 ; k < POOL_SLOTS ; ++k ) {
+        unsigned i = (cache.slot + k) % POOL_SLOTS;
+        if (!atomic_load_explicit(&pool->slots[i], memory_order_relaxed)) continue;
+        struct block* b = atomic_exchange_explicit(&pool->slots[i], NULL, memory_order_acquire);
+        if (b) {
+            cache.slot = i;
+            *n = b->used;
+            return b;
+        }
+    }
+    return NULL;
+}
+
+static void cache_flush(void) {
+    if (cache.blocks) pool_push_batch(cache.pool, cache.blocks, cache.n);
+    cache.blocks = NULL;
+    cache.n = 0;
+}
+
+static void cache_detach(void) {
+    if (!cache.pool) return;
+    cache_flush();
+    atomic_fetch_sub_explicit(&cache.pool->users, 1, memory_order_release);
+    cache.pool = NULL;
+}
+
+// thread exit: the cache goes back to its pool
+static void cache_exit(void* unused) {
+    (void)unused;
+    cache_detach();
+}
+
+static void cache_key_create(void) {
+    pthread_key_create(&cache_key, cache_exit);
+}
+
+static void cache_use(struct block_pool* pool) {
+    if (cache.pool == pool) return;
+    cache_detach();
+    pthread_once(&cache_once, cache_key_create);
+    pthread_setspecific(cache_key, &cache);
+    atomic_fetch_add_explicit(&pool->users, 1, memory_order_relaxed);
+    cache.pool = pool;
+}
+
+// a BLOCK_SIZE block from the cache or the pool, NULL when both are empty
+static struct block* pool_get(struct block_pool* pool) {
+    cache_use(pool);
+    if (!cache.blocks) cache.blocks = pool_pop_batch(pool, &cache.n);
+    struct block* b = cache.blocks;
+    if (b == NULL) return NULL;
+    cache.blocks = b->next;
+    cache.n--;
+    return b;
+}
+
+// the chain tops up the cache, the rest goes to the pool in batches
+static void pool_put(struct block_pool* pool, struct block* first) {
+    cache_use(pool);
+    while (first && cache.n < POOL_CACHE) {
+        struct block* next = first->next;
+        first->next = cache.blocks;
+        cache.blocks = first;
+        cache.n++;
+        first = next;
+    }
+    while (first) {
+        struct block* batch = first;
+        size_t n = 1;
+        for ( ; n < POOL_CACHE && first->next ; ++n ) first = first->next;
+        struct block* rest = first->next;
+        first->next = NULL;
+        pool_push_batch(pool, batch, n);
+        first = rest;
+    }
+}
+
+void pool_init(struct block_pool* pool) {
+    for ( unsigned i = 0 ; i < POOL_SLOTS ; ++i ) atomic_init(&pool->slots[i], NULL);
+    atomic_init(&pool->users, 0);
+}
+
+void pool_destroy(struct block_pool* pool) {
+    if (cache.pool == pool) cache_detach();
+    assert(atomic_load_explicit(&pool->users, memory_order_acquire) == 0 &&
+           "pool_destroy with threads still using the pool");
+    for ( unsigned i = 0 ; i < POOL_SLOTS ; ++i ) {
+        free_chain(atomic_exchange_explicit(&pool->slots[i], NULL, memory_order_acquire));
+    }
+}
+
+static struct block* arena_new_block(struct arena* a, size_t cap) {
+    struct block* b = a->pool && cap == BLOCK_SIZE ? pool_get(a->pool) : NULL;
+    if (b == NULL) return allocBlock(cap);
+    b->used = 0;
+    b->next = NULL;
+    return b;
+}
+
+// frees the blocks from b up to stop; a pooled arena's BLOCK_SIZE ones go
+// back to the pool together
+static void arena_drop(struct arena* a, struct block* b, struct block* stop) {
+    struct block* first = NULL;
+    while (b != stop) {
+        struct block* next = b->next;
+        if (a->pool && b->cap == BLOCK_SIZE) {
+            b->next = first;
+            first = b;
+        }
+        else {
+            freeBlock(b);
+        }
+        b = next;
+    }
+    if (first) pool_put(a->pool, first);
+}
+
+// ---- Arena ----
+
 void arena_init(struct arena* a) {
     a->head = NULL;
     a->current_block = NULL;
+    a->pool = NULL;
+}
+
+void arena_init_pool(struct arena* a, struct block_pool* pool) {
+    arena_init(a);
+    a->pool = pool;
 }
 
 void arena_destroy(struct arena* a) {
-    struct block* prev = NULL;
-    struct block* b = a->head;
-    while (b) {
-        prev = b;
-        b = b->next;
-        freeBlock(prev);
-    }
+    arena_drop(a, a->head, NULL);
     a->head = NULL;
     a->current_block = NULL;
 }
@@ -64,7 +224,7 @@ void* arena_alloc_align(struct arena* a, size_t size, size_t align) {
     struct block* b = a->current_block;
 
     if (b == NULL) {
-        b = allocBlock(BLOCK_SIZE);
+        b = arena_new_block(a, BLOCK_SIZE);
         if (b == NULL) {
             errno = ENOMEM;
             return NULL;
@@ -82,7 +242,7 @@ void* arena_alloc_align(struct arena* a, size_t size, size_t align) {
         }
         size_t need = size + align;
         size_t cap = (need > BLOCK_SIZE) ? need : BLOCK_SIZE;
-        b = allocBlock(cap);
+        b = arena_new_block(a, cap);
         if (b == NULL) {
             errno = ENOMEM;
             return NULL;
@@ -123,17 +283,43 @@ void arena_reset(struct arena* a) {
     if (!a->head) {
         return;
     }
-    struct block* b = a->head->next;
-    while (b) {
-        struct block* next = b->next;
-        freeBlock(b);
-        b = next;
-    }
+    arena_drop(a, a->head->next, NULL);
     a->head->next = NULL;
     a->current_block = a->head;
     a->current_block->used = 0;
 }
 
+// bytes handed out since the last reset, summed over all blocks
+size_t arena_used(const struct arena* a) {
+    size_t used = 0;
+    for ( struct block* b = a->head ; b ; b = b->next ) {
+        used += b->used;
+    }
+    return used;
+}
+
+struct arena_mark arena_get_mark(const struct arena* a) {
+    struct arena_mark mark;
+    mark.block = a->current_block;
+    mark.used = a->current_block ? a->current_block->used : 0;
+    return mark;
+}
+
+// frees everything allocated after mark was taken; new blocks are always
+// pushed at the head, so they are exactly the ones in front of mark.block
+void arena_release(struct arena* a, struct arena_mark mark) {
+    struct block* b = a->head;
+    while (b && b != mark.block) {
+        // marked while empty: keep one block around like arena_reset does
+        if (!mark.block && !b->next) break;
+        b = b->next;
+    }
+    arena_drop(a, a->head, b);
+    a->head = b;
+    a->current_block = b;
+    if (b) b->used = mark.block ? mark.used : 0;
+}
+
 struct block* allocBlock(size_t block_size) {
 
     struct block* b = malloc(sizeof(struct block) + block_size);
@@ -8,9 +8,12 @@
 #include <errno.h>
 #include <stdint.h>
 #include <stdalign.h>
+#include <stdatomic.h>
 
 #define BLOCK_SIZE (1024u * 64u)
 #define ALIGN_UP(x, align) (((x) + ((align) - 1)) & ~((align) - 1))
+#define POOL_CACHE 16u   // BLOCK_SIZE blocks a thread keeps before using the pool
+#define POOL_SLOTS 64u   // batches of up to POOL_CACHE blocks a pool keeps, more are freed
 
 struct block {
     struct block* next;
@@ -19,19 +22,55 @@ struct block {
     alignas(max_align_t) unsigned char data[]; // flexible array member
 };
 
+// An arena belongs to one thread at a time. Arenas of worker threads can
+// share their BLOCK_SIZE blocks through a pool instead of malloc/free:
+// arena_alloc stays a bump in the thread's own block, a new block comes
+// from a per-thread cache of POOL_CACHE blocks, and only an empty cache
+// goes to the pool (and only an empty pool to malloc). arena_reset,
+// arena_release and arena_destroy hand their blocks back to the cache
+// and the overflow to the pool in batches. Bigger blocks are never
+// pooled.
+//
+// The pool is POOL_SLOTS slots of one batch each: a chain of at most
+// POOL_CACHE blocks, its length in the first one's used. A batch goes in
+// with a compare-and-swap into an empty slot and comes out with an
+// exchange that empties one, so there is no ABA problem and no list to
+// walk, and a full pool frees what doesn't fit.
+struct block_pool {
+    _Atomic(struct block*) slots[POOL_SLOTS];
+    atomic_uint users; // threads whose cache holds blocks of this pool
+};
+
 struct arena {
     struct block* head;
     struct block* current_block;
+    struct block_pool* pool; // NULL: blocks come from malloc
+};
+
+// position to roll the arena back to with arena_release
+struct arena_mark {
+    struct block* block;
+    size_t used;
 };
 
 void arena_init(struct arena* a);
+void arena_init_pool(struct arena* a, struct block_pool* pool);
 void arena_destroy(struct arena* a);
 void* arena_alloc(struct arena* a, size_t size);
 void* arena_alloc_align(struct arena* a, size_t size, size_t align);
 void* arena_calloc(struct arena* a, size_t count, size_t size);
 unsigned char* arena_strdup(struct arena *a, const char *s);
 void arena_reset(struct arena* a);
+size_t arena_used(const struct arena* a);
+struct arena_mark arena_get_mark(const struct arena* a);
+void arena_release(struct arena* a, struct arena_mark mark);
 struct block* allocBlock(size_t block_size);
 void freeBlock(struct block* b);
 
+void pool_init(struct block_pool* pool);
+// frees the pooled blocks and the calling thread's cached ones. Every
+// other thread that used the pool must have exited first, which puts its
+// cache back (asserted).
+void pool_destroy(struct block_pool* pool);
+
 #endif
@@ -0,0 +1,129 @@
+#include "cmd.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void token_init(struct Token* token) {
+    token->tok_type = TOK_NONE;
+    token->rd_type = R_NONE;
+    token->fd = -1;
+    token->quoted = 0;
+    token->copied = 0;
+    token->off = 0;
+    token->len = 0;
+}
+
+void toklist_init(struct TokenList* toklist) {
+    toklist->tokens = NULL;
+    toklist->ntoks = 0;
+    toklist->tok_cap = 0;
+    toklist->src = NULL;
+    toklist->src_len = 0;
+    toklist->extra = NULL;
+    toklist->extra_len = 0;
+    toklist->extra_cap = 0;
+}
+
+void initCmd(struct Cmd* cmd) {
+  cmd->argc = 0;
+  cmd->argv = NULL;
+  cmd->cap = DEFAULT_NUM_ARG;
+  cmd->rds = NULL;
+  cmd->nrds = 0;
+  cmd->rd_cap = DEFAULT_REDIR_CAP;
+}
+
+void initCmdRedir(struct Cmd* cmd, struct arena* a) {
+    cmd->rds = arena_alloc(a, cmd->rd_cap * sizeof(struct Redir));
+    if (cmd->rds == NULL) {
+        perror("Not enough memory at initCmdRedir");
+        return;
+    }
+}
+
+void initCmdArgv(struct Cmd* cmd, struct arena* a) {
+    cmd->argv = arena_alloc(a, cmd->cap * sizeof(char*));
+    if (cmd->argv == NULL) {
+        perror("Not enough memory at initCmdArgv");
+        return;
+    }
+    for ( size_t i = 0 ; i < cmd->cap ; ++i ) {
+        cmd->argv[i] = NULL;
+    }
+}
+
+int cmdRedirGrow(struct Cmd* cmd, struct arena* a) {
+    size_t old = cmd->rd_cap;
+    size_t new = old * 2;
+
+    struct Redir* v = arena_alloc(a, sizeof(struct Redir) * new);
+    if (!v) return -1;
+
+    memcpy(v, cmd->rds, sizeof(struct Redir) * old);
+    memset(v + old, 0, sizeof(struct Redir) * (new - old));
+
+    cmd->rds = v;
+    cmd->rd_cap  = new;
+    return 0;
+}
+
+int cmdArgvGrow(struct Cmd* cmd, struct arena* a) {
+    size_t old = cmd->cap;
+    size_t new = old * 2;
+
+    char** v = arena_alloc(a, sizeof(char*) * new);
+    if (!v) return -1;
+
+    memcpy(v, cmd->argv, sizeof(char*) * old);
+    memset(v + old, 0, sizeof(char*) * (new - old));
+
+    cmd->argv = v;
+    cmd->cap  = new;
+    return 0;
+}
+
+int tokListGrow(struct TokenList* toklist, struct arena* a) {
+    size_t old = toklist->tok_cap;
+    size_t new = old * 2;
+    if (old == 0) new = DEFAULT_NUM_TOKENS;
+
+    struct Token* v = arena_alloc(a, sizeof(struct Token) * new);
+    if (!v) return -1;
+
+    memcpy(v, toklist->tokens, sizeof(struct Token) * old);
+    memset(v + old, 0, sizeof(struct Token) * (new - old));
+
+    toklist->tokens = v;
+    toklist->tok_cap  = new;
+
+    for (size_t num_tok = old ; num_tok < toklist->tok_cap ; num_tok++) {
+        token_init(&toklist->tokens[num_tok]);
+    }
+
+    return 0;
+}
+
+int toklist_push(struct TokenList* toklist, struct arena* a, struct Token token) {
+    if (toklist->ntoks == toklist->tok_cap) {
+        if (tokListGrow(toklist, a) < 0) return -1;
+    }
+    toklist->tokens[toklist->ntoks++] = token;
+    return 0;
+}
+
+struct Cmd* createCmd() {
+  struct Cmd* cmd = (struct Cmd*)malloc(sizeof(struct Cmd));
+  initCmd(cmd);
+  return cmd;
+}
+
+int push_argv(struct Cmd* cmd, struct arena* a, char* text) {
+    if (cmd->argc + 1 >= cmd->cap ) {
+        if (cmdArgvGrow(cmd, a) < 0) return -1;
+    }
+    cmd->argv[cmd->argc++] = text;
+    cmd->argv[cmd->argc] = NULL;
+    return 0;
+}
+
@@ -0,0 +1,102 @@
+#ifndef CMD_H
+#define CMD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+
+#define DEFAULT_STR_ALLOC 64
+#define MAX_STR_ALLOC 1024
+
+#define DEFAULT_NUM_TOKENS 10
+#define DEFAULT_NUM_ARG 8
+#define DEFAULT_REDIR_CAP 6
+
+enum RedirType {
+    R_IN,             // [n]<
+    R_OUT,            // [n]> and [n]>|
+    R_OUT_APPEND,     // [n]>>
+    R_RDWR,           // [n]<>
+    R_DUP_IN,         // [n]<&M, [n]<&-
+    R_DUP_OUT,        // [n]>&M, [n]>&-
+    R_OUT_BOTH,       // &> (and >&file)
+    R_OUT_BOTH_APPEND, // &>>
+    R_HEREDOC,        // path is the body, still to be expanded
+    R_HEREDOC_QUOTED, // path is the body, delimiter was quoted: taken as is
+    R_NONE
+};
+
+struct Redir {
+    int fd;
+    enum RedirType rd_type;
+    const char* path;
+};
+
+enum TokenType {
+    TOK_WORD,
+    TOK_REDIR,
+    TOK_PIPE,
+    TOK_AND_IF,   // &&
+    TOK_OR_IF,    // ||
+    TOK_SEMI,     // ;
+    TOK_AMP,      // &
+    TOK_NEWLINE,
+    TOK_LPAREN,
+    TOK_RPAREN,
+    TOK_NONE
+};
+
+// a token is a slice of the line it came from: no text is copied while
+// tokenizing, except for words that had to be rewritten (a \<newline>
+// inside the word, a <<- body), which are cut from TokenList.extra instead
+struct Token {
+    uint32_t off;
+    uint32_t len;
+    unsigned tok_type : 4; // enum TokenType
+    unsigned rd_type : 4;  // enum RedirType, TOK_REDIR
+    unsigned quoted : 1;   // any part of a WORD was quoted, so it can't be a keyword
+    unsigned copied : 1;   // off indexes extra rather than src
+    signed fd : 16;        // TOK_REDIR, at most MAX_FD_DIGITS digits
+};
+
+struct TokenList {
+    struct Token* tokens;
+    size_t ntoks;
+    size_t tok_cap;
+    const char* src; // the tokenized line, has to outlive the list
+    size_t src_len;
+    char* extra;     // rewritten words, in the tokenizer's arena
+    size_t extra_len;
+    size_t extra_cap;
+};
+
+// the text of a token, tok->len bytes and not NUL-terminated
+static inline const char* tok_text(const struct TokenList* toklist, const struct Token* tok) {
+    return (tok->copied ? toklist->extra : toklist->src) + tok->off;
+}
+
+struct Cmd {
+  size_t argc;
+  char** argv;
+  size_t cap;
+  struct Redir* rds;
+  size_t nrds;
+  size_t rd_cap;
+};
+
+void token_init(struct Token* token);
+void toklist_init(struct TokenList* toklist);
+int tokListGrow(struct TokenList* toklist, struct arena* a);
+int toklist_push(struct TokenList* toklist, struct arena* a, struct Token token);
+
+struct Cmd* createCmd();
+void freeCmd(struct Cmd* cmd);
+void initCmd(struct Cmd* cmd);
+void initCmdArgv(struct Cmd* cmd, struct arena* a);
+void initCmdRedir(struct Cmd* cmd, struct arena* a);
+int cmdRedirGrow(struct Cmd* cmd, struct arena* a);
+int cmdArgvGrow(struct Cmd* cmd, struct arena* a);
+int push_argv(struct Cmd* cmd, struct arena* a, char* text);
+
+#endif
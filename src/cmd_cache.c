@@ -0,0 +1,133 @@
+#include "cmd_cache.h"
+#include "hash.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+static void drop_entries(struct cmd_cache* c) {
+    memset(c->entries, 0, sizeof(c->entries));
+    memset(c->buckets, 0, sizeof(c->buckets));
+    c->lru_head = NULL;
+    c->lru_tail = NULL;
+    c->nentries = 0;
+}
+
+void cmd_cache_init(struct cmd_cache* c) {
+    arena_init(&c->a);
+    drop_entries(c);
+    c->dead_bytes = 0;
+    c->begin_used = 0;
+    c->flush_pending = 0;
+    memset(&c->stats, 0, sizeof(c->stats));
+}
+
+void cmd_cache_destroy(struct cmd_cache* c) {
+    arena_destroy(&c->a);
+    cmd_cache_init(c);
+}
+
+// forgets every entry but keeps the statistics. The tree that is running
+// right now may live in the arena, so the memory goes at the next begin.
+void cmd_cache_clear(struct cmd_cache* c) {
+    drop_entries(c);
+    c->flush_pending = 1;
+}
+
+/* LRU list */
+
+static void lru_unlink(struct cmd_cache* c, struct cmd_cache_entry* e) {
+    if (e->prev) e->prev->next = e->next;
+    else c->lru_head = e->next;
+    if (e->next) e->next->prev = e->prev;
+    else c->lru_tail = e->prev;
+    e->prev = NULL;
+    e->next = NULL;
+}
+
+static void lru_push_front(struct cmd_cache* c, struct cmd_cache_entry* e) {
+    e->prev = NULL;
+    e->next = c->lru_head;
+    if (c->lru_head) c->lru_head->prev = e;
+    c->lru_head = e;
+    if (!c->lru_tail) c->lru_tail = e;
+}
+
+/* buckets */
+
+static void bucket_remove(struct cmd_cache* c, struct cmd_cache_entry* e) {
+    struct cmd_cache_entry** pp = &c->buckets[e->hash & (CMD_CACHE_BUCKETS - 1)];
+    while (*pp && *pp != e) pp = &(*pp)->hnext;
+    if (*pp) *pp = e->hnext;
+    e->hnext = NULL;
+}
+
+/* public api */
+
+struct Node* cmd_cache_get(struct cmd_cache* c, const char* line) {
+    uint64_t h = hash_bytes(line, strlen(line));
+    struct cmd_cache_entry* e = c->buckets[h & (CMD_CACHE_BUCKETS - 1)];
+    for ( ; e ; e = e->hnext) {
+        if (e->hash == h && strcmp(e->line, line) == 0) {
+            if (c->lru_head != e) {
+                lru_unlink(c, e);
+                lru_push_front(c, e);
+            }
+            c->stats.hits++;
+            return e->node;
+        }
+    }
+    c->stats.misses++;
+    return NULL;
+}
+
+// returns the arena the next tree should be parsed into
+struct arena* cmd_cache_begin(struct cmd_cache* c) {
+    // evicted entries still occupy the arena, reclaim it all at once
+    if (c->flush_pending || c->dead_bytes > CMD_CACHE_DEAD_LIMIT) {
+        drop_entries(c);
+        arena_reset(&c->a);
+        c->dead_bytes = 0;
+        c->flush_pending = 0;
+        c->stats.flushes++;
+    }
+    c->begin_used = arena_used(&c->a);
+    return &c->a;
+}
+
+// whatever was parsed since begin will never be looked up
+void cmd_cache_abort(struct cmd_cache* c) {
+    c->dead_bytes += arena_used(&c->a) - c->begin_used;
+}
+
+int cmd_cache_put(struct cmd_cache* c, const char* line, struct Node* node) {
+    struct cmd_cache_entry* e;
+    if (c->nentries < CMD_CACHE_ENTRIES) {
+        e = &c->entries[c->nentries++];
+    }
+    else {
+        e = c->lru_tail;
+        lru_unlink(c, e);
+        bucket_remove(c, e);
+        c->dead_bytes += e->bytes;
+        c->stats.evictions++;
+    }
+
+    e->hash = hash_bytes(line, strlen(line));
+    e->line = (char*)arena_strdup(&c->a, line);
+    e->node = node;
+    e->bytes = arena_used(&c->a) - c->begin_used;
+    if (!e->line) {
+        // node stays valid until the next begin, it just can't be found again
+        cmd_cache_clear(c);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    size_t b = e->hash & (CMD_CACHE_BUCKETS - 1);
+    e->hnext = c->buckets[b];
+    c->buckets[b] = e;
+    lru_push_front(c, e);
+    return 0;
+}
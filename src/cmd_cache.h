@@ -0,0 +1,59 @@
+#ifndef CMD_CACHE_H
+#define CMD_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "parser.h"
+
+#define CMD_CACHE_ENTRIES 64
+#define CMD_CACHE_BUCKETS 128 // power of two
+// once this many bytes belong to evicted entries the arena is flushed
+#define CMD_CACHE_DEAD_LIMIT (256u * 1024u)
+
+struct cmd_cache_entry {
+    uint64_t hash;
+    const char* line;
+    size_t bytes; // arena bytes owned by this entry
+    struct Node* node;
+    struct cmd_cache_entry* hnext; // bucket chain
+    struct cmd_cache_entry* prev;  // LRU list, head is most recent
+    struct cmd_cache_entry* next;
+};
+
+struct cmd_cache_stats {
+    size_t hits;
+    size_t misses;
+    size_t evictions;
+    size_t flushes;
+};
+
+// compiled (tokenized + parsed) input keyed by its text. Trees are parsed
+// straight into the cache arena between cmd_cache_begin and cmd_cache_put,
+// which is also the only place the arena is ever flushed, so a tree returned
+// by cmd_cache_get stays valid until the next cmd_cache_begin.
+struct cmd_cache {
+    struct arena a;
+    struct cmd_cache_entry entries[CMD_CACHE_ENTRIES];
+    struct cmd_cache_entry* buckets[CMD_CACHE_BUCKETS];
+    struct cmd_cache_entry* lru_head;
+    struct cmd_cache_entry* lru_tail;
+    size_t nentries;
+    size_t dead_bytes;
+    size_t begin_used;
+    int flush_pending;
+    struct cmd_cache_stats stats;
+};
+
+extern struct cmd_cache cmd_cache;
+
+void cmd_cache_init(struct cmd_cache* c);
+void cmd_cache_destroy(struct cmd_cache* c);
+void cmd_cache_clear(struct cmd_cache* c);
+struct Node* cmd_cache_get(struct cmd_cache* c, const char* line);
+struct arena* cmd_cache_begin(struct cmd_cache* c);
+void cmd_cache_abort(struct cmd_cache* c);
+int cmd_cache_put(struct cmd_cache* c, const char* line, struct Node* node);
+
+#endif
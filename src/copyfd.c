@@ -0,0 +1,171 @@
+#define _GNU_SOURCE // copy_file_range, splice, tee, F_GETPIPE_SZ
+#include "copyfd.h"
+#include "fdtrack.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+
+// in .bss: no memory until the read/write fallback first runs
+static char copy_buf[COPY_BUF_SIZE];
+
+enum copy_method { C_RANGE, C_SENDFILE, C_SPLICE, C_READ };
+
+// errors that say "not with these fds", not "this failed"
+static int unsupported(int err) {
+    return err == EINVAL || err == EXDEV || err == ENOSYS || err == EOPNOTSUPP ||
+           err == ENOTSUP || err == EBADF;
+}
+
+static int write_all(int fd, const char* p, size_t n) {
+    while (n > 0) {
+        ssize_t w = write(fd, p, n);
+        if (w < 0 && errno == EINTR) continue;
+        if (w < 0) return -1;
+        p += w;
+        n -= (size_t)w;
+    }
+    return 0;
+}
+
+// /proc and sysfs files say size 0 and copy_file_range copies nothing
+// from them: only files with a size go through the kernel-side copies
+static enum copy_method first_method(const struct stat* in, const struct stat* out) {
+    int sized = S_ISREG(in->st_mode) && in->st_size > 0;
+    if (sized && S_ISREG(out->st_mode)) return C_RANGE;
+    if (sized) return C_SENDFILE;
+    if (S_ISFIFO(in->st_mode) || S_ISFIFO(out->st_mode)) return C_SPLICE;
+    return C_READ;
+}
+
+static ssize_t copy_step(enum copy_method m, int in, int out) {
+    switch (m) {
+        case C_RANGE: return copy_file_range(in, NULL, out, NULL, COPY_CHUNK, 0);
+        case C_SENDFILE: return sendfile(out, in, NULL, COPY_CHUNK);
+        case C_SPLICE: return splice(in, NULL, out, NULL, COPY_CHUNK, SPLICE_F_MOVE);
+        case C_READ: break;
+    }
+    ssize_t r = read(in, copy_buf, sizeof(copy_buf));
+    if (r > 0 && write_all(out, copy_buf, (size_t)r) < 0) return -1;
+    return r;
+}
+
+int copy_fd(int in, int out) {
+    struct stat ist, ost;
+    if (fstat(in, &ist) < 0 || fstat(out, &ost) < 0) return -1;
+    enum copy_method m = first_method(&ist, &ost);
+    for (;;) {
+        ssize_t r = copy_step(m, in, out);
+        if (r == 0) return 0;
+        if (r > 0) continue;
+        if (errno == EINTR) continue;
+        if (m == C_READ || !unsupported(errno)) return -1;
+        // every method reads at in's offset, the next one carries on from there
+        if (m == C_RANGE) m = C_SENDFILE;
+        else if (m == C_SENDFILE && S_ISFIFO(ost.st_mode)) m = C_SPLICE;
+        else m = C_READ;
+    }
+}
+
+/* tee */
+
+// moves n bytes already in pipe from to out, 0 or -1
+static int splice_n(int from, int out, size_t n) {
+    while (n > 0) {
+        ssize_t r = splice(from, NULL, out, NULL, n, SPLICE_F_MOVE);
+        if (r < 0 && errno == EINTR) continue;
+        if (r == 0) errno = EIO;
+        if (r <= 0) return -1;
+        n -= (size_t)r;
+    }
+    return 0;
+}
+
+// tee(2) copies pipe buffers to stdout's pipe and, through a pipe of our
+// own, to the files, then splice() drops them from in. Only for in and
+// outs[0] pipes, the rest files without O_APPEND (splice refuses those).
+// 1 when this can't be used, else as tee_fds.
+static int tee_spliced(int in, const int* outs, size_t n, int* failed) {
+    struct stat st;
+    if (fstat(in, &st) < 0 || !S_ISFIFO(st.st_mode)) return 1;
+    if (fstat(outs[0], &st) < 0 || !S_ISFIFO(st.st_mode)) return 1;
+    for ( size_t i = 1 ; i < n ; ++i ) {
+        if (fstat(outs[i], &st) < 0 || !S_ISREG(st.st_mode)) return 1;
+        if (fcntl(outs[i], F_GETFL) & O_APPEND) return 1;
+    }
+    int priv[2] = { -1, -1 };
+    int null = fd_track(open("/dev/null", O_WRONLY | O_CLOEXEC), "tee");
+    if (null < 0 || (n > 1 && pipe2(priv, O_CLOEXEC) < 0)) {
+        if (null >= 0) fd_close(null);
+        return 1;
+    }
+    fd_track(priv[0], "tee pipe");
+    fd_track(priv[1], "tee pipe");
+    // one tee() never takes more than in holds, which then fits
+    if (n > 1) fcntl(priv[1], F_SETPIPE_SZ, fcntl(in, F_GETPIPE_SZ));
+
+    int rc = 0;
+    for (;;) {
+        ssize_t m = tee(in, outs[0], COPY_CHUNK, 0);
+        if (m < 0 && errno == EINTR) continue;
+        if (m < 0) {
+            // stdout is gone: the rest goes the slow way to the files
+            failed[0] = errno;
+            rc = 1;
+            break;
+        }
+        if (m == 0) break;
+        for ( size_t i = 1 ; i < n ; ++i ) {
+            if (failed[i]) continue;
+            ssize_t t;
+            do {
+                t = tee(in, priv[1], (size_t)m, 0);
+            } while (t < 0 && errno == EINTR);
+            int err = t < 0 ? errno : t != m ? EIO : 0;
+            if (!err && splice_n(priv[0], outs[i], (size_t)m) < 0) err = errno;
+            if (err) {
+                failed[i] = err;
+                // whatever is left in our pipe must not reach the next file
+                if (t > 0) splice(priv[0], NULL, null, NULL, (size_t)t, SPLICE_F_NONBLOCK);
+            }
+        }
+        if (splice_n(in, null, (size_t)m) < 0) {
+            rc = -1;
+            break;
+        }
+    }
+    fd_close(null);
+    if (priv[0] >= 0) {
+        fd_close(priv[0]);
+        fd_close(priv[1]);
+    }
+    return rc;
+}
+
+int tee_fds(int in, const int* outs, size_t n, int* failed) {
+    int rc = n > 0 ? tee_spliced(in, outs, n, failed) : 1;
+    if (rc <= 0) goto out;
+
+    for (;;) {
+        ssize_t r = read(in, copy_buf, sizeof(copy_buf));
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0) return -1;
+        if (r == 0) break;
+        int live = 0;
+        for ( size_t i = 0 ; i < n ; ++i ) {
+            if (failed[i]) continue;
+            if (write_all(outs[i], copy_buf, (size_t)r) < 0) failed[i] = errno;
+            else live++;
+        }
+        // every output failed
+        if (!live) break;
+    }
+    rc = 0;
+out:
+    for ( size_t i = 0 ; i < n ; ++i ) {
+        if (failed[i]) rc = -1;
+    }
+    return rc;
+}
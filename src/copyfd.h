@@ -0,0 +1,25 @@
+#ifndef COPYFD_H
+#define COPYFD_H
+
+#include <stddef.h>
+
+#define COPY_BUF_SIZE (128 * 1024)  // the read/write fallback's buffer
+#define COPY_CHUNK (1L << 30)       // most bytes asked of one kernel copy call
+
+// moves data between fds for the cat and tee builtins without it passing
+// through the shell where the kernel can do the copy: copy_file_range
+// between files (a reflink or server-side copy where the filesystem has
+// one), sendfile from a file, splice to or from a pipe, tee(2) to
+// duplicate a pipe. Each falls back to the next when the fds don't allow
+// it (O_APPEND, crossing filesystems, a tty), read/write being the last.
+
+// everything from in (up to EOF) to out. -1 with errno on a failure,
+// which may be after part of the data was written
+int copy_fd(int in, int out);
+
+// everything from in to each of outs. Keeps going when one of them fails
+// and returns -1 then, with failed[i] (zeroed by the caller) set to the
+// errno it got.
+int tee_fds(int in, const int* outs, size_t n, int* failed);
+
+#endif
@@ -0,0 +1,268 @@
+#define _GNU_SOURCE // strchrnul
+#include "dirs.h"
+#include "vars.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+struct dir_stack dir_stack;
+
+/* logical paths */
+
+// base/path with ".", ".." and repeated slashes folded away textually, the
+// way cd -L treats them: a/link/.. is a, whatever link points to
+static char* canon_path(const char* base, const char* path) {
+    size_t blen = (path[0] == '/' || !base) ? 0 : strlen(base);
+    size_t plen = strlen(path);
+    char* out = malloc(blen + plen + 3);
+    if (!out) return NULL;
+
+    size_t n = 0;
+    const char* parts[2] = { blen ? base : NULL, path };
+    for ( int k = 0 ; k < 2 ; ++k ) {
+        const char* s = parts[k];
+        while (s && *s) {
+            while (*s == '/') s++;
+            const char* end = strchrnul(s, '/');
+            size_t len = (size_t)(end - s);
+            if (len == 0 || (len == 1 && s[0] == '.')) {
+                // nothing
+            }
+            else if (len == 2 && s[0] == '.' && s[1] == '.') {
+                while (n > 0 && out[n - 1] != '/') n--;
+                if (n > 0) n--;
+            }
+            else {
+                out[n++] = '/';
+                memcpy(out + n, s, len);
+                n += len;
+            }
+            s = end;
+        }
+    }
+    if (n == 0) out[n++] = '/';
+    out[n] = '\0';
+    return out;
+}
+
+static int same_file(const char* a, const char* b) {
+    struct stat sa, sb;
+    if (stat(a, &sa) < 0 || stat(b, &sb) < 0) return 0;
+    return sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+}
+
+static int is_dir(const char* path) {
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+/* init / destroy */
+
+int dirs_init(struct dir_stack* ds) {
+    memset(ds, 0, sizeof(*ds));
+
+    // an inherited $PWD is kept when it still names ".", so the logical
+    // path (symlinks and all) survives into the shell without a getcwd
+    const char* env = vars_get(&shell_vars, "PWD");
+    if (env && env[0] == '/' && same_file(env, ".")) {
+        char* c = canon_path(NULL, env);
+        if (c && strcmp(c, env) == 0) ds->pwd = c;
+        else free(c);
+    }
+    if (!ds->pwd) {
+        char cwd[PATH_MAX];
+        if (getcwd(cwd, sizeof(cwd))) ds->pwd = strdup(cwd);
+    }
+    if (ds->pwd) vars_set(&shell_vars, "PWD", ds->pwd, 0);
+    return 0;
+}
+
+void dirs_destroy(struct dir_stack* ds) {
+    dirs_clear(ds);
+    free(ds->dirs);
+    free(ds->pwd);
+    memset(ds, 0, sizeof(*ds));
+}
+
+const char* dirs_pwd(struct dir_stack* ds) {
+    return ds->pwd;
+}
+
+/* cd */
+
+// the cached directory moves to pwd (owned), the old one becomes OLDPWD
+static void set_pwd(struct dir_stack* ds, char* pwd) {
+    if (ds->pwd) vars_set(&shell_vars, "OLDPWD", ds->pwd, 0);
+    free(ds->pwd);
+    ds->pwd = pwd;
+    if (pwd) vars_set(&shell_vars, "PWD", pwd, 0);
+}
+
+// chdir to the logical form of target, falling back to the physical path
+// (and one getcwd) when the textual .. walk leads somewhere that fails
+static int go(struct dir_stack* ds, const char* target) {
+    if (ds->pwd || target[0] == '/') {
+        char* logical = canon_path(ds->pwd, target);
+        if (!logical) return -1;
+        if (chdir(logical) == 0) {
+            set_pwd(ds, logical);
+            return 0;
+        }
+        free(logical);
+    }
+
+    if (chdir(target) < 0) return -1;
+    char cwd[PATH_MAX];
+    set_pwd(ds, getcwd(cwd, sizeof(cwd)) ? strdup(cwd) : NULL);
+    return 0;
+}
+
+// the first CDPATH entry holding dir, NULL to use dir as it is. *print is
+// set for a non-empty entry: the user could not know where cd went.
+static char* cdpath_find(struct dir_stack* ds, const char* dir, int* print) {
+    const char* cdpath = vars_get(&shell_vars, "CDPATH");
+    if (!cdpath || dir[0] == '/') return NULL;
+    if (dir[0] == '.' && (dir[1] == '\0' || dir[1] == '/' ||
+                          (dir[1] == '.' && (dir[2] == '\0' || dir[2] == '/')))) {
+        return NULL;
+    }
+
+    size_t dlen = strlen(dir);
+    const char* s = cdpath;
+    for (;;) {
+        const char* end = strchrnul(s, ':');
+        size_t len = (size_t)(end - s);
+        char* cand = malloc(len + dlen + 2);
+        if (!cand) return NULL;
+        if (len) {
+            memcpy(cand, s, len);
+            cand[len] = '/';
+            memcpy(cand + len + 1, dir, dlen + 1);
+        }
+        else {
+            memcpy(cand, dir, dlen + 1);
+        }
+
+        char* full = (cand[0] != '/' && ds->pwd) ? canon_path(ds->pwd, cand) : NULL;
+        int hit = is_dir(full ? full : cand);
+        free(full);
+        if (hit) {
+            *print = (len != 0);
+            return cand;
+        }
+        free(cand);
+        if (*end == '\0') return NULL;
+        s = end + 1;
+    }
+}
+
+int dirs_cd(struct dir_stack* ds, const char* arg, int* print) {
+    *print = 0;
+    if (!arg) {
+        arg = vars_get(&shell_vars, "HOME");
+        if (!arg) {
+            errno = ENOENT;
+            return -1;
+        }
+    }
+    else if (strcmp(arg, "-") == 0) {
+        arg = vars_get(&shell_vars, "OLDPWD");
+        if (!arg) {
+            errno = ENOENT;
+            return -1;
+        }
+        *print = 1;
+    }
+
+    // arg may point into OLDPWD, which go() replaces
+    char* target = cdpath_find(ds, arg, print);
+    if (!target) target = strdup(arg);
+    if (!target) return -1;
+    int rc = go(ds, target);
+    free(target);
+    return rc;
+}
+
+/* pushd / popd / dirs */
+
+static int stack_push(struct dir_stack* ds, char* dir) {
+    if (ds->n == ds->cap) {
+        size_t cap = ds->cap ? ds->cap * 2 : DIRS_DEFAULT_CAP;
+        char** d = realloc(ds->dirs, cap * sizeof(char*));
+        if (!d) return -1;
+        ds->dirs = d;
+        ds->cap = cap;
+    }
+    ds->dirs[ds->n++] = dir;
+    return 0;
+}
+
+int dirs_push(struct dir_stack* ds, const char* arg) {
+    char* old = ds->pwd ? strdup(ds->pwd) : NULL;
+    if (!old) return -1;
+    int print = 0;
+    if (dirs_cd(ds, arg, &print) < 0 || stack_push(ds, old) < 0) {
+        free(old);
+        return -1;
+    }
+    return 0;
+}
+
+// pushd without an argument: exchange the top two entries
+int dirs_swap(struct dir_stack* ds) {
+    if (ds->n == 0 || !ds->pwd) {
+        errno = ENOENT;
+        return -1;
+    }
+    char* old = strdup(ds->pwd);
+    if (!old) return -1;
+    if (go(ds, ds->dirs[ds->n - 1]) < 0) {
+        free(old);
+        return -1;
+    }
+    free(ds->dirs[ds->n - 1]);
+    ds->dirs[ds->n - 1] = old;
+    return 0;
+}
+
+int dirs_pop(struct dir_stack* ds) {
+    if (ds->n == 0) {
+        errno = ENOENT;
+        return -1;
+    }
+    if (go(ds, ds->dirs[ds->n - 1]) < 0) return -1;
+    free(ds->dirs[--ds->n]);
+    return 0;
+}
+
+void dirs_clear(struct dir_stack* ds) {
+    for ( size_t i = 0 ; i < ds->n ; ++i ) free(ds->dirs[i]);
+    ds->n = 0;
+}
+
+// prints dir with $HOME abbreviated to ~
+static void print_dir(const char* dir, const char* home, size_t hlen) {
+    if (hlen > 1 && strncmp(dir, home, hlen) == 0 && (dir[hlen] == '\0' || dir[hlen] == '/')) {
+        printf("~%s", dir + hlen);
+    }
+    else {
+        fputs(dir, stdout);
+    }
+}
+
+void dirs_print(struct dir_stack* ds, int verbose) {
+    const char* home = vars_get(&shell_vars, "HOME");
+    size_t hlen = home ? strlen(home) : 0;
+    size_t total = ds->n + 1;
+    for ( size_t i = 0 ; i < total ; ++i ) {
+        const char* dir = (i == 0) ? (ds->pwd ? ds->pwd : ".") : ds->dirs[ds->n - i];
+        if (verbose) printf("%2zu  ", i);
+        print_dir(dir, home, hlen);
+        putchar(verbose || i + 1 == total ? '\n' : ' ');
+    }
+}
@@ -0,0 +1,32 @@
+#ifndef DIRS_H
+#define DIRS_H
+
+#include <stddef.h>
+
+#define DIRS_DEFAULT_CAP 8
+
+// the logical working directory (what $PWD says, symlinks kept) is cached
+// here and only changes on cd, so pwd and the prompt never call getcwd
+struct dir_stack {
+    char* pwd;      // NULL: unknown, fall back to getcwd
+    char** dirs;    // pushd stack, dirs[n-1] is the most recent
+    size_t n;
+    size_t cap;
+};
+
+extern struct dir_stack dir_stack;
+
+int dirs_init(struct dir_stack* ds);
+void dirs_destroy(struct dir_stack* ds);
+const char* dirs_pwd(struct dir_stack* ds);
+
+// cd: resolves ~, - and CDPATH, changes directory and updates PWD/OLDPWD.
+// *print is set when the new directory should be echoed (cd -, CDPATH hit).
+int dirs_cd(struct dir_stack* ds, const char* arg, int* print);
+int dirs_push(struct dir_stack* ds, const char* arg);
+int dirs_swap(struct dir_stack* ds);
+int dirs_pop(struct dir_stack* ds);
+void dirs_clear(struct dir_stack* ds);
+void dirs_print(struct dir_stack* ds, int verbose);
+
+#endif
@@ -0,0 +1,253 @@
+#define _GNU_SOURCE // pidfd_open via syscall, signalfd, timerfd
+#include "evloop.h"
+#include "fdtrack.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+
+// epoll_event.data for what isn't a child: children are their index
+#define TAG_SIGNAL   UINT64_MAX
+#define TAG_TIMER    (UINT64_MAX - 1)
+#define TAG_DEADLINE (UINT64_MAX - 2)
+
+static int ep_fd = -1;
+static int sig_fd = -1;
+static int timer_fd = -1;
+// a forked subshell must not add its children to the parent's epoll set
+// or arm the parent's timer: it makes its own
+static pid_t ev_owner;
+static int timer_armed;
+
+static void ev_signals(sigset_t* set) {
+    sigemptyset(set);
+    sigaddset(set, SIGINT);
+    sigaddset(set, SIGTERM);
+    sigaddset(set, SIGHUP);
+    sigaddset(set, SIGQUIT);
+}
+
+void ev_destroy(void) {
+    // close() drops the registrations: no EPOLL_CTL_DEL on a shared set
+    if (ep_fd >= 0) fd_close(ep_fd);
+    if (sig_fd >= 0) fd_close(sig_fd);
+    if (timer_fd >= 0) fd_close(timer_fd);
+    ep_fd = sig_fd = timer_fd = -1;
+    timer_armed = 0;
+}
+
+static int ev_add(int fd, uint64_t tag) {
+    struct epoll_event ev = { .events = EPOLLIN, .data.u64 = tag };
+    return epoll_ctl(ep_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+static int ev_init(void) {
+    pid_t self = getpid();
+    if (ep_fd >= 0 && ev_owner == self) return 0;
+    ev_destroy();
+    ev_owner = self;
+
+    sigset_t set;
+    ev_signals(&set);
+    ep_fd = fd_track(epoll_create1(EPOLL_CLOEXEC), "epoll");
+    sig_fd = fd_track(signalfd(-1, &set, SFD_CLOEXEC | SFD_NONBLOCK), "signalfd");
+    timer_fd = fd_track(timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK), "timerfd");
+    if (ep_fd < 0 || sig_fd < 0 || timer_fd < 0 ||
+        ev_add(sig_fd, TAG_SIGNAL) < 0 || ev_add(timer_fd, TAG_TIMER) < 0) {
+        int err = errno;
+        ev_destroy();
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+/* time */
+
+void ev_now(struct timespec* ts) {
+    clock_gettime(CLOCK_MONOTONIC, ts);
+}
+
+void ev_add_ns(struct timespec* ts, long long ns) {
+    ns += ts->tv_nsec;
+    ts->tv_sec += (time_t)(ns / 1000000000);
+    ts->tv_nsec = (long)(ns % 1000000000);
+}
+
+static int ts_set(const struct timespec* ts) {
+    return ts->tv_sec != 0 || ts->tv_nsec != 0;
+}
+
+static int ts_before(const struct timespec* a, const struct timespec* b) {
+    return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+// when c needs a signal next, 0 if never
+static const struct timespec* next_action(const struct ev_child* c) {
+    if (c->done) return NULL;
+    if (c->timed_out == 0 && ts_set(&c->term_at)) return &c->term_at;
+    if (c->timed_out == 1 && ts_set(&c->kill_at)) return &c->kill_at;
+    return NULL;
+}
+
+// the timerfd fires at the earliest deadline left, or is disarmed
+static void arm_timer(const struct ev_child* kids, size_t n) {
+    const struct timespec* first = NULL;
+    for ( size_t i = 0 ; i < n ; ++i ) {
+        const struct timespec* t = next_action(&kids[i]);
+        if (t && (!first || ts_before(t, first))) first = t;
+    }
+    if (!first && !timer_armed) return;
+    struct itimerspec its = { 0 };
+    if (first) its.it_value = *first;
+    timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+    timer_armed = (first != NULL);
+}
+
+static void fire_deadlines(struct ev_child* kids, size_t n) {
+    uint64_t ticks;
+    while (read(timer_fd, &ticks, sizeof(ticks)) > 0) {}
+    struct timespec now;
+    ev_now(&now);
+    for ( size_t i = 0 ; i < n ; ++i ) {
+        const struct timespec* t = next_action(&kids[i]);
+        if (!t || ts_before(&now, t)) continue;
+        kill(kids[i].pid, kids[i].timed_out == 0 ? SIGTERM : SIGKILL);
+        kids[i].timed_out++;
+    }
+}
+
+// -1 once every writer is gone
+static int read_deadlines(int fd, struct ev_child* kids, size_t n) {
+    struct ev_deadline d;
+    ssize_t r;
+    // records are far below PIPE_BUF: each write arrives whole
+    while ((r = read(fd, &d, sizeof(d))) == (ssize_t)sizeof(d)) {
+        for ( size_t i = 0 ; i < n ; ++i ) {
+            if (kids[i].pid != d.pid || kids[i].done) continue;
+            kids[i].term_at = d.term_at;
+            kids[i].kill_at = d.kill_at;
+        }
+    }
+    return r == 0 ? -1 : 0;
+}
+
+/* waiting */
+
+void ev_child_init(struct ev_child* c, pid_t pid) {
+    memset(c, 0, sizeof(*c));
+    c->pid = pid;
+}
+
+static void reap(struct ev_child* c, int flags) {
+    int status;
+    pid_t r;
+    while ((r = waitpid(c->pid, &status, flags)) < 0 && errno == EINTR) {}
+    if (r == 0) return; // WNOHANG, still running
+    c->done = 1;
+    if (r < 0) {
+        perror("waitpid");
+        c->status = 1;
+    }
+    else if (c->timed_out) c->status = c->timed_out == 1 ? 124 : 128 + SIGKILL;
+    else if (WIFEXITED(status)) c->status = WEXITSTATUS(status);
+    else if (WIFSIGNALED(status)) c->status = 128 + WTERMSIG(status);
+    else c->status = 1;
+}
+
+int ev_wait(struct ev_child* kids, size_t n, int deadline_fd) {
+    if (ev_init() < 0) {
+        // out of fds: plain waitpid, deadlines can't be kept
+        for ( size_t i = 0 ; i < n ; ++i ) {
+            if (!kids[i].done) reap(&kids[i], 0);
+        }
+        return -1;
+    }
+
+    sigset_t set, old;
+    ev_signals(&set);
+    pthread_sigmask(SIG_BLOCK, &set, &old);
+
+    int pidfds[n];
+    size_t pending = 0;
+    for ( size_t i = 0 ; i < n ; ++i ) {
+        pidfds[i] = -1;
+        if (kids[i].done) continue;
+        pidfds[i] = fd_track((int)syscall(SYS_pidfd_open, kids[i].pid, 0), "pidfd");
+        if (pidfds[i] >= 0 && ev_add(pidfds[i], i) == 0) pending++;
+        else if (pidfds[i] >= 0) {
+            fd_close(pidfds[i]);
+            pidfds[i] = -1;
+        }
+    }
+    if (deadline_fd >= 0) ev_add(deadline_fd, TAG_DEADLINE);
+
+    int forwarded = 0; // a signal some process sent the shell
+    int tty_sig = 0;   // one the terminal sent everybody
+    while (pending > 0) {
+        arm_timer(kids, n);
+        struct epoll_event evs[EV_MAX_EVENTS];
+        int ready = epoll_wait(ep_fd, evs, EV_MAX_EVENTS, -1);
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready < 0) {
+            perror("epoll_wait");
+            break;
+        }
+        for ( int e = 0 ; e < ready ; ++e ) {
+            uint64_t tag = evs[e].data.u64;
+            if (tag == TAG_TIMER) fire_deadlines(kids, n);
+            else if (tag == TAG_DEADLINE) {
+                if (read_deadlines(deadline_fd, kids, n) < 0) {
+                    epoll_ctl(ep_fd, EPOLL_CTL_DEL, deadline_fd, NULL);
+                    deadline_fd = -1;
+                }
+            }
+            else if (tag == TAG_SIGNAL) {
+                struct signalfd_siginfo si;
+                while (read(sig_fd, &si, sizeof(si)) == (ssize_t)sizeof(si)) {
+                    if (si.ssi_code == SI_KERNEL || si.ssi_pid == 0) {
+                        tty_sig = (int)si.ssi_signo;
+                        continue;
+                    }
+                    forwarded = (int)si.ssi_signo;
+                    for ( size_t i = 0 ; i < n ; ++i ) {
+                        if (!kids[i].done) kill(kids[i].pid, forwarded);
+                    }
+                }
+            }
+            else {
+                size_t i = (size_t)tag;
+                reap(&kids[i], WNOHANG);
+                if (!kids[i].done) continue;
+                fd_close(pidfds[i]);
+                pidfds[i] = -1;
+                pending--;
+            }
+        }
+    }
+    // a failed epoll_wait, or no pidfds (before Linux 5.3): one by one
+    for ( size_t i = 0 ; i < n ; ++i ) {
+        if (pidfds[i] >= 0) fd_close(pidfds[i]);
+        if (!kids[i].done) reap(&kids[i], 0);
+    }
+    if (deadline_fd >= 0) epoll_ctl(ep_fd, EPOLL_CTL_DEL, deadline_fd, NULL);
+    arm_timer(kids, 0);
+
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (tty_sig && !forwarded) {
+        for ( size_t i = 0 ; i < n ; ++i ) {
+            if (kids[i].status == 128 + tty_sig && !kids[i].timed_out) forwarded = tty_sig;
+        }
+    }
+    if (forwarded) raise(forwarded);
+    return 0;
+}
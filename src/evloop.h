@@ -0,0 +1,47 @@
+#ifndef EVLOOP_H
+#define EVLOOP_H
+
+#include <sys/types.h>
+#include <time.h>
+
+#define EV_MAX_EVENTS 16
+
+// The shell waits for its children on one epoll set: a pidfd per child, a
+// timerfd armed for the nearest deadline and a signalfd, so nothing blocks
+// in a waitpid that no deadline or signal can get out of.
+//
+// SIGINT, SIGTERM, SIGHUP and SIGQUIT are blocked while waiting. One sent
+// by another process (kill, automation) is passed on to the children and
+// then delivered to the shell itself once they are gone. One from the
+// terminal already reached the children, the shell only dies of it when a
+// child did too, like bash does.
+
+struct ev_child {
+    pid_t pid;
+    int status;               // once done: as $? sees it
+    int done;
+    int timed_out;            // 1: sent SIGTERM at term_at, 2: and SIGKILL at kill_at
+    struct timespec term_at;  // CLOCK_MONOTONIC, 0: no deadline
+    struct timespec kill_at;  // after term_at, 0: never escalate
+};
+
+// what a pipeline stage that runs `timeout` in place writes to the fd its
+// parent passed to ev_wait: the deadlines to apply to its own pid
+struct ev_deadline {
+    pid_t pid;
+    struct timespec term_at;
+    struct timespec kill_at;
+};
+
+void ev_child_init(struct ev_child* c, pid_t pid);
+// waits until every child has exited. deadline_fd (-1 for none) is read
+// for ev_deadline records about the children. A child that ran out of time
+// gets status 124, or 137 if it had to be killed. -1 when the loop could
+// not be set up and the children were waited for without deadlines.
+int ev_wait(struct ev_child* kids, size_t n, int deadline_fd);
+void ev_destroy(void);
+
+void ev_now(struct timespec* ts);
+void ev_add_ns(struct timespec* ts, long long ns);
+
+#endif
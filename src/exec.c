@@ -0,0 +1,1471 @@
+#define _GNU_SOURCE // memfd_create, pipe2
+#include "exec.h"
+#include "cmd_cache.h"
+#include "expand.h"
+#include "vars.h"
+#include "fdtrack.h"
+#include "dirs.h"
+#include "hash.h"
+#include "zygote.h"
+#include "evloop.h"
+#include "limits.h"
+#include "copyfd.h"
+#include "path_index.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+extern char** environ;
+
+#define BUILTIN(name, fn, flags) static int fn(struct Cmd* cmd);
+#include "builtins.def"
+#undef BUILTIN
+
+#include "builtins_table.h"
+
+const char* built_in_commands[] = {
+#define BUILTIN(name, fn, flags) name,
+#include "builtins.def"
+#undef BUILTIN
+  NULL
+};
+
+/* command verifications */
+
+// one hash and one compare, however many builtins there are
+const struct builtin* find_builtin(const char* name) {
+    size_t len = strlen(name);
+    size_t slot = (size_t)((hash_bytes(name, len) * BUILTIN_SEED) >> (64 - BUILTIN_TABLE_BITS));
+    const struct builtin* b = &builtin_table[slot];
+    if (b->name && b->len == len && memcmp(b->name, name, len) == 0) return b;
+    return NULL;
+}
+
+int isBuiltinCommand(char* cmd) {
+  return find_builtin(cmd) != NULL;
+}
+
+/* critical functions */
+char* find_path_executable(char* path, char* type_arg) {
+    char* save = NULL;
+    char* rt = NULL;
+    char found[PATH_MAX];
+    int indexed = strchr(type_arg, '/') ? -1 : pidx_lookup(path, type_arg, found, sizeof(found));
+    if (indexed >= 0) {
+        free(path);
+        return indexed ? strdup(found) : NULL;
+    }
+    for ( char* dir = strtok_r(path, ":", &save) ;
+          dir ;
+          dir = strtok_r(NULL, ":", &save)) {
+
+        char full_path[PATH_MAX] = {0};
+        snprintf(full_path, sizeof(full_path), "%s/%s", dir, type_arg);
+        
+        if (access(full_path, X_OK) == 0) {
+            rt = strdup(full_path); 
+            free(path);
+            return rt;
+        }
+    }
+    free(path);
+    return NULL;
+}
+
+// the body goes into a sealed memfd: no temp file on disk, and unlike a
+// pipe the shell never blocks writing a body bigger than the pipe buffer
+static int open_heredoc(const char* body) {
+    int fd = memfd_create("heredoc", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) return -1;
+    size_t len = strlen(body);
+    size_t off = 0;
+    while (off < len) {
+        ssize_t w = write(fd, body + off, len - off);
+        if (w < 0 && errno == EINTR) continue;
+        if (w < 0) {
+            close(fd);
+            return -1;
+        }
+        off += (size_t)w;
+    }
+    if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) < 0 ||
+        lseek(fd, 0, SEEK_SET) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int open_for_redir(const struct Redir* r) {
+    int flags = 0;
+    mode_t mode = 0644;
+    switch (r->rd_type) {
+        case R_IN:
+            flags = O_RDONLY;
+            break;
+        case R_OUT:
+            flags = O_WRONLY | O_CREAT | O_TRUNC;
+            break;
+        case R_OUT_APPEND:
+            flags = O_WRONLY | O_CREAT | O_APPEND;
+            break;
+        case R_RDWR:
+            flags = O_RDWR | O_CREAT;
+            break;
+        case R_OUT_BOTH:
+        case R_DUP_OUT: // >&file
+            flags = O_WRONLY | O_CREAT | O_TRUNC;
+            break;
+        case R_OUT_BOTH_APPEND:
+            flags = O_WRONLY | O_CREAT | O_APPEND;
+            break;
+        case R_HEREDOC:
+        case R_HEREDOC_QUOTED:
+            return open_heredoc(r->path);
+        default:
+            errno = EINVAL;
+            return -1;
+    }
+    // only the dup2'd copy may survive exec
+    return open(r->path, flags | O_CLOEXEC, mode);
+}
+
+/* redirections */
+
+// what the fds touched by a builtin's redirections pointed to before
+struct fd_saves {
+    int fd[MAX_SAVED_FDS];
+    int saved[MAX_SAVED_FDS]; // -1: fd was closed
+    size_t n;
+};
+
+static int save_fd(struct fd_saves* s, int fd) {
+    if (!s) return 0;
+    for ( size_t i = 0 ; i < s->n ; ++i ) {
+        if (s->fd[i] == fd) return 0;
+    }
+    if (s->n == MAX_SAVED_FDS) {
+        errno = EMFILE;
+        return -1;
+    }
+    int copy = fd_track(fcntl(fd, F_DUPFD_CLOEXEC, SAVED_FD_MIN), "saved");
+    if (copy < 0 && errno != EBADF) return -1;
+    s->fd[s->n] = fd;
+    s->saved[s->n++] = copy;
+    return 0;
+}
+
+// puts every saved fd back, last redirection first
+static void restore_fds(struct fd_saves* s) {
+    fflush(stdout);
+    fflush(stderr);
+    while (s->n > 0) {
+        s->n--;
+        if (s->saved[s->n] >= 0) {
+            dup2(s->saved[s->n], s->fd[s->n]);
+            fd_close(s->saved[s->n]);
+        }
+        else {
+            close(s->fd[s->n]);
+        }
+    }
+}
+
+// the fd a word like "2" names, -1 if it isn't one
+static int parse_fd(const char* s) {
+    if (!*s) return -1;
+    long v = 0;
+    for ( ; *s ; ++s ) {
+        if (*s < '0' || *s > '9') return -1;
+        v = v * 10 + (*s - '0');
+        if (v > INT_MAX) return -1;
+    }
+    return (int)v;
+}
+
+// [n]<&M [n]>&M [n]<&- [n]>&-
+static int apply_dup(const struct Redir* r, struct fd_saves* saves) {
+    if (strcmp(r->path, "-") == 0) {
+        if (save_fd(saves, r->fd) < 0) return -1;
+        close(r->fd);
+        return 0;
+    }
+    int src = parse_fd(r->path);
+    if (src < 0) {
+        fprintf(stderr, "%s: ambiguous redirect\n", r->path);
+        return -1;
+    }
+    if (fcntl(src, F_GETFD) < 0) {
+        fprintf(stderr, "%d: Bad file descriptor\n", src);
+        return -1;
+    }
+    if (src == r->fd) return 0;
+    if (save_fd(saves, r->fd) < 0 || dup2(src, r->fd) < 0) {
+        perror("dup2");
+        return -1;
+    }
+    return 0;
+}
+
+// an fd duplication or close, not a file (>&file is &>file)
+static int redir_is_dup(const struct Redir* r) {
+    if (r->rd_type == R_DUP_IN) return 1;
+    if (r->rd_type != R_DUP_OUT) return 0;
+    return r->fd != 1 || parse_fd(r->path) >= 0 || strcmp(r->path, "-") == 0;
+}
+
+// applies one redirection onto r->fd, saving the old fd first if asked.
+// fd is the target when it was opened beforehand, else -1
+static int apply_redir(const struct Redir* r, struct fd_saves* saves, int fd) {
+    if (redir_is_dup(r)) return apply_dup(r, saves);
+
+    int both = (r->rd_type == R_OUT_BOTH || r->rd_type == R_OUT_BOTH_APPEND ||
+                r->rd_type == R_DUP_OUT);
+    if (save_fd(saves, r->fd) < 0 || (both && save_fd(saves, STDERR_FILENO) < 0)) {
+        perror("redirection");
+        return -1;
+    }
+    if (fd < 0 && (fd = open_for_redir(r)) < 0) {
+        perror(r->path);
+        return -1;
+    }
+    int rc = 0;
+    // dup2 drops close-on-exec, an fd opened straight onto r->fd keeps it
+    if (fd != r->fd) rc = dup2(fd, r->fd);
+    else rc = fcntl(fd, F_SETFD, 0);
+    if (rc >= 0 && both && fd != STDERR_FILENO) rc = dup2(r->fd, STDERR_FILENO);
+    if (fd != r->fd && !(both && fd == STDERR_FILENO)) close(fd);
+    if (rc < 0) {
+        perror("dup2");
+        return -1;
+    }
+    return 0;
+}
+
+// left to right, so 2>&1 >f and >f 2>&1 differ like they should
+static int apply_redirs(const struct Cmd* cmd, struct fd_saves* saves, const int* pre) {
+    for ( size_t i = 0 ; i < cmd->nrds ; ++i ) {
+        if (apply_redir(&cmd->rds[i], saves, pre ? pre[i] : -1) < 0) return -1;
+    }
+    return 0;
+}
+
+static void close_preopened(int* pre, size_t n) {
+    for ( size_t i = 0 ; i < n ; ++i ) fd_close(pre[i]);
+    free(pre);
+}
+
+// opens the file targets before fork so a bad path costs no child. The fds
+// are close-on-exec and kept clear of every fd the command redirects, so
+// applying one redirection can't clobber a later pre-opened target
+static int preopen_redirs(const struct Cmd* cmd, int** out) {
+    *out = NULL;
+    if (cmd->nrds == 0) return 0;
+    int* pre = malloc(cmd->nrds * sizeof(int));
+    if (!pre) {
+        perror("malloc");
+        return -1;
+    }
+    int min_fd = SAVED_FD_MIN;
+    for ( size_t i = 0 ; i < cmd->nrds ; ++i ) {
+        pre[i] = -1;
+        if (cmd->rds[i].fd >= min_fd) min_fd = cmd->rds[i].fd + 1;
+    }
+    for ( size_t i = 0 ; i < cmd->nrds ; ++i ) {
+        const struct Redir* r = &cmd->rds[i];
+        if (redir_is_dup(r)) continue;
+        int fd = open_for_redir(r);
+        if (fd < 0) {
+            perror(r->path);
+            close_preopened(pre, i);
+            return -1;
+        }
+        for ( size_t k = 0 ; k < cmd->nrds ; ++k ) {
+            if (cmd->rds[k].fd != fd) continue;
+            int high = fcntl(fd, F_DUPFD_CLOEXEC, min_fd);
+            close(fd);
+            fd = high;
+            break;
+        }
+        if (fd < 0) {
+            perror("fcntl");
+            close_preopened(pre, i);
+            return -1;
+        }
+        pre[i] = fd_track(fd, "redirection");
+    }
+    *out = pre;
+    return 0;
+}
+
+// NAME=value words in front of a command name
+static int apply_assignments(const struct Cmd* assigns, unsigned flags) {
+    for ( size_t i = 0 ; assigns && i < assigns->argc ; ++i ) {
+        const char* word = assigns->argv[i];
+        size_t len = strchr(word, '=') - word;
+        if (vars_set_n(&shell_vars, word, len, word + len + 1, flags) < 0) {
+            perror("assignment");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// exec_child once the redirections are in place
+static void exec_redirected(struct Cmd* cmd, const char* file) {
+    environ = vars_envp(&shell_vars);
+    if (rlimits_apply() < 0) {
+        perror("ulimit");
+        _exit(1);
+    }
+    // a resolved file has a '/': no second PATH search, but execvp still
+    // hands a script without #! to /bin/sh
+    execvp(file ? file : cmd->argv[0], cmd->argv);
+    perror("execvp");
+    _exit(127);
+}
+
+// applies the redirections and replaces the current (child) process with
+// file (argv[0] when NULL), pre holds the targets the parent already
+// opened (or is NULL)
+static void exec_child(struct Cmd* cmd, const struct Cmd* assigns, const int* pre,
+                       const char* file) {
+    // prefix assignments only exist in this child's environment
+    if (assigns && assigns->argc && apply_assignments(assigns, VAR_EXPORT) < 0) _exit(1);
+    if (apply_redirs(cmd, NULL, pre) < 0) _exit(1);
+    exec_redirected(cmd, file);
+}
+
+static int wait_status(pid_t pid) {
+    struct ev_child c;
+    ev_child_init(&c, pid);
+    ev_wait(&c, 1, -1);
+    return c.status;
+}
+
+// a redirection onto the zygote's socket would take it away while the
+// request is sent
+static int redirects_zygote(const struct Cmd* cmd) {
+    for ( size_t i = 0 ; i < cmd->nrds ; ++i ) {
+        if (cmd->rds[i].fd == zygote_fd()) return 1;
+    }
+    return 0;
+}
+
+// the fds a command launched by the zygote gets, with cmd's redirections
+// applied: the open ones of 0-2 and every redirected one
+static int zygote_fds(const struct Cmd* cmd, int* fds) {
+    int n = 0;
+    for ( int fd = 0 ; fd < 3 ; ++fd ) {
+        if (fcntl(fd, F_GETFD) >= 0) fds[n++] = fd;
+    }
+    for ( size_t i = 0 ; i < cmd->nrds && n < ZYGOTE_MAX_FDS ; ++i ) {
+        int fd = cmd->rds[i].fd;
+        int seen = (fd < 3);
+        for ( int k = 0 ; k < n && !seen ; ++k ) seen = (fds[k] == fd);
+        if (!seen && fcntl(fd, F_GETFD) >= 0) fds[n++] = fd;
+    }
+    return n;
+}
+
+// launches cmd through the zygote: the redirections are applied in the
+// shell just long enough to hand the resulting fds over. 0 with *pid (or
+// *status when a redirection or fork failed), -1 when the caller has to
+// fork, decided before any redirection target is opened.
+static int spawn_via_zygote(struct Cmd* cmd, const char* file, pid_t* pid, int* status) {
+    *pid = -1;
+    if (redirects_zygote(cmd) || zygote_prepare(file, cmd->argv, vars_envp(&shell_vars)) < 0) {
+        return -1;
+    }
+    struct fd_saves saves = { .n = 0 };
+    if (apply_redirs(cmd, &saves, NULL) < 0) {
+        restore_fds(&saves);
+        *status = 1;
+        return 0;
+    }
+    int fds[ZYGOTE_MAX_FDS];
+    int n = zygote_fds(cmd, fds);
+    *pid = zygote_spawn_prepared(fds, fds, n);
+    // the zygote died or couldn't clone: fork with the fds as they are now,
+    // opening the targets again would truncate or block a second time
+    if (*pid < 0) {
+        *pid = fork();
+        if (*pid == 0) exec_redirected(cmd, file);
+        if (*pid < 0) {
+            perror("fork");
+            *status = -1;
+        }
+    }
+    restore_fds(&saves);
+    return 0;
+}
+
+int run_process(struct Cmd* cmd, const struct Cmd* assigns, const char* file) {
+    // rebuild a stale envp here so the parent keeps the result for the next fork
+    vars_envp(&shell_vars);
+    // prefix assignments are only known to a forked child's variable table,
+    // ulimit's limits are set by the child itself
+    if (zygote_active() && (!assigns || assigns->argc == 0) && !rlimits_active()) {
+        pid_t pid;
+        int status;
+        if (spawn_via_zygote(cmd, file, &pid, &status) == 0) {
+            return pid < 0 ? status : wait_status(pid);
+        }
+    }
+    int* pre;
+    if (preopen_redirs(cmd, &pre) < 0) return 1;
+    pid_t pid = fork();
+    // child
+    if (pid == 0) {
+        exec_child(cmd, assigns, pre, file);
+    }
+    close_preopened(pre, pre ? cmd->nrds : 0);
+    // parent
+    if (pid > 0) {
+        return wait_status(pid);
+    }
+    perror("fork");
+    return -1;
+}
+
+/* interpreter state */
+
+static int last_status;
+static int exit_requested;
+static int exit_code;
+static int loop_depth;
+static int breaking;   // loops still to leave because of break N
+static int continuing; // loops still to skip because of continue N
+static int subst_status; // of the last $(...) in the current simple command
+static int builtin_in_child; // the running builtin is the last thing this process does
+// a pipeline stage's write end of the pipe its parent reads ev_deadline
+// records from, -1 when nobody watches this process's deadlines
+static int deadline_fd = -1;
+
+int exec_last_status(void) {
+    return last_status;
+}
+
+int exec_exit_requested(void) {
+    return exit_requested;
+}
+
+int exec_exit_code(void) {
+    return exit_requested ? exit_code : last_status;
+}
+
+// exit/break/continue unwind every list until someone consumes them
+static int unwinding(void) {
+    return exit_requested || breaking || continuing;
+}
+
+static int loop_count_arg(struct Cmd* cmd) {
+    int n = 1;
+    if (cmd->argc >= 2) {
+        n = atoi(cmd->argv[1]);
+        if (n < 1) n = 1;
+    }
+    return n < loop_depth ? n : loop_depth;
+}
+
+/* simple commands */
+
+static int run_simple(struct Cmd* cmd, const struct Cmd* assigns, int in_child) {
+    // redirections alone still create/truncate their targets
+    if (cmd->argc == 0) {
+        if (apply_assignments(assigns, 0) < 0) return 1;
+        struct fd_saves saves = { .n = 0 };
+        int rc = apply_redirs(cmd, &saves, NULL);
+        restore_fds(&saves);
+        return rc < 0 ? 1 : subst_status;
+    }
+
+    char* exe_name = cmd->argv[0];
+    const struct builtin* builtin = find_builtin(exe_name);
+
+    if (!builtin) {
+        if (strchr(exe_name, '/')) {
+            if (in_child) exec_child(cmd, assigns, NULL, NULL);
+            return run_process(cmd, assigns, NULL);
+        }
+        // check if PATH can find that executable
+        const char* path = vars_get(&shell_vars, "PATH");
+        char* path_copy = path ? strdup(path) : NULL;
+        char* full_path = path_copy ? find_path_executable(path_copy, exe_name) : NULL;
+        if (full_path) {
+            // already forked, no need for run_process to fork again
+            if (in_child) exec_child(cmd, assigns, NULL, full_path);
+            int status = run_process(cmd, assigns, full_path);
+            free(full_path);
+            return status;
+        }
+        printf("%s: command not found\n", exe_name);
+        return 127;
+    }
+
+    // assignments in front of a builtin stay set, like for special builtins;
+    // exec hands them to the program like any command would
+    if (apply_assignments(assigns, builtin->fn == bi_exec ? VAR_EXPORT : 0) < 0) return 1;
+
+    // builtins run in the shell itself: their redirections are undone after
+    struct fd_saves saves = { .n = 0 };
+    int keep = in_child || (builtin->flags & BI_KEEP_FDS);
+    int status = 1;
+    builtin_in_child = in_child;
+    if (apply_redirs(cmd, keep ? NULL : &saves, NULL) == 0) status = builtin->fn(cmd);
+    builtin_in_child = 0;
+    restore_fds(&saves);
+    return status;
+}
+
+/* builtins */
+
+static int bi_exit(struct Cmd* cmd) {
+    exit_requested = 1;
+    exit_code = (cmd->argc >= 2) ? atoi(cmd->argv[1]) & 0xff : last_status;
+    return exit_code;
+}
+
+static int bi_echo(struct Cmd* cmd) {
+    size_t i = 1;
+    int newline = 1;
+    if (cmd->argc >= 2 && strcmp(cmd->argv[1], "-n") == 0) {
+        newline = 0;
+        i++;
+    }
+    for ( ; i < cmd->argc ; ++i ) {
+        fputs(cmd->argv[i], stdout);
+        if (i + 1 < cmd->argc) putchar(' ');
+    }
+    if (newline) putchar('\n');
+    return 0;
+}
+
+static int bi_type(struct Cmd* cmd) {
+    char* type_arg = cmd->argv[1];
+    if (cmd->argc < 2) return 0;
+    if (isBuiltinCommand(type_arg)) {
+        printf("%s is a shell builtin\n", type_arg);
+        return 0;
+    }
+    // try to parse PATH and find executable
+    const char* path = vars_get(&shell_vars, "PATH");
+    char* path_copy = path ? strdup(path) : NULL;
+    char* full_path = path_copy ? find_path_executable(path_copy, type_arg) : NULL;
+    if (full_path) {
+        printf("%s is %s\n", type_arg, full_path);
+        free(full_path);
+        return 0;
+    }
+    printf("%s: not found\n", type_arg);
+    return 1;
+}
+
+static int bi_pwd(struct Cmd* cmd) {
+    // the cached logical directory unless -P asks for the physical one
+    const char* pwd = dirs_pwd(&dir_stack);
+    if (pwd && !(cmd->argc >= 2 && strcmp(cmd->argv[1], "-P") == 0)) {
+        printf("%s\n", pwd);
+        return 0;
+    }
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, sizeof(cwd)) == NULL) {
+        perror("getcwd");
+        return 1;
+    }
+    printf("%s\n", cwd);
+    return 0;
+}
+
+static int bi_cd(struct Cmd* cmd) {
+    char* dest = (cmd->argc >= 2) ? cmd->argv[1] : NULL;
+    int print = 0;
+    if (dirs_cd(&dir_stack, dest, &print) == -1) {
+        if (!dest) printf("cd: HOME not set\n");
+        else if (strcmp(dest, "-") == 0 && errno == ENOENT) printf("cd: OLDPWD not set\n");
+        else printf("cd: %s: %s\n", dest, strerror(errno));
+        return 1;
+    }
+    if (print) printf("%s\n", dirs_pwd(&dir_stack));
+    return 0;
+}
+
+static int bi_pushd(struct Cmd* cmd) {
+    int rc;
+    if (cmd->argc >= 2) {
+        rc = dirs_push(&dir_stack, cmd->argv[1]);
+        if (rc < 0) fprintf(stderr, "pushd: %s: %s\n", cmd->argv[1], strerror(errno));
+    }
+    else if (dir_stack.n == 0) {
+        fprintf(stderr, "pushd: no other directory\n");
+        return 1;
+    }
+    else {
+        rc = dirs_swap(&dir_stack);
+        if (rc < 0) perror("pushd");
+    }
+    if (rc < 0) return 1;
+    dirs_print(&dir_stack, 0);
+    return 0;
+}
+
+static int bi_popd(struct Cmd* cmd) {
+    (void)cmd;
+    if (dir_stack.n == 0) {
+        fprintf(stderr, "popd: directory stack empty\n");
+        return 1;
+    }
+    if (dirs_pop(&dir_stack) < 0) {
+        perror("popd");
+        return 1;
+    }
+    dirs_print(&dir_stack, 0);
+    return 0;
+}
+
+static int bi_dirs(struct Cmd* cmd) {
+    int verbose = 0;
+    for ( size_t i = 1 ; i < cmd->argc ; ++i ) {
+        if (strcmp(cmd->argv[i], "-c") == 0) {
+            dirs_clear(&dir_stack);
+            return 0;
+        }
+        if (strcmp(cmd->argv[i], "-v") == 0) verbose = 1;
+        else {
+            fprintf(stderr, "dirs: %s: invalid option\n", cmd->argv[i]);
+            return 1;
+        }
+    }
+    dirs_print(&dir_stack, verbose);
+    return 0;
+}
+
+static int bi_cmdcache(struct Cmd* cmd) {
+    if (cmd->argc >= 2 && strcmp(cmd->argv[1], "-c") == 0) {
+        cmd_cache_clear(&cmd_cache);
+    }
+    else {
+        struct cmd_cache_stats* st = &cmd_cache.stats;
+        printf("entries: %zu\nhits: %zu\nmisses: %zu\nevictions: %zu\nflushes: %zu\n",
+               cmd_cache.nentries, st->hits, st->misses, st->evictions, st->flushes);
+    }
+    return 0;
+}
+
+static int bi_true(struct Cmd* cmd) {
+    (void)cmd;
+    return 0;
+}
+
+static int bi_false(struct Cmd* cmd) {
+    (void)cmd;
+    return 1;
+}
+
+static int bi_break(struct Cmd* cmd) {
+    if (loop_depth > 0) breaking = loop_count_arg(cmd);
+    return 0;
+}
+
+static int bi_continue(struct Cmd* cmd) {
+    if (loop_depth > 0) continuing = loop_count_arg(cmd);
+    return 0;
+}
+
+static int bi_export(struct Cmd* cmd) {
+    if (cmd->argc == 1) {
+        vars_print(&shell_vars, VAR_EXPORT);
+        return 0;
+    }
+    int status = 0;
+    for ( size_t i = 1 ; i < cmd->argc ; ++i ) {
+        char* arg = cmd->argv[i];
+        char* eq = strchr(arg, '=');
+        size_t len = eq ? (size_t)(eq - arg) : strlen(arg);
+        int rc = eq ? vars_set_n(&shell_vars, arg, len, eq + 1, VAR_EXPORT)
+                    : vars_export(&shell_vars, arg);
+        if (rc < 0) {
+            fprintf(stderr, "export: `%s': not a valid identifier\n", arg);
+            status = 1;
+        }
+    }
+    return status;
+}
+
+static int bi_unset(struct Cmd* cmd) {
+    for ( size_t i = 1 ; i < cmd->argc ; ++i ) {
+        vars_unset(&shell_vars, cmd->argv[i]);
+    }
+    return 0;
+}
+
+// execs argv with ulimit's limits and the shell's environment. Only
+// returns when that failed: 127 when there is no such command, else 126.
+static int exec_argv(char** argv, const char* who) {
+    if (rlimits_apply() < 0) {
+        fprintf(stderr, "%s: ulimit: %s\n", who, strerror(errno));
+        return 126;
+    }
+    // execvp looks PATH up in environ. `exec` runs in the shell itself,
+    // which keeps its own environ when this fails: the next vars_envp()
+    // may free the array
+    char** saved = environ;
+    environ = vars_envp(&shell_vars);
+    execvp(argv[0], argv);
+    int err = errno;
+    environ = saved;
+    fprintf(stderr, "%s: %s: %s\n", who, argv[0], strerror(err));
+    return err == ENOENT ? 127 : 126;
+}
+
+// starts argv with the fds as a builtin sees them, its redirections
+// applied: through the zygote where it can, else forked
+static pid_t spawn_argv(struct Cmd* cmd, char** argv, const char* who) {
+    pid_t pid = -1;
+    if (zygote_active() && !redirects_zygote(cmd) && !rlimits_active()) {
+        int fds[ZYGOTE_MAX_FDS];
+        int n = zygote_fds(cmd, fds);
+        pid = zygote_spawn(NULL, argv, vars_envp(&shell_vars), fds, fds, n);
+    }
+    if (pid >= 0) return pid;
+    vars_envp(&shell_vars);
+    pid = fork();
+    if (pid == 0) _exit(exec_argv(argv, who));
+    if (pid < 0) perror("fork");
+    return pid;
+}
+
+// for the options a builtin leaves to the program of the same name in PATH
+static int run_external(struct Cmd* cmd) {
+    if (builtin_in_child) return exec_argv(cmd->argv, cmd->argv[0]);
+    pid_t pid = spawn_argv(cmd, cmd->argv, cmd->argv[0]);
+    return pid < 0 ? 1 : wait_status(pid);
+}
+
+// exec cmd...: replaces the shell, with the redirections already applied.
+// Without a command only the redirections happen, and they stay.
+static int bi_exec(struct Cmd* cmd) {
+    if (cmd->argc < 2) return 0;
+    return exec_argv(cmd->argv + 1, "exec");
+}
+
+// "1.5", "30s", "2m", "1h", "1d" in nanoseconds
+static int parse_duration(const char* s, long long* ns) {
+    char* end;
+    errno = 0;
+    double v = strtod(s, &end);
+    double unit = 1e9;
+    switch (*end) {
+        case 's': ++end; break;
+        case 'm': unit *= 60; ++end; break;
+        case 'h': unit *= 3600; ++end; break;
+        case 'd': unit *= 86400; ++end; break;
+    }
+    if (errno || end == s || *end || !(v >= 0) || v * unit > 9e18) return -1;
+    *ns = (long long)(v * unit);
+    return 0;
+}
+
+static void start_deadline(struct ev_child* c, long long term_ns, long long kill_ns) {
+    if (term_ns == 0) return;
+    ev_now(&c->term_at);
+    ev_add_ns(&c->term_at, term_ns);
+    if (kill_ns == 0) return;
+    c->kill_at = c->term_at;
+    ev_add_ns(&c->kill_at, kill_ns);
+}
+
+// timeout [-k GRACE] DURATION cmd...: cmd gets SIGTERM once DURATION is
+// up and SIGKILL GRACE (TIMEOUT_GRACE without -k, 0: never) later. 124 when
+// it ran out of time, 137 when it had to be killed, 125 on a usage error.
+// As a pipeline stage it execs cmd in place and leaves the signals to the
+// shell that waits for the pipeline.
+static int bi_timeout(struct Cmd* cmd) {
+    long long term_ns;
+    long long kill_ns = TIMEOUT_GRACE;
+    size_t i = 1;
+    if (i < cmd->argc && strcmp(cmd->argv[i], "-k") == 0) {
+        if (i + 1 >= cmd->argc || parse_duration(cmd->argv[i + 1], &kill_ns) < 0) i = cmd->argc;
+        else i += 2;
+    }
+    if (i + 1 >= cmd->argc || parse_duration(cmd->argv[i], &term_ns) < 0) {
+        fprintf(stderr, "usage: timeout [-k DURATION] DURATION command [arg ...]\n");
+        return 125;
+    }
+    char** argv = cmd->argv + i + 1;
+    struct ev_child c;
+    ev_child_init(&c, -1);
+    start_deadline(&c, term_ns, kill_ns);
+
+    int in_place = 0;
+    if (builtin_in_child && deadline_fd >= 0) {
+        struct ev_deadline d = { .pid = getpid(), .term_at = c.term_at, .kill_at = c.kill_at };
+        in_place = (write(deadline_fd, &d, sizeof(d)) == (ssize_t)sizeof(d));
+    }
+    if (in_place) return exec_argv(argv, "timeout");
+    pid_t pid = spawn_argv(cmd, argv, "timeout");
+    if (pid < 0) return 125;
+    c.pid = pid;
+    ev_wait(&c, 1, -1);
+    return c.status;
+}
+
+// ulimit [-HS] [-a | -cdflmnstuv [LIMIT]]: shows or sets a limit for the
+// commands started from here on, -f without an option. LIMIT is a number
+// in the unit -a shows, unlimited, soft or hard. Setting changes both the
+// soft and the hard limit unless -S or -H says which.
+static int bi_ulimit(struct Cmd* cmd) {
+    int soft = 0, hard = 0, all = 0;
+    const struct rlimit_opt* o = rlimit_find('f');
+    size_t i = 1;
+    for ( ; i < cmd->argc && cmd->argv[i][0] == '-' && cmd->argv[i][1] ; ++i ) {
+        for ( const char* f = cmd->argv[i] + 1 ; *f ; ++f ) {
+            if (*f == 'S') soft = 1;
+            else if (*f == 'H') hard = 1;
+            else if (*f == 'a') all = 1;
+            else if (!(o = rlimit_find(*f))) {
+                fprintf(stderr, "ulimit: -%c: invalid option\n", *f);
+                return 2;
+            }
+        }
+    }
+    struct rlimit cur;
+    if (all || i == cmd->argc) {
+        for ( const struct rlimit_opt* p = all ? rlimit_opts : o ; p->opt ; ++p ) {
+            rlimit_get(p, &cur);
+            rlim_t v = hard ? cur.rlim_max : cur.rlim_cur;
+            if (all) printf("%-28s(-%c) ", p->what, p->opt);
+            if (v == RLIM_INFINITY) printf("unlimited\n");
+            else printf("%llu\n", (unsigned long long)(v / p->unit));
+            if (!all) break;
+        }
+        return 0;
+    }
+
+    const char* arg = cmd->argv[i];
+    rlim_t value;
+    rlimit_get(o, &cur);
+    if (strcmp(arg, "unlimited") == 0) value = RLIM_INFINITY;
+    else if (strcmp(arg, "soft") == 0) value = cur.rlim_cur;
+    else if (strcmp(arg, "hard") == 0) value = cur.rlim_max;
+    else {
+        char* end;
+        errno = 0;
+        unsigned long long n = strtoull(arg, &end, 10);
+        if (errno || end == arg || *end || arg[0] == '-' || n > RLIM_INFINITY / o->unit) {
+            fprintf(stderr, "ulimit: %s: invalid number\n", arg);
+            return 1;
+        }
+        value = (rlim_t)n * o->unit;
+    }
+    if (!soft && !hard) soft = hard = 1;
+    if (rlimit_set(o, value, soft, hard) < 0) {
+        fprintf(stderr, "ulimit: %s: %s\n", o->what, strerror(errno));
+        return 1;
+    }
+    return 0;
+}
+
+// "512M", "2G", "1048576": bytes, K/M/G/T are powers of 1024
+static int parse_size(const char* s, long long* out) {
+    char* end;
+    errno = 0;
+    long long v = strtoll(s, &end, 10);
+    int shift = 0;
+    switch (*end) {
+        case 'k': case 'K': shift = 10; ++end; break;
+        case 'm': case 'M': shift = 20; ++end; break;
+        case 'g': case 'G': shift = 30; ++end; break;
+        case 't': case 'T': shift = 40; ++end; break;
+    }
+    if (errno || end == s || *end || v < 0 || v > (LLONG_MAX >> shift)) return -1;
+    *out = v << shift;
+    return 0;
+}
+
+// in the child of cgroup_fork, which may have no working malloc or stdio:
+// only system calls from here. file is argv's program, found in PATH by
+// the parent; sh_argv runs it with /bin/sh when it has no #! line.
+static void limit_exec(const char* file, char** argv, char** sh_argv, char** envp) {
+    static const char ulimit_failed[] = "limit: ulimit: cannot set the limits\n";
+    static const char exec_failed[] = "limit: cannot execute ";
+    if (rlimits_apply() < 0) {
+        write(STDERR_FILENO, ulimit_failed, sizeof(ulimit_failed) - 1);
+        _exit(126);
+    }
+    execve(file, argv, envp);
+    if (errno == ENOEXEC) execve(sh_argv[0], sh_argv, envp);
+    int err = errno;
+    struct iovec msg[3] = {
+        { .iov_base = (char*)exec_failed, .iov_len = sizeof(exec_failed) - 1 },
+        { .iov_base = (char*)file, .iov_len = strlen(file) },
+        { .iov_base = "\n", .iov_len = 1 },
+    };
+    writev(STDERR_FILENO, msg, 3);
+    _exit(err == ENOENT ? 127 : 126);
+}
+
+// limit [--mem SIZE] [--cpus N] [--pids N] cmd...: runs cmd in a cgroup v2
+// group of its own, created for it and removed (with anything cmd left
+// running in it) when it exits. 125 when the group can't be set up.
+static int bi_limit(struct Cmd* cmd) {
+    struct cgroup_limits lim = { .mem = -1, .cpus = -1, .pids = -1 };
+    size_t i = 1;
+    int bad = 0;
+    for ( ; !bad && i + 1 < cmd->argc && strncmp(cmd->argv[i], "--", 2) == 0 ; i += 2 ) {
+        const char* opt = cmd->argv[i] + 2;
+        const char* val = cmd->argv[i + 1];
+        char* end;
+        if (strcmp(opt, "mem") == 0) bad = parse_size(val, &lim.mem) < 0;
+        else if (strcmp(opt, "pids") == 0) bad = parse_size(val, &lim.pids) < 0;
+        else if (strcmp(opt, "cpus") == 0) {
+            lim.cpus = strtod(val, &end);
+            bad = end == val || *end || !(lim.cpus > 0);
+        }
+        else bad = 1;
+    }
+    if (bad || i >= cmd->argc) {
+        fprintf(stderr, "usage: limit [--mem SIZE] [--cpus N] [--pids N] command [arg ...]\n");
+        return 125;
+    }
+    // everything the child needs is looked up and allocated here, see
+    // limit_exec
+    char** argv = cmd->argv + i;
+    const char* path = vars_get(&shell_vars, "PATH");
+    char* file = strchr(argv[0], '/') ? strdup(argv[0])
+                 : path ? find_path_executable(strdup(path), argv[0]) : NULL;
+    if (!file) {
+        fprintf(stderr, "limit: %s: %s\n", argv[0], strerror(ENOENT));
+        return 127;
+    }
+    size_t argc = cmd->argc - i;
+    char** sh_argv = malloc((argc + 2) * sizeof(char*));
+    if (!sh_argv) {
+        perror("limit");
+        free(file);
+        return 125;
+    }
+    sh_argv[0] = "/bin/sh";
+    sh_argv[1] = file;
+    memcpy(sh_argv + 2, argv + 1, argc * sizeof(char*)); // with the NULL
+
+    int status = 125;
+    struct cgroup cg;
+    if (cgroup_create(&cg, &lim) == 0) {
+        char** envp = vars_envp(&shell_vars);
+        pid_t pid = cgroup_fork(&cg);
+        if (pid == 0) limit_exec(file, argv, sh_argv, envp);
+        if (pid < 0) perror("limit: clone3");
+        else {
+            struct ev_child c;
+            ev_child_init(&c, pid);
+            ev_wait(&c, 1, -1);
+            status = c.status;
+        }
+        cgroup_remove(&cg);
+    }
+    free(sh_argv);
+    free(file);
+    return status;
+}
+
+// cat [-u] [file ...]: the files (- or none: stdin) to stdout, moved by
+// copy_fd without a fork. Other options run the cat in PATH.
+static int bi_cat(struct Cmd* cmd) {
+    size_t i = 1;
+    for ( ; i < cmd->argc && cmd->argv[i][0] == '-' && cmd->argv[i][1] ; ++i ) {
+        if (strcmp(cmd->argv[i], "--") == 0) {
+            ++i;
+            break;
+        }
+        if (strcmp(cmd->argv[i], "-u") != 0) return run_external(cmd);
+    }
+    char* stdin_only[] = { "-" };
+    char** files = i < cmd->argc ? cmd->argv + i : stdin_only;
+    size_t nfiles = i < cmd->argc ? cmd->argc - i : 1;
+
+    fflush(stdout);
+    struct stat ost;
+    int out_is_file = fstat(STDOUT_FILENO, &ost) == 0 && S_ISREG(ost.st_mode);
+    int status = 0;
+    for ( size_t f = 0 ; f < nfiles ; ++f ) {
+        const char* name = files[f];
+        int is_stdin = strcmp(name, "-") == 0;
+        int fd = is_stdin ? STDIN_FILENO : fd_track(open(name, O_RDONLY | O_CLOEXEC), "cat");
+        struct stat ist;
+        if (fd < 0) {
+            fprintf(stderr, "cat: %s: %s\n", name, strerror(errno));
+            status = 1;
+            continue;
+        }
+        if (out_is_file && fstat(fd, &ist) == 0 && ist.st_dev == ost.st_dev && ist.st_ino == ost.st_ino) {
+            fprintf(stderr, "cat: %s: input file is output file\n", name);
+            status = 1;
+        }
+        else if (copy_fd(fd, STDOUT_FILENO) < 0) {
+            fprintf(stderr, "cat: %s: %s\n", name, strerror(errno));
+            status = 1;
+        }
+        if (!is_stdin) fd_close(fd);
+    }
+    return status;
+}
+
+// tee [-a] [file ...]: stdin to stdout and to every file, truncated or
+// with -a appended to. Other options run the tee in PATH.
+static int bi_tee(struct Cmd* cmd) {
+    int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+    size_t i = 1;
+    for ( ; i < cmd->argc && cmd->argv[i][0] == '-' && cmd->argv[i][1] ; ++i ) {
+        if (strcmp(cmd->argv[i], "--") == 0) {
+            ++i;
+            break;
+        }
+        if (strcmp(cmd->argv[i], "-a") != 0) return run_external(cmd);
+        flags = (flags & ~O_TRUNC) | O_APPEND;
+    }
+
+    size_t nfiles = cmd->argc - i;
+    int* outs = malloc((nfiles + 1) * sizeof(int));
+    int* failed = calloc(nfiles + 1, sizeof(int));
+    char** names = malloc((nfiles + 1) * sizeof(char*));
+    if (!outs || !failed || !names) {
+        perror("tee");
+        free(outs);
+        free(failed);
+        free(names);
+        return 1;
+    }
+    int status = 0;
+    size_t n = 0;
+    names[n] = "standard output";
+    outs[n++] = STDOUT_FILENO;
+    for ( ; i < cmd->argc ; ++i ) {
+        int fd = fd_track(open(cmd->argv[i], flags, 0666), "tee");
+        if (fd < 0) {
+            fprintf(stderr, "tee: %s: %s\n", cmd->argv[i], strerror(errno));
+            status = 1;
+            continue;
+        }
+        names[n] = cmd->argv[i];
+        outs[n++] = fd;
+    }
+
+    fflush(stdout);
+    if (tee_fds(STDIN_FILENO, outs, n, failed) < 0) {
+        status = 1;
+        int reported = 0;
+        for ( size_t k = 0 ; k < n ; ++k ) {
+            if (!failed[k]) continue;
+            fprintf(stderr, "tee: %s: %s\n", names[k], strerror(failed[k]));
+            reported = 1;
+        }
+        if (!reported) fprintf(stderr, "tee: standard input: %s\n", strerror(errno));
+    }
+    for ( size_t k = 1 ; k < n ; ++k ) fd_close(outs[k]);
+    free(outs);
+    free(failed);
+    free(names);
+    return status;
+}
+
+static int bi_fds(struct Cmd* cmd) {
+    (void)cmd;
+    fd_list(stdout);
+    return 0;
+}
+
+// copies raw's redirections into out (rds already sized) with their targets expanded
+static int expand_redirs(const struct Cmd* raw, struct Cmd* out, struct arena* a) {
+    for ( size_t r = 0 ; r < raw->nrds ; ++r ) {
+        out->rds[r] = raw->rds[r];
+        if (raw->rds[r].rd_type == R_HEREDOC_QUOTED) continue;
+        if (raw->rds[r].rd_type == R_HEREDOC) out->rds[r].path = expand_heredoc(raw->rds[r].path, a);
+        else out->rds[r].path = expand_word_single(raw->rds[r].path, a);
+        if (!out->rds[r].path) return -1;
+    }
+    out->nrds = raw->nrds;
+    return 0;
+}
+
+// expands the parsed words into a fresh Cmd in a, then runs it. Everything
+// allocated for the expansion is released again before returning. in_child:
+// nothing runs after this command in this process, so a program replaces
+// it rather than being forked.
+static int exec_simple(struct Cmd* raw, struct arena* a, int in_child) {
+    struct arena_mark mark = arena_get_mark(a);
+    int status = 1;
+    subst_status = 0;
+
+    struct Cmd cmd;
+    struct Cmd assigns;
+    initCmd(&cmd);
+    initCmd(&assigns);
+    initCmdArgv(&cmd, a);
+    initCmdArgv(&assigns, a);
+    cmd.rd_cap = raw->nrds ? raw->nrds : 1;
+    initCmdRedir(&cmd, a);
+    if (!cmd.argv || !assigns.argv || !cmd.rds) goto out;
+
+    size_t i = 0;
+    for ( ; i < raw->argc && assignment_name_len(raw->argv[i]) ; ++i ) {
+        char* word = expand_word_single(raw->argv[i], a);
+        if (!word || push_argv(&assigns, a, word) < 0) goto out;
+    }
+    for ( ; i < raw->argc ; ++i ) {
+        if (expand_word(&cmd, raw->argv[i], a) < 0) goto out;
+    }
+    if (expand_redirs(raw, &cmd, a) < 0) goto out;
+
+    status = run_simple(&cmd, &assigns, in_child);
+out:
+    arena_release(a, mark);
+    return status;
+}
+
+/* command substitution */
+
+static int run_node(struct Node* n, struct arena* a, int tail);
+
+// builtins that only print, safe to run without a subshell
+static int is_capture_builtin(const struct Node* n) {
+    if (n->type != N_CMD || n->cmd.argc == 0) return 0;
+    const struct builtin* b = find_builtin(n->cmd.argv[0]);
+    return b && (b->flags & BI_CAPTURE);
+}
+
+// appends everything readable from fd to out
+static int read_all(int fd, struct sbuf* out) {
+    for (;;) {
+        if (sbuf_reserve(out, 4096) < 0) return -1;
+        ssize_t r = read(fd, out->p + out->len, out->cap - out->len - 1);
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0) return -1;
+        if (r == 0) break;
+        out->len += (size_t)r;
+    }
+    if (out->p) out->p[out->len] = '\0';
+    return 0;
+}
+
+// output of an in-process builtin goes to a memfd rather than a pipe, so a
+// big output can't block the shell writing to itself
+static int capture_builtin(struct Node* n, struct arena* a, struct sbuf* out) {
+    int mfd = fd_track(memfd_create("subst", MFD_CLOEXEC), "subst memfd");
+    if (mfd < 0) return -1;
+    int saved = fd_track(fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, SAVED_FD_MIN), "saved");
+    if (saved < 0 || dup2(mfd, STDOUT_FILENO) < 0) {
+        fd_close(saved);
+        fd_close(mfd);
+        return -1;
+    }
+    fflush(stdout);
+    int status = exec_simple(&n->cmd, a, 0);
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    fd_close(saved);
+
+    struct stat st;
+    int rc = -1;
+    if (fstat(mfd, &st) == 0 && sbuf_reserve(out, (size_t)st.st_size) == 0 &&
+        lseek(mfd, 0, SEEK_SET) == 0) {
+        rc = read_all(mfd, out);
+    }
+    fd_close(mfd);
+    subst_status = status;
+    return rc;
+}
+
+// runs n with stdout captured into out, the exit status becomes $?
+int exec_capture(struct Node* n, struct arena* a, struct sbuf* out) {
+    if (is_capture_builtin(n)) {
+        int saved_subst = subst_status;
+        if (capture_builtin(n, a, out) < 0) {
+            perror("command substitution");
+            subst_status = saved_subst;
+            return -1;
+        }
+        last_status = subst_status;
+        return 0;
+    }
+
+    int pfd[2];
+    if (pipe2(pfd, O_CLOEXEC) < 0) {
+        perror("pipe");
+        return -1;
+    }
+    fd_track(pfd[0], "subst pipe");
+    fd_track(pfd[1], "subst pipe");
+    vars_envp(&shell_vars);
+    pid_t pid = fork();
+    if (pid == 0) {
+        deadline_fd = -1;
+        dup2(pfd[1], STDOUT_FILENO);
+        int status = run_node(n, a, 1);
+        _exit(exit_requested ? exit_code : status);
+    }
+    fd_close(pfd[1]);
+    if (pid < 0) {
+        perror("fork");
+        fd_close(pfd[0]);
+        return -1;
+    }
+    int rc = read_all(pfd[0], out);
+    fd_close(pfd[0]);
+    int status = wait_status(pid);
+    if (rc < 0) {
+        perror("command substitution");
+        return -1;
+    }
+    subst_status = status;
+    last_status = status;
+    return 0;
+}
+
+/* compound commands */
+
+// runs a pipeline stage after fork, never returns
+static void exec_in_child(struct Node* n, struct arena* a) {
+    int status = run_node(n, a, 1);
+    _exit(exit_requested ? exit_code : status);
+}
+
+// a stage that starts with `timeout` can exec its command in place and
+// tell the shell its deadline instead of waiting for it in another process
+static int is_timeout_stage(const struct Node* n) {
+    if (n->type != N_CMD) return 0;
+    for ( size_t i = 0 ; i < n->cmd.argc ; ++i ) {
+        if (!assignment_name_len(n->cmd.argv[i])) return strcmp(n->cmd.argv[i], "timeout") == 0;
+    }
+    return 0;
+}
+
+static int exec_pipeline(struct Node* n, struct arena* a) {
+    size_t nstages = n->pipe.nstages;
+    struct ev_child* kids = malloc(nstages * sizeof(struct ev_child));
+    if (!kids) {
+        perror("malloc");
+        return 1;
+    }
+
+    int dl[2] = { -1, -1 };
+    for ( size_t i = 0 ; i < nstages && dl[0] < 0 ; ++i ) {
+        if (!is_timeout_stage(n->pipe.stages[i])) continue;
+        if (pipe2(dl, O_CLOEXEC | O_NONBLOCK) == 0) {
+            fd_track(dl[0], "deadlines");
+            fd_track(dl[1], "deadlines");
+        }
+    }
+
+    int in_fd = -1;
+    size_t started = 0;
+    for ( size_t i = 0 ; i < nstages ; ++i ) {
+        int pfd[2] = { -1, -1 };
+        if (i + 1 < nstages) {
+            if (pipe2(pfd, O_CLOEXEC) < 0) {
+                perror("pipe");
+                break;
+            }
+            fd_track(pfd[0], "pipeline");
+            fd_track(pfd[1], "pipeline");
+        }
+        pid_t pid = fork();
+        if (pid == 0) {
+            if (in_fd != -1) {
+                dup2(in_fd, STDIN_FILENO);
+                close(in_fd);
+            }
+            if (pfd[1] != -1) {
+                close(pfd[0]);
+                dup2(pfd[1], STDOUT_FILENO);
+                close(pfd[1]);
+            }
+            if (dl[0] != -1) close(dl[0]);
+            deadline_fd = dl[1];
+            exec_in_child(n->pipe.stages[i], a);
+        }
+        if (in_fd != -1) fd_close(in_fd);
+        in_fd = pfd[0];
+        if (pfd[1] != -1) fd_close(pfd[1]);
+        if (pid < 0) {
+            perror("fork");
+            break;
+        }
+        ev_child_init(&kids[started++], pid);
+    }
+    if (in_fd != -1) fd_close(in_fd);
+    // the stages hold the write end until they exec
+    if (dl[1] != -1) fd_close(dl[1]);
+
+    ev_wait(kids, started, dl[0]);
+    int status = started == nstages ? kids[nstages - 1].status : 1;
+    if (dl[0] != -1) fd_close(dl[0]);
+    free(kids);
+    return status;
+}
+
+// { ...; } > f, while ...; done < f: redirected in the shell and undone after
+static int exec_redir(struct Node* n, struct arena* a) {
+    struct arena_mark mark = arena_get_mark(a);
+    int status = 1;
+    struct Cmd rds;
+    initCmd(&rds);
+    rds.rd_cap = n->redir.rds.nrds;
+    initCmdRedir(&rds, a);
+    if (rds.rds && expand_redirs(&n->redir.rds, &rds, a) == 0) {
+        struct fd_saves saves = { .n = 0 };
+        if (apply_redirs(&rds, &saves, NULL) == 0) status = exec_node(n->redir.body, a);
+        restore_fds(&saves);
+    }
+    arena_release(a, mark);
+    return status;
+}
+
+// ( ... ) as the last command needs no fork of its own: the shell is about
+// to exit anyway, so it can be the subshell
+static int exec_subshell(struct Node* n, struct arena* a, int tail) {
+    if (tail) return run_node(n->child, a, 1);
+    pid_t pid = fork();
+    if (pid == 0) {
+        deadline_fd = -1;
+        int status = run_node(n->child, a, 1);
+        _exit(exit_requested ? exit_code : status);
+    }
+    if (pid < 0) {
+        perror("fork");
+        return 1;
+    }
+    return wait_status(pid);
+}
+
+// after a loop body: 1 if the loop has to stop
+static int loop_should_stop(void) {
+    if (exit_requested) return 1;
+    if (breaking) {
+        breaking--;
+        return 1;
+    }
+    if (continuing) {
+        // continue N leaves the inner N-1 loops
+        if (--continuing > 0) return 1;
+    }
+    return 0;
+}
+
+static int exec_loop(struct Node* n, struct arena* a) {
+    int status = 0;
+    loop_depth++;
+    for (;;) {
+        int c = exec_node(n->loop.cond, a);
+        if (unwinding() && loop_should_stop()) break;
+        if ((c == 0) != (n->type == N_WHILE)) break;
+        status = exec_node(n->loop.body, a);
+        if (unwinding() && loop_should_stop()) break;
+    }
+    loop_depth--;
+    return status;
+}
+
+static int exec_for(struct Node* n, struct arena* a) {
+    struct arena_mark mark = arena_get_mark(a);
+    int status = 0;
+
+    // the word list is expanded once, before the first iteration
+    struct Cmd words;
+    initCmd(&words);
+    initCmdArgv(&words, a);
+    if (!words.argv) return 1;
+    for ( size_t i = 0 ; i < n->forl.nwords ; ++i ) {
+        if (expand_word(&words, n->forl.words[i], a) < 0) {
+            arena_release(a, mark);
+            return 1;
+        }
+    }
+
+    loop_depth++;
+    for ( size_t i = 0 ; i < words.argc ; ++i ) {
+        if (vars_set(&shell_vars, n->forl.var, words.argv[i], 0) < 0) {
+            perror(n->forl.var);
+            status = 1;
+            break;
+        }
+        status = exec_node(n->forl.body, a);
+        if (unwinding() && loop_should_stop()) break;
+    }
+    loop_depth--;
+    arena_release(a, mark);
+    return status;
+}
+
+// tail: n is the last thing this process will run, so its last simple
+// command may exec in place instead of fork + wait + exit. It is passed on
+// only to the parts of n that run last: not to conditions, loops, negated
+// commands or anything whose redirections still have to be undone.
+static int run_node(struct Node* n, struct arena* a, int tail) {
+    int status = 0;
+    if (!n) return last_status;
+
+    switch (n->type) {
+        case N_CMD:
+            status = exec_simple(&n->cmd, a, tail);
+            break;
+        case N_PIPE:
+            status = exec_pipeline(n, a);
+            break;
+        case N_AND:
+        case N_OR:
+            status = run_node(n->bin.left, a, 0);
+            if (unwinding()) break;
+            if ((status == 0) == (n->type == N_AND)) status = run_node(n->bin.right, a, tail);
+            break;
+        case N_SEQ:
+            status = run_node(n->bin.left, a, 0);
+            if (unwinding()) break;
+            status = run_node(n->bin.right, a, tail);
+            break;
+        case N_NOT:
+            status = !run_node(n->child, a, 0);
+            break;
+        case N_IF:
+            status = run_node(n->cond.cond, a, 0);
+            if (unwinding()) break;
+            if (status == 0) status = run_node(n->cond.then_part, a, tail);
+            else if (n->cond.else_part) status = run_node(n->cond.else_part, a, tail);
+            else status = 0;
+            break;
+        case N_WHILE:
+        case N_UNTIL:
+            status = exec_loop(n, a);
+            break;
+        case N_FOR:
+            status = exec_for(n, a);
+            break;
+        case N_GROUP:
+            status = run_node(n->child, a, tail);
+            break;
+        case N_SUBSHELL:
+            status = exec_subshell(n, a, tail);
+            break;
+        case N_REDIR:
+            status = exec_redir(n, a);
+            break;
+    }
+    last_status = status;
+    return status;
+}
+
+int exec_node(struct Node* n, struct arena* a) {
+    return run_node(n, a, 0);
+}
+
+int exec_node_last(struct Node* n, struct arena* a) {
+    return run_node(n, a, 1);
+}
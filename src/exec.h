@@ -0,0 +1,46 @@
+#ifndef EXEC_H
+#define EXEC_H
+
+#include "cmd.h"
+#include "parser.h"
+
+// fds a builtin redirects are parked at or above SAVED_FD_MIN meanwhile
+#define MAX_SAVED_FDS 16
+#define SAVED_FD_MIN 10
+
+// timeout's SIGTERM to SIGKILL grace period without -k, in nanoseconds
+#define TIMEOUT_GRACE 5000000000LL
+
+#define BI_CAPTURE 0x1 // only prints, safe to run in-process for $(...)
+#define BI_KEEP_FDS 0x2 // its redirections are not undone afterwards
+
+// every builtin has the same signature, see builtins.def
+typedef int (*builtin_fn)(struct Cmd* cmd);
+
+struct builtin {
+    const char* name; // NULL: empty slot
+    size_t len;
+    builtin_fn fn;
+    unsigned flags;
+};
+
+extern const char* built_in_commands[];
+
+const struct builtin* find_builtin(const char* name);
+int isBuiltinCommand(char* cmd);
+char* find_path_executable(char* path, char* type_arg);
+// file: the program find_path_executable found, NULL to exec argv[0]
+int run_process(struct Cmd* cmd, const struct Cmd* assigns, const char* file);
+
+struct sbuf;
+
+int exec_node(struct Node* n, struct arena* a);
+// exec_node for the last command the shell runs: its final program may
+// replace the shell, so only call this when nothing is left to do after it
+int exec_node_last(struct Node* n, struct arena* a);
+int exec_capture(struct Node* n, struct arena* a, struct sbuf* out);
+int exec_last_status(void);
+int exec_exit_requested(void);
+int exec_exit_code(void);
+
+#endif
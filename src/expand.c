@@ -0,0 +1,547 @@
+#include "expand.h"
+#include "exec.h"
+#include "parser.h"
+#include "pathglob.h"
+#include "vars.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#define DEFAULT_SBUF_CAP 64
+#define DEFAULT_IFS " \t\n"
+
+/* sbuf */
+
+void sbuf_init(struct sbuf* sb, struct arena* a) {
+    sb->p = NULL;
+    sb->len = 0;
+    sb->cap = 0;
+    sb->a = a;
+}
+
+static int sbuf_grow(struct sbuf* sb, size_t need) {
+    size_t new_cap = sb->cap ? sb->cap : DEFAULT_SBUF_CAP;
+    while (new_cap < need) new_cap *= 2;
+
+    char* v = arena_alloc_align(sb->a, new_cap, 1);
+    if (!v) return -1;
+    if (sb->len) memcpy(v, sb->p, sb->len);
+    sb->p = v;
+    sb->cap = new_cap;
+    return 0;
+}
+
+// makes room for extra more bytes plus the NUL without changing len
+int sbuf_reserve(struct sbuf* sb, size_t extra) {
+    if (sb->len + extra + 1 <= sb->cap) return 0;
+    return sbuf_grow(sb, sb->len + extra + 1);
+}
+
+// always leaves room for (and writes) a terminating NUL
+int sbuf_append(struct sbuf* sb, const char* s, size_t n) {
+    if (sb->len + n + 1 > sb->cap) {
+        if (sbuf_grow(sb, sb->len + n + 1) < 0) return -1;
+    }
+    memcpy(sb->p + sb->len, s, n);
+    sb->len += n;
+    sb->p[sb->len] = '\0';
+    return 0;
+}
+
+int sbuf_putc(struct sbuf* sb, char c) {
+    return sbuf_append(sb, &c, 1);
+}
+
+/* expander */
+
+struct expander {
+    struct arena* a;
+    struct Cmd* out; // NULL: produce a single field, no splitting or globbing
+    struct sbuf cur;
+    int has_field;   // cur is a field even when empty ("" or '')
+    int has_glob;    // cur holds an unquoted * ? or [
+    int escaped;     // cur holds backslashes added by put
+};
+
+static int is_glob_char(char c) {
+    return c == '*' || c == '?' || c == '[' || c == '\\';
+}
+
+// appends s[0..n) with a backslash in front of every glob character, so the
+// pathname matcher takes them literally
+static int put_escaped(struct expander* e, const char* s, size_t n) {
+    size_t start = 0;
+    for ( size_t i = 0 ; i < n ; ++i ) {
+        if (!is_glob_char(s[i])) continue;
+        if (sbuf_append(&e->cur, s + start, i - start) < 0) return -1;
+        if (sbuf_putc(&e->cur, '\\') < 0) return -1;
+        e->escaped = 1;
+        start = i;
+    }
+    return sbuf_append(&e->cur, s + start, n - start);
+}
+
+// quoted text, never a pattern
+static int put(struct expander* e, const char* s, size_t n) {
+    e->has_field = 1;
+    if (!e->out) return sbuf_append(&e->cur, s, n);
+    return put_escaped(e, s, n);
+}
+
+// unquoted text, its * ? and [ are pathname patterns
+static int put_pattern(struct expander* e, const char* s, size_t n) {
+    e->has_field = 1;
+    if (!e->out) return sbuf_append(&e->cur, s, n);
+    for ( size_t i = 0 ; i < n ; ++i ) {
+        if (s[i] == '*' || s[i] == '?' || s[i] == '[') e->has_glob = 1;
+    }
+    if (!memchr(s, '\\', n)) return sbuf_append(&e->cur, s, n);
+    return put_escaped(e, s, n);
+}
+
+// drops the backslashes put_escaped added
+static void unescape(char* s) {
+    char* d = s;
+    for ( ; *s ; ++s ) {
+        if (*s == '\\' && s[1]) s++;
+        *d++ = *s;
+    }
+    *d = '\0';
+}
+
+static int finish_field(struct expander* e) {
+    if (!e->out || !e->has_field) return 0;
+    char* field = e->cur.p;
+    if (!field) {
+        field = arena_alloc(e->a, 1);
+        if (!field) return -1;
+        field[0] = '\0';
+    }
+    int matched = 0;
+    if (e->has_glob) {
+        matched = glob_expand(e->out, field, e->a);
+        if (matched < 0) return -1;
+    }
+    // no match leaves the word as it was
+    if (!matched) {
+        if (e->escaped) unescape(field);
+        if (push_argv(e->out, e->a, field) < 0) return -1;
+    }
+    sbuf_init(&e->cur, e->a);
+    e->has_field = 0;
+    e->has_glob = 0;
+    e->escaped = 0;
+    return 0;
+}
+
+static int is_ifs_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n';
+}
+
+// unquoted expansion results are split into fields on $IFS
+static int put_split(struct expander* e, const char* val, size_t n) {
+    if (!e->out) return put(e, val, n);
+    const char* ifs = vars_get(&shell_vars, "IFS");
+    if (!ifs) ifs = DEFAULT_IFS;
+    if (!*ifs) return put_pattern(e, val, n);
+
+    size_t i = 0;
+    while (i < n) {
+        char c = val[i];
+        if (!strchr(ifs, c)) {
+            size_t j = i + 1;
+            while (j < n && !strchr(ifs, val[j])) j++;
+            if (put_pattern(e, val + i, j - i) < 0) return -1;
+            i = j;
+            continue;
+        }
+        if (is_ifs_space(c)) {
+            if (finish_field(e) < 0) return -1;
+            while (i < n && is_ifs_space(val[i]) && strchr(ifs, val[i])) i++;
+            continue;
+        }
+        // a non-blank separator always delimits, even an empty field
+        e->has_field = 1;
+        if (finish_field(e) < 0) return -1;
+        i++;
+    }
+    return 0;
+}
+
+static int put_value(struct expander* e, const char* val, size_t n, int in_dq) {
+    if (in_dq) return put(e, val, n);
+    return put_split(e, val, n);
+}
+
+/* parameters */
+
+// $? $$ $# $0..$9 and plain names; NULL when unset
+static const char* param_value(const char* name, size_t len, char* tmp, size_t tmp_size) {
+    struct var_table* t = &shell_vars;
+    if (len == 1) {
+        switch (name[0]) {
+            case '?':
+                snprintf(tmp, tmp_size, "%d", exec_last_status());
+                return tmp;
+            case '$':
+                snprintf(tmp, tmp_size, "%ld", (long)getpid());
+                return tmp;
+            case '#':
+                snprintf(tmp, tmp_size, "%zu", t->nargs ? t->nargs - 1 : 0);
+                return tmp;
+            default:
+                break;
+        }
+    }
+    if (name[0] >= '0' && name[0] <= '9') {
+        size_t k = 0;
+        for ( size_t i = 0 ; i < len ; ++i ) k = k * 10 + (size_t)(name[i] - '0');
+        return k < t->nargs ? t->args[k] : NULL;
+    }
+    return vars_get_n(t, name, len);
+}
+
+// "$@" keeps every positional parameter a separate field, $* joins them
+static int put_args(struct expander* e, char which, int in_dq) {
+    struct var_table* t = &shell_vars;
+    const char* ifs = vars_get(t, "IFS");
+    if (!ifs) ifs = DEFAULT_IFS;
+    for ( size_t i = 1 ; i < t->nargs ; ++i ) {
+        if (i > 1) {
+            if (in_dq && which == '*') {
+                if (*ifs && put(e, ifs, 1) < 0) return -1;
+            }
+            else {
+                e->has_field = 1;
+                if (finish_field(e) < 0) return -1;
+            }
+        }
+        if (put_value(e, t->args[i], strlen(t->args[i]), in_dq) < 0) return -1;
+    }
+    return 0;
+}
+
+static int expand_raw(struct expander* e, const char* s, size_t n, int in_dq);
+
+/* command substitution */
+
+// runs text, replaces it by its output minus trailing newlines
+static int command_subst(struct expander* e, const char* text, size_t n, int in_dq) {
+    char* src = arena_alloc(e->a, n + 1);
+    if (!src) return -1;
+    memcpy(src, text, n);
+    src[n] = '\0';
+
+    struct TokenList toklist;
+    toklist_init(&toklist);
+    struct Node* node = NULL;
+    if (tokenize(&toklist, src, e->a) < 0 ||
+        parse_program(&toklist, e->a, &node) != 0) {
+        fprintf(stderr, "command substitution: syntax error\n");
+        errno = EINVAL;
+        return -1;
+    }
+
+    struct sbuf out;
+    sbuf_init(&out, e->a);
+    if (node && exec_capture(node, e->a, &out) < 0) return -1;
+    while (out.len > 0 && out.p[out.len - 1] == '\n') out.len--;
+    if (out.len == 0) return 0;
+    return put_value(e, out.p, out.len, in_dq);
+}
+
+// `...`: a backslash only escapes $ ` and \ (and " inside double quotes)
+static int backquote_subst(struct expander* e, const char* s, size_t n, int in_dq) {
+    struct sbuf text;
+    sbuf_init(&text, e->a);
+    for ( size_t i = 0 ; i < n ; ++i ) {
+        if (s[i] == '\\' && i + 1 < n &&
+            (s[i+1] == '$' || s[i+1] == '`' || s[i+1] == '\\' || (in_dq && s[i+1] == '"'))) {
+            i++;
+        }
+        if (sbuf_putc(&text, s[i]) < 0) return -1;
+    }
+    return command_subst(e, text.p ? text.p : "", text.len, in_dq);
+}
+
+static int is_name_char(char c, int first) {
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_') return 1;
+    return !first && c >= '0' && c <= '9';
+}
+
+// index of the '}' closing the ${ that starts at s[i], or n
+static size_t brace_end(const char* s, size_t n, size_t i) {
+    int depth = 0;
+    for ( ; i < n ; ++i) {
+        if (s[i] == '\\') { i++; continue; }
+        if (s[i] == '\'') {
+            while (++i < n && s[i] != '\'') {}
+            continue;
+        }
+        if (s[i] == '{') depth++;
+        else if (s[i] == '}' && --depth == 0) return i;
+    }
+    return n;
+}
+
+// ${name} ${#name} ${name[:]-word} ${name[:]=word} ${name[:]+word}
+static int expand_braced(struct expander* e, const char* s, size_t n, int in_dq) {
+    char tmp[32];
+    int length = 0;
+    size_t i = 0;
+    if (n > 1 && s[0] == '#') {
+        length = 1;
+        i = 1;
+    }
+
+    size_t name_start = i;
+    if (i < n && (s[i] == '?' || s[i] == '$' || s[i] == '#' || s[i] == '@' || s[i] == '*')) {
+        i++;
+    }
+    else {
+        while (i < n && is_name_char(s[i], i == name_start)) i++;
+        if (i == name_start) {
+            while (i < n && s[i] >= '0' && s[i] <= '9') i++;
+        }
+    }
+    size_t name_len = i - name_start;
+    if (name_len == 0) goto bad;
+    const char* name = s + name_start;
+
+    if (name_len == 1 && (name[0] == '@' || name[0] == '*')) {
+        if (length || i != n) goto bad;
+        return put_args(e, name[0], in_dq);
+    }
+
+    const char* val = param_value(name, name_len, tmp, sizeof(tmp));
+    if (length) {
+        if (i != n) goto bad;
+        snprintf(tmp, sizeof(tmp), "%zu", val ? strlen(val) : 0);
+        return put_value(e, tmp, strlen(tmp), in_dq);
+    }
+    if (i == n) {
+        return val ? put_value(e, val, strlen(val), in_dq) : 0;
+    }
+
+    int colon = 0;
+    if (s[i] == ':') {
+        colon = 1;
+        i++;
+    }
+    if (i >= n) goto bad;
+    char op = s[i++];
+    const char* word = s + i;
+    size_t word_len = n - i;
+    int set = val && (!colon || *val);
+
+    switch (op) {
+        case '-':
+            if (set) return put_value(e, val, strlen(val), in_dq);
+            return expand_raw(e, word, word_len, in_dq);
+        case '+':
+            if (set) return expand_raw(e, word, word_len, in_dq);
+            return 0;
+        case '=': {
+            if (set) return put_value(e, val, strlen(val), in_dq);
+            struct expander sub = { e->a, NULL, { NULL, 0, 0, e->a }, 0, 0, 0 };
+            if (expand_raw(&sub, word, word_len, in_dq) < 0) return -1;
+            const char* assigned = sub.cur.p ? sub.cur.p : "";
+            if (vars_set_n(&shell_vars, name, name_len, assigned, 0) < 0) goto bad;
+            return put_value(e, assigned, strlen(assigned), in_dq);
+        }
+        default:
+            break;
+    }
+
+bad:
+    fprintf(stderr, "${%.*s}: bad substitution\n", (int)n, s);
+    errno = EINVAL;
+    return -1;
+}
+
+// s[i] is '$', returns the index just past the expansion or -1
+static long expand_dollar(struct expander* e, const char* s, size_t n, size_t i, int in_dq) {
+    char tmp[32];
+    size_t j = i + 1;
+
+    if (j < n && s[j] == '{') {
+        size_t end = brace_end(s, n, j);
+        if (end == n) {
+            fprintf(stderr, "bad substitution: missing '}'\n");
+            errno = EINVAL;
+            return -1;
+        }
+        if (expand_braced(e, s + j + 1, end - j - 1, in_dq) < 0) return -1;
+        return (long)end + 1;
+    }
+    if (j < n && s[j] == '(') {
+        long end = subst_end(s, (long)i);
+        if (end < 0 || (size_t)end > n) {
+            fprintf(stderr, "bad substitution: missing ')'\n");
+            errno = EINVAL;
+            return -1;
+        }
+        if (command_subst(e, s + j + 1, (size_t)end - j - 2, in_dq) < 0) return -1;
+        return end;
+    }
+    if (j < n && (s[j] == '@' || s[j] == '*')) {
+        if (put_args(e, s[j], in_dq) < 0) return -1;
+        return (long)j + 1;
+    }
+    if (j < n && (s[j] == '?' || s[j] == '$' || s[j] == '#' || (s[j] >= '0' && s[j] <= '9'))) {
+        const char* val = param_value(s + j, 1, tmp, sizeof(tmp));
+        if (val && put_value(e, val, strlen(val), in_dq) < 0) return -1;
+        return (long)j + 1;
+    }
+    if (j < n && is_name_char(s[j], 1)) {
+        size_t start = j;
+        while (j < n && is_name_char(s[j], 0)) j++;
+        const char* val = vars_get_n(&shell_vars, s + start, j - start);
+        if (val && put_value(e, val, strlen(val), in_dq) < 0) return -1;
+        return (long)j;
+    }
+    // not an expansion, a literal dollar
+    if (put(e, "$", 1) < 0) return -1;
+    return (long)j;
+}
+
+// quote removal and parameter expansion over s[0..n)
+static int expand_raw(struct expander* e, const char* s, size_t n, int in_dq) {
+    size_t i = 0;
+    while (i < n) {
+        char c = s[i];
+        if (c == '\'' && !in_dq) {
+            size_t j = i + 1;
+            while (j < n && s[j] != '\'') j++;
+            if (put(e, s + i + 1, j - i - 1) < 0) return -1;
+            i = j + 1;
+            continue;
+        }
+        if (c == '"') {
+            in_dq = !in_dq;
+            e->has_field = 1;
+            i++;
+            continue;
+        }
+        if (c == '\\' && i + 1 < n) {
+            char next = s[i + 1];
+            if (!in_dq || next == '$' || next == '`' || next == '"' || next == '\\') {
+                if (put(e, &next, 1) < 0) return -1;
+            }
+            else if (next != '\n') {
+                if (put(e, s + i, 2) < 0) return -1;
+            }
+            i += 2;
+            continue;
+        }
+        if (c == '`') {
+            long end = subst_end(s, (long)i);
+            if (end < 0 || (size_t)end > n) {
+                fprintf(stderr, "bad substitution: missing '`'\n");
+                errno = EINVAL;
+                return -1;
+            }
+            if (backquote_subst(e, s + i + 1, (size_t)end - i - 2, in_dq) < 0) return -1;
+            i = (size_t)end;
+            continue;
+        }
+        if (c == '$') {
+            long next = expand_dollar(e, s, n, i, in_dq);
+            if (next < 0) return -1;
+            i = (size_t)next;
+            continue;
+        }
+        if ((in_dq ? put(e, &c, 1) : put_pattern(e, &c, 1)) < 0) return -1;
+        i++;
+    }
+    return 0;
+}
+
+static int expand_tilde(struct expander* e, const char** raw) {
+    const char* s = *raw;
+    if (s[0] != '~' || (s[1] != '\0' && s[1] != '/')) return 0;
+    const char* home = vars_get(&shell_vars, "HOME");
+    if (!home) return 0;
+    *raw = s + 1;
+    return put(e, home, strlen(home));
+}
+
+/* public api */
+
+// appends the fields raw expands to (possibly none) to out->argv
+int expand_word(struct Cmd* out, const char* raw, struct arena* a) {
+    struct expander e = { a, out, { NULL, 0, 0, a }, 0, 0, 0 };
+    if (expand_tilde(&e, &raw) < 0) return -1;
+    if (expand_raw(&e, raw, strlen(raw), 0) < 0) return -1;
+    return finish_field(&e);
+}
+
+// expansion without field splitting, for redirection targets and assignments
+char* expand_word_single(const char* raw, struct arena* a) {
+    struct expander e = { a, NULL, { NULL, 0, 0, a }, 0, 0, 0 };
+    if (expand_tilde(&e, &raw) < 0) return NULL;
+    if (expand_raw(&e, raw, strlen(raw), 0) < 0) return NULL;
+    if (!e.cur.p) {
+        char* empty = arena_alloc(a, 1);
+        if (empty) empty[0] = '\0';
+        return empty;
+    }
+    return e.cur.p;
+}
+
+// here-document body: $ and ` expand, a backslash only quotes $ ` \ and
+// newline, quotes are ordinary characters
+char* expand_heredoc(const char* body, struct arena* a) {
+    struct expander e = { a, NULL, { NULL, 0, 0, a }, 0, 0, 0 };
+    size_t n = strlen(body);
+    size_t i = 0;
+    while (i < n) {
+        char c = body[i];
+        if (c == '\\' && i + 1 < n) {
+            char next = body[i + 1];
+            if (next == '$' || next == '`' || next == '\\') {
+                if (put(&e, &next, 1) < 0) return NULL;
+            }
+            else if (next != '\n') {
+                if (put(&e, body + i, 2) < 0) return NULL;
+            }
+            i += 2;
+            continue;
+        }
+        if (c == '$') {
+            long next = expand_dollar(&e, body, n, i, 1);
+            if (next < 0) return NULL;
+            i = (size_t)next;
+            continue;
+        }
+        if (c == '`') {
+            long end = subst_end(body, (long)i);
+            if (end < 0) {
+                fprintf(stderr, "bad substitution: missing '`'\n");
+                errno = EINVAL;
+                return NULL;
+            }
+            if (backquote_subst(&e, body + i + 1, (size_t)end - i - 2, 1) < 0) return NULL;
+            i = (size_t)end;
+            continue;
+        }
+        if (put(&e, &c, 1) < 0) return NULL;
+        i++;
+    }
+    if (!e.cur.p) {
+        char* empty = arena_alloc(a, 1);
+        if (empty) empty[0] = '\0';
+        return empty;
+    }
+    return e.cur.p;
+}
+
+// length of NAME in a NAME=value word, 0 if raw isn't an assignment
+size_t assignment_name_len(const char* raw) {
+    size_t i = 0;
+    while (is_name_char(raw[i], i == 0)) i++;
+    return (i > 0 && raw[i] == '=') ? i : 0;
+}
@@ -0,0 +1,27 @@
+#ifndef EXPAND_H
+#define EXPAND_H
+
+#include <stddef.h>
+
+#include "arena.h"
+#include "cmd.h"
+
+// growable string in an arena, grows by doubling like cmdArgvGrow
+struct sbuf {
+    char* p;
+    size_t len;
+    size_t cap;
+    struct arena* a;
+};
+
+void sbuf_init(struct sbuf* sb, struct arena* a);
+int sbuf_reserve(struct sbuf* sb, size_t extra);
+int sbuf_append(struct sbuf* sb, const char* s, size_t n);
+int sbuf_putc(struct sbuf* sb, char c);
+
+int expand_word(struct Cmd* out, const char* raw, struct arena* a);
+char* expand_word_single(const char* raw, struct arena* a);
+char* expand_heredoc(const char* body, struct arena* a);
+size_t assignment_name_len(const char* raw);
+
+#endif
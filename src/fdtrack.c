@@ -0,0 +1,85 @@
+#include "fdtrack.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+
+static const char* owners[FDTRACK_MAX];
+
+// labels fd and makes sure it is close-on-exec, what must outlive the fd
+int fd_track(int fd, const char* what) {
+    if (fd < 0) return fd;
+    int flags = fcntl(fd, F_GETFD);
+    if (flags >= 0 && !(flags & FD_CLOEXEC)) fcntl(fd, F_SETFD, flags | FD_CLOEXEC);
+    if (fd < FDTRACK_MAX) owners[fd] = what;
+    return fd;
+}
+
+// for fds closed some other way, e.g. by fclose
+void fd_untrack(int fd) {
+    if (fd >= 0 && fd < FDTRACK_MAX) owners[fd] = NULL;
+}
+
+int fd_close(int fd) {
+    if (fd < 0) return 0;
+    fd_untrack(fd);
+    return close(fd);
+}
+
+const char* fd_owner(int fd) {
+    return (fd >= 0 && fd < FDTRACK_MAX) ? owners[fd] : NULL;
+}
+
+static int cmp_int(const void* a, const void* b) {
+    int x = *(const int*)a;
+    int y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+// one line per open fd: number, access mode, cloexec, target, owner
+void fd_list(FILE* out) {
+    DIR* dp = opendir("/proc/self/fd");
+    if (!dp) {
+        perror("/proc/self/fd");
+        return;
+    }
+    int self = dirfd(dp);
+    int fds[FDTRACK_MAX];
+    size_t n = 0;
+    struct dirent* de;
+    while ((de = readdir(dp)) && n < FDTRACK_MAX) {
+        if (de->d_name[0] == '.') continue;
+        int fd = atoi(de->d_name);
+        if (fd != self) fds[n++] = fd;
+    }
+    qsort(fds, n, sizeof(int), cmp_int);
+
+    for ( size_t i = 0 ; i < n ; ++i ) {
+        int fd = fds[i];
+        char link[32];
+        char target[PATH_MAX];
+        snprintf(link, sizeof(link), "/proc/self/fd/%d", fd);
+        ssize_t len = readlink(link, target, sizeof(target) - 1);
+        if (len < 0) continue;
+        target[len] = '\0';
+
+        int fl = fcntl(fd, F_GETFL);
+        int fdfl = fcntl(fd, F_GETFD);
+        const char* mode = "?";
+        if (fl >= 0) {
+            int acc = fl & O_ACCMODE;
+            mode = (acc == O_RDONLY) ? "r" : (acc == O_WRONLY) ? "w" : "rw";
+        }
+        int cloexec = (fdfl >= 0 && (fdfl & FD_CLOEXEC));
+        const char* owner = fd_owner(fd);
+        fprintf(out, "%3d %-2s %-7s %s", fd, mode, cloexec ? "cloexec" : "-", target);
+        if (owner) fprintf(out, " (%s)", owner);
+        else if (fd > 2 && !cloexec) fprintf(out, " (inherited by children)");
+        fputc('\n', out);
+    }
+    closedir(dp);
+}
@@ -0,0 +1,17 @@
+#ifndef FDTRACK_H
+#define FDTRACK_H
+
+#include <stdio.h>
+
+#define FDTRACK_MAX 1024 // fds at or above this are not tracked
+
+// every fd the shell opens for itself is registered with a short label and
+// is close-on-exec, so nothing but 0-2 and the redirections a command asked
+// for reaches an exec'd program
+int fd_track(int fd, const char* what);
+int fd_close(int fd);
+void fd_untrack(int fd);
+const char* fd_owner(int fd);
+void fd_list(FILE* out);
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// FNV-1a, shared by every string keyed table in the shell
+static inline uint64_t hash_bytes(const char* s, size_t n) {
+    uint64_t h = 1469598103934665603ull;
+    for ( size_t i = 0 ; i < n ; ++i ) {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+#endif
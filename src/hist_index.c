@@ -0,0 +1,276 @@
+#define _GNU_SOURCE // memmem
+#include "hist_index.h"
+#include "hash.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+/* hashing */
+
+static uint32_t hash_tri(uint32_t key) {
+    key ^= key >> 15;
+    key *= 0x2c1b3c6du;
+    key ^= key >> 12;
+    key *= 0x297a2d39u;
+    key ^= key >> 15;
+    return key;
+}
+
+// +1 so that a valid trigram never packs to 0 (the empty slot marker)
+static uint32_t tri_key(const char* s) {
+    return (((uint32_t)(unsigned char)s[0] << 16) |
+            ((uint32_t)(unsigned char)s[1] << 8) |
+            (uint32_t)(unsigned char)s[2]) + 1;
+}
+
+/* init / destroy */
+
+void hist_index_init(struct hist_index* h) {
+    arena_init(&h->strings);
+    h->entries = NULL;
+    h->nentries = 0;
+    h->entry_cap = 0;
+    h->line_slots = NULL;
+    h->line_mask = 0;
+    h->tri = NULL;
+    h->tri_mask = 0;
+    h->ntri = 0;
+    h->seq = 0;
+}
+
+void hist_index_destroy(struct hist_index* h) {
+    if (h->tri) {
+        for ( size_t i = 0 ; i <= h->tri_mask ; ++i ) {
+            free(h->tri[i].ids);
+        }
+    }
+    free(h->tri);
+    free(h->line_slots);
+    free(h->entries);
+    arena_destroy(&h->strings);
+    hist_index_init(h);
+}
+
+/* line table: dedupes identical lines so each one is indexed once */
+
+static int line_table_grow(struct hist_index* h) {
+    size_t old_slots = h->line_slots ? h->line_mask + 1 : 0;
+    size_t new_slots = old_slots ? old_slots * 2 : HIST_DEFAULT_SLOTS;
+
+    uint32_t* v = calloc(new_slots, sizeof(uint32_t));
+    if (!v) return -1;
+
+    size_t mask = new_slots - 1;
+    for ( size_t i = 0 ; i < old_slots ; ++i ) {
+        uint32_t slot = h->line_slots[i];
+        if (!slot) continue;
+        const struct hist_entry* e = &h->entries[slot - 1];
+        size_t pos = hash_bytes(e->line, e->len) & mask;
+        while (v[pos]) pos = (pos + 1) & mask;
+        v[pos] = slot;
+    }
+    free(h->line_slots);
+    h->line_slots = v;
+    h->line_mask = mask;
+    return 0;
+}
+
+// returns the slot holding the line or the empty slot where it belongs
+static uint32_t* line_table_find(struct hist_index* h, const char* line, size_t len) {
+    size_t pos = hash_bytes(line, len) & h->line_mask;
+    for (;;) {
+        uint32_t* slot = &h->line_slots[pos];
+        if (*slot == 0) return slot;
+        const struct hist_entry* e = &h->entries[*slot - 1];
+        if (e->len == len && memcmp(e->line, line, len) == 0) return slot;
+        pos = (pos + 1) & h->line_mask;
+    }
+}
+
+/* trigram table */
+
+static int tri_table_grow(struct hist_index* h) {
+    size_t old_slots = h->tri ? h->tri_mask + 1 : 0;
+    size_t new_slots = old_slots ? old_slots * 2 : HIST_DEFAULT_SLOTS;
+
+    struct hist_posting* v = calloc(new_slots, sizeof(struct hist_posting));
+    if (!v) return -1;
+
+    size_t mask = new_slots - 1;
+    for ( size_t i = 0 ; i < old_slots ; ++i ) {
+        if (!h->tri[i].key) continue;
+        size_t pos = hash_tri(h->tri[i].key) & mask;
+        while (v[pos].key) pos = (pos + 1) & mask;
+        v[pos] = h->tri[i];
+    }
+    free(h->tri);
+    h->tri = v;
+    h->tri_mask = mask;
+    return 0;
+}
+
+static struct hist_posting* tri_table_lookup(const struct hist_index* h, uint32_t key) {
+    if (!h->tri) return NULL;
+    size_t pos = hash_tri(key) & h->tri_mask;
+    while (h->tri[pos].key) {
+        if (h->tri[pos].key == key) return &h->tri[pos];
+        pos = (pos + 1) & h->tri_mask;
+    }
+    return NULL;
+}
+
+static struct hist_posting* tri_table_insert(struct hist_index* h, uint32_t key) {
+    // keep load factor under 1/2
+    if (!h->tri || (h->ntri + 1) * 2 > h->tri_mask + 1) {
+        if (tri_table_grow(h) < 0) return NULL;
+    }
+    size_t pos = hash_tri(key) & h->tri_mask;
+    while (h->tri[pos].key) {
+        if (h->tri[pos].key == key) return &h->tri[pos];
+        pos = (pos + 1) & h->tri_mask;
+    }
+    h->tri[pos].key = key;
+    h->ntri++;
+    return &h->tri[pos];
+}
+
+static int posting_push(struct hist_posting* p, uint32_t id) {
+    // a trigram repeated inside one line only needs to be recorded once
+    if (p->n && p->ids[p->n - 1] == id) return 0;
+    if (p->n == p->cap) {
+        uint32_t new_cap = p->cap ? p->cap * 2 : 4;
+        uint32_t* v = realloc(p->ids, new_cap * sizeof(uint32_t));
+        if (!v) return -1;
+        p->ids = v;
+        p->cap = new_cap;
+    }
+    p->ids[p->n++] = id;
+    return 0;
+}
+
+/* public api */
+
+int hist_index_add(struct hist_index* h, const char* line) {
+    size_t len = strlen(line);
+    if (len == 0) return 0;
+    if (len > UINT32_MAX || h->nentries >= UINT32_MAX - 1) {
+        errno = EOVERFLOW;
+        return -1;
+    }
+
+    // keep the line table at most half full
+    if (!h->line_slots || (h->nentries + 1) * 2 > h->line_mask + 1) {
+        if (line_table_grow(h) < 0) return -1;
+    }
+
+    h->seq++;
+    uint32_t* slot = line_table_find(h, line, len);
+    if (*slot) {
+        struct hist_entry* e = &h->entries[*slot - 1];
+        e->count++;
+        e->last_seq = h->seq;
+        return 0;
+    }
+
+    if (h->nentries == h->entry_cap) {
+        size_t new_cap = h->entry_cap ? h->entry_cap * 2 : HIST_DEFAULT_ENTRIES;
+        struct hist_entry* v = realloc(h->entries, new_cap * sizeof(struct hist_entry));
+        if (!v) return -1;
+        h->entries = v;
+        h->entry_cap = new_cap;
+    }
+
+    char* copy = (char*)arena_strdup(&h->strings, line);
+    if (!copy) return -1;
+
+    uint32_t id = (uint32_t)h->nentries;
+    struct hist_entry* e = &h->entries[h->nentries++];
+    e->line = copy;
+    e->len = (uint32_t)len;
+    e->count = 1;
+    e->last_seq = h->seq;
+    *slot = id + 1;
+
+    for ( size_t i = 0 ; i + 3 <= len ; ++i ) {
+        struct hist_posting* p = tri_table_insert(h, tri_key(copy + i));
+        if (!p || posting_push(p, id) < 0) return -1;
+    }
+    return 0;
+}
+
+const char* hist_index_line(const struct hist_index* h, uint32_t id) {
+    if (id >= h->nentries) return NULL;
+    return h->entries[id].line;
+}
+
+// frequency decayed by how many commands ago the line was last run
+static double entry_score(const struct hist_index* h, const struct hist_entry* e) {
+    double age = (double)(h->seq - e->last_seq);
+    return (double)e->count / (1.0 + age / 64.0);
+}
+
+// keep out[] sorted by descending score, dropping the worst when full
+static void top_insert(struct hist_match* out, size_t* n, size_t max,
+                       uint32_t id, double score) {
+    if (*n == max && score <= out[max - 1].score) return;
+    size_t pos = (*n < max) ? (*n)++ : max - 1;
+    while (pos > 0 && out[pos - 1].score < score) {
+        out[pos] = out[pos - 1];
+        pos--;
+    }
+    out[pos].id = id;
+    out[pos].score = score;
+}
+
+static int posting_contains(const struct hist_posting* p, uint32_t id) {
+    size_t lo = 0, hi = p->n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (p->ids[mid] < id) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo < p->n && p->ids[lo] == id;
+}
+
+size_t hist_index_search(struct hist_index* h, const char* query,
+                         struct hist_match* out, size_t max) {
+    size_t qlen = strlen(query);
+    size_t n = 0;
+    if (max == 0) return 0;
+
+    // too short for a trigram: scan every unique line
+    if (qlen < HIST_SHORT_QUERY) {
+        for ( size_t id = 0 ; id < h->nentries ; ++id ) {
+            const struct hist_entry* e = &h->entries[id];
+            if (qlen && !memmem(e->line, e->len, query, qlen)) continue;
+            top_insert(out, &n, max, (uint32_t)id, entry_score(h, e));
+        }
+        return n;
+    }
+
+    // drive the scan from the rarest trigram, filter by the next rarest
+    const struct hist_posting* rare = NULL;
+    const struct hist_posting* second = NULL;
+    for ( size_t i = 0 ; i + 3 <= qlen ; ++i ) {
+        const struct hist_posting* p = tri_table_lookup(h, tri_key(query + i));
+        if (!p) return 0;
+        if (!rare || p->n < rare->n) {
+            second = rare;
+            rare = p;
+        }
+        else if (p != rare && (!second || p->n < second->n)) {
+            second = p;
+        }
+    }
+
+    for ( uint32_t k = 0 ; k < rare->n ; ++k ) {
+        uint32_t id = rare->ids[k];
+        if (second && !posting_contains(second, id)) continue;
+        const struct hist_entry* e = &h->entries[id];
+        if (!memmem(e->line, e->len, query, qlen)) continue;
+        top_insert(out, &n, max, id, entry_score(h, e));
+    }
+    return n;
+}
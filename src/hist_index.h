@@ -0,0 +1,61 @@
+#ifndef HIST_INDEX_H
+#define HIST_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+
+#define HIST_DEFAULT_ENTRIES 256
+#define HIST_DEFAULT_SLOTS 1024
+#define HIST_SHORT_QUERY 3
+
+// one unique history line, duplicates bump count/last_seq instead of adding
+struct hist_entry {
+    const char* line; // owned by hist_index.strings
+    uint32_t len;
+    uint32_t count;
+    uint64_t last_seq;
+};
+
+// posting list of entry ids containing one trigram, ids are appended in
+// increasing order so the list is always sorted
+struct hist_posting {
+    uint32_t key; // 0 means empty slot
+    uint32_t n;
+    uint32_t cap;
+    uint32_t* ids;
+};
+
+struct hist_index {
+    struct arena strings;
+
+    struct hist_entry* entries;
+    size_t nentries;
+    size_t entry_cap;
+
+    // line -> entry id + 1 (open addressing, 0 == empty)
+    uint32_t* line_slots;
+    size_t line_mask;
+
+    // trigram -> posting list (open addressing)
+    struct hist_posting* tri;
+    size_t tri_mask;
+    size_t ntri;
+
+    uint64_t seq;
+};
+
+struct hist_match {
+    uint32_t id;
+    double score;
+};
+
+void hist_index_init(struct hist_index* h);
+void hist_index_destroy(struct hist_index* h);
+int hist_index_add(struct hist_index* h, const char* line);
+size_t hist_index_search(struct hist_index* h, const char* query,
+                         struct hist_match* out, size_t max);
+const char* hist_index_line(const struct hist_index* h, uint32_t id);
+
+#endif
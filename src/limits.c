@@ -0,0 +1,297 @@
+#define _GNU_SOURCE // clone3 via syscall, getline
+#include "limits.h"
+#include "fdtrack.h"
+#include "vars.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <linux/sched.h> // struct clone_args, CLONE_INTO_CGROUP
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+/* ulimit */
+
+const struct rlimit_opt rlimit_opts[] = {
+    { 'c', RLIMIT_CORE,    1024, "core file size (blocks)" },
+    { 'd', RLIMIT_DATA,    1024, "data seg size (kbytes)" },
+    { 'f', RLIMIT_FSIZE,   1024, "file size (blocks)" },
+    { 'l', RLIMIT_MEMLOCK, 1024, "max locked memory (kbytes)" },
+    { 'm', RLIMIT_RSS,     1024, "max memory size (kbytes)" },
+    { 'n', RLIMIT_NOFILE,  1,    "open files" },
+    { 's', RLIMIT_STACK,   1024, "stack size (kbytes)" },
+    { 't', RLIMIT_CPU,     1,    "cpu time (seconds)" },
+    { 'u', RLIMIT_NPROC,   1,    "max user processes" },
+    { 'v', RLIMIT_AS,      1024, "virtual memory (kbytes)" },
+    { 0, 0, 0, NULL },
+};
+
+// what ulimit changed, by resource
+static struct rlimit pending[RLIM_NLIMITS];
+static unsigned char pending_set[RLIM_NLIMITS];
+static int npending;
+
+const struct rlimit_opt* rlimit_find(char opt) {
+    for ( const struct rlimit_opt* o = rlimit_opts ; o->opt ; ++o ) {
+        if (o->opt == opt) return o;
+    }
+    return NULL;
+}
+
+void rlimit_get(const struct rlimit_opt* o, struct rlimit* out) {
+    if (pending_set[o->resource]) *out = pending[o->resource];
+    else getrlimit(o->resource, out);
+}
+
+int rlimit_set(const struct rlimit_opt* o, rlim_t value, int soft, int hard) {
+    struct rlimit now, lim;
+    rlimit_get(o, &lim);
+    getrlimit(o->resource, &now);
+    if (soft) lim.rlim_cur = value;
+    if (hard) lim.rlim_max = value;
+    // checked here, so a child's setrlimit doesn't fail for every command
+    if (lim.rlim_cur > lim.rlim_max) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (lim.rlim_max > now.rlim_max && geteuid() != 0) {
+        errno = EPERM;
+        return -1;
+    }
+    if (!pending_set[o->resource]) npending++;
+    pending_set[o->resource] = 1;
+    pending[o->resource] = lim;
+    return 0;
+}
+
+int rlimits_active(void) {
+    return npending > 0;
+}
+
+int rlimits_apply(void) {
+    for ( int r = 0 ; npending && r < RLIM_NLIMITS ; ++r ) {
+        if (pending_set[r] && setrlimit(r, &pending[r]) < 0) return -1;
+    }
+    return 0;
+}
+
+/* limit */
+
+static unsigned cgroup_seq;
+
+// where cgroup2 is mounted: /sys/fs/cgroup, or .../unified on hybrid hosts
+static char* cgroup_mount(void) {
+    FILE* f = fopen("/proc/self/mountinfo", "re");
+    if (!f) return NULL;
+    char* line = NULL;
+    size_t cap = 0;
+    char* found = NULL;
+    while (!found && getline(&line, &cap, f) > 0) {
+        char* sep = strstr(line, " - cgroup2 ");
+        if (!sep) continue;
+        // id parent major:minor root mountpoint ...
+        char* p = line;
+        for ( int field = 0 ; field < 4 && p ; ++field ) {
+            p = strchr(p, ' ');
+            if (p) ++p;
+        }
+        char* end = p ? strchr(p, ' ') : NULL;
+        if (end) found = strndup(p, (size_t)(end - p));
+    }
+    free(line);
+    fclose(f);
+    return found;
+}
+
+// the shell's own group, as /proc/self/cgroup says: "0::/path"
+static char* cgroup_self(void) {
+    FILE* f = fopen("/proc/self/cgroup", "re");
+    if (!f) return NULL;
+    char* line = NULL;
+    size_t cap = 0;
+    char* found = NULL;
+    ssize_t len;
+    while (!found && (len = getline(&line, &cap, f)) > 0) {
+        if (strncmp(line, "0::", 3) != 0) continue;
+        if (line[len - 1] == '\n') line[len - 1] = '\0';
+        found = strdup(line + 3);
+    }
+    free(line);
+    fclose(f);
+    return found;
+}
+
+static int write_file(int dirfd, const char* name, const char* value) {
+    int fd = openat(dirfd, name, O_WRONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    size_t len = strlen(value);
+    ssize_t w = write(fd, value, len);
+    int err = errno;
+    close(fd);
+    errno = err;
+    return w == (ssize_t)len ? 0 : -1;
+}
+
+// the controller has to be listed in base's cgroup.controllers, then
+// switched on for its children
+static int enable_controller(int basefd, const char* base, const char* ctrl) {
+    char buf[256] = "";
+    int fd = openat(basefd, "cgroup.controllers", O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        ssize_t r = read(fd, buf, sizeof(buf) - 1);
+        buf[r > 0 ? r : 0] = '\0';
+        close(fd);
+    }
+    size_t n = strlen(ctrl);
+    int listed = 0;
+    for ( char* p = buf ; !listed && (p = strstr(p, ctrl)) ; p += n ) {
+        listed = (p == buf || p[-1] == ' ') && (p[n] == ' ' || p[n] == '\n' || p[n] == '\0');
+    }
+    if (!listed) {
+        fprintf(stderr, "limit: %s: no %s controller (set %s to a group that has one)\n",
+                base, ctrl, CGROUP_ENV);
+        return -1;
+    }
+    char req[32];
+    snprintf(req, sizeof(req), "+%s", ctrl);
+    if (write_file(basefd, "cgroup.subtree_control", req) < 0) {
+        // EBUSY: base has processes of its own, like the shell, and isn't the root
+        fprintf(stderr, "limit: %s: enabling %s: %s (set %s to a group the shell may manage)\n",
+                base, ctrl, strerror(errno), CGROUP_ENV);
+        return -1;
+    }
+    return 0;
+}
+
+static int set_limits(struct cgroup* cg, const struct cgroup_limits* lim) {
+    char val[64];
+    if (lim->mem >= 0) {
+        snprintf(val, sizeof(val), "%lld", lim->mem);
+        if (write_file(cg->fd, "memory.max", val) < 0) return -1;
+        // without this, the group swaps instead of hitting the limit
+        write_file(cg->fd, "memory.swap.max", "0");
+    }
+    if (lim->cpus >= 0) {
+        snprintf(val, sizeof(val), "%lld %d",
+                 (long long)(lim->cpus * CGROUP_CPU_PERIOD), CGROUP_CPU_PERIOD);
+        if (write_file(cg->fd, "cpu.max", val) < 0) return -1;
+    }
+    if (lim->pids >= 0) {
+        snprintf(val, sizeof(val), "%lld", lim->pids);
+        if (write_file(cg->fd, "pids.max", val) < 0) return -1;
+    }
+    return 0;
+}
+
+int cgroup_create(struct cgroup* cg, const struct cgroup_limits* lim) {
+    cg->path = NULL;
+    cg->fd = -1;
+    char* mount = cgroup_mount();
+    const char* env = vars_get(&shell_vars, CGROUP_ENV);
+    char* rel = env && *env ? strdup(env) : cgroup_self();
+    if (!mount || !rel) {
+        fprintf(stderr, "limit: no cgroup v2 hierarchy\n");
+        free(mount);
+        free(rel);
+        return -1;
+    }
+    char* base = NULL;
+    int rc = asprintf(&base, "%s%s%s", mount, rel[0] == '/' ? "" : "/", rel);
+    free(mount);
+    free(rel);
+    if (rc < 0) return -1;
+    size_t blen = strlen(base);
+    while (blen > 1 && base[blen - 1] == '/') base[--blen] = '\0';
+
+    int basefd = open(base, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    rc = -1;
+    if (basefd < 0) {
+        fprintf(stderr, "limit: %s: %s\n", base, strerror(errno));
+        goto out;
+    }
+    if ((lim->mem >= 0 && enable_controller(basefd, base, "memory") < 0) ||
+        (lim->cpus >= 0 && enable_controller(basefd, base, "cpu") < 0) ||
+        (lim->pids >= 0 && enable_controller(basefd, base, "pids") < 0)) {
+        goto out;
+    }
+    if (asprintf(&cg->path, "%s/shell-%d-%u", base, (int)getpid(), cgroup_seq++) < 0) {
+        cg->path = NULL;
+        goto out;
+    }
+    if (mkdir(cg->path, 0755) < 0) {
+        fprintf(stderr, "limit: %s: %s\n", cg->path, strerror(errno));
+        goto out;
+    }
+    cg->fd = fd_track(open(cg->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC), "cgroup");
+    if (cg->fd < 0 || set_limits(cg, lim) < 0) {
+        fprintf(stderr, "limit: %s: %s\n", cg->path, strerror(errno));
+        cgroup_remove(cg);
+        goto out;
+    }
+    rc = 0;
+out:
+    if (basefd >= 0) close(basefd);
+    if (rc < 0 && cg->path) {
+        free(cg->path);
+        cg->path = NULL;
+    }
+    free(base);
+    return rc;
+}
+
+// after cgroup.kill, until "populated 0" shows up in cgroup.events
+static void wait_drained(struct cgroup* cg) {
+    int fd = openat(cg->fd, "cgroup.events", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    for ( int waited = 0 ; waited < CGROUP_DRAIN_MS ; waited += 10 ) {
+        char buf[256];
+        ssize_t r = pread(fd, buf, sizeof(buf) - 1, 0);
+        if (r <= 0) break;
+        buf[r] = '\0';
+        if (strstr(buf, "populated 0")) break;
+        // the file signals POLLPRI on every change
+        struct pollfd p = { .fd = fd, .events = POLLPRI };
+        poll(&p, 1, 10);
+    }
+    close(fd);
+}
+
+void cgroup_remove(struct cgroup* cg) {
+    if (!cg->path) return;
+    if (rmdir(cg->path) < 0 && errno == EBUSY && cg->fd >= 0) {
+        // the command is gone, whatever it left behind goes with the group
+        if (write_file(cg->fd, "cgroup.kill", "1") == 0) wait_drained(cg);
+        if (rmdir(cg->path) < 0) fprintf(stderr, "limit: %s: %s\n", cg->path, strerror(errno));
+    }
+    if (cg->fd >= 0) fd_close(cg->fd);
+    free(cg->path);
+    cg->path = NULL;
+    cg->fd = -1;
+}
+
+pid_t cgroup_fork(struct cgroup* cg) {
+    struct clone_args args = {
+        .flags = CLONE_INTO_CGROUP,
+        .exit_signal = SIGCHLD,
+        .cgroup = (unsigned long long)cg->fd,
+    };
+    // no fork handlers run, another thread may hold the malloc or stdio
+    // locks: the child may only make system calls until it execs
+    pid_t pid = (pid_t)syscall(SYS_clone3, &args, sizeof(args));
+    if (pid >= 0 || (errno != ENOSYS && errno != E2BIG && errno != EINVAL)) return pid;
+
+    // before Linux 5.7: the child moves itself before it execs
+    pid = fork();
+    if (pid == 0 && write_file(cg->fd, "cgroup.procs", "0") < 0) {
+        static const char msg[] = "limit: cannot join the cgroup\n";
+        write(STDERR_FILENO, msg, sizeof(msg) - 1);
+        _exit(125);
+    }
+    return pid;
+}
@@ -0,0 +1,57 @@
+#ifndef LIMITS_H
+#define LIMITS_H
+
+#include <sys/resource.h>
+#include <sys/types.h>
+
+#define CGROUP_ENV "SHELL_CGROUP"   // parent of limit's groups, default: the shell's own
+#define CGROUP_CPU_PERIOD 100000    // cpu.max period in microseconds
+#define CGROUP_DRAIN_MS 1000        // how long a killed group may take to empty
+
+/* ulimit */
+
+// ulimit sets limits for the commands the shell starts, not for the shell
+// itself (a small -n or -v would break it): every child applies them
+// between fork and exec.
+
+struct rlimit_opt {
+    char opt;       // ulimit -opt
+    int resource;   // RLIMIT_*
+    rlim_t unit;    // bytes per unit ulimit shows and takes
+    const char* what;
+};
+
+extern const struct rlimit_opt rlimit_opts[];
+
+const struct rlimit_opt* rlimit_find(char opt);
+// soft and/or hard limit for o's resource, RLIM_INFINITY for unlimited
+int rlimit_set(const struct rlimit_opt* o, rlim_t value, int soft, int hard);
+// what a command would get
+void rlimit_get(const struct rlimit_opt* o, struct rlimit* out);
+int rlimits_active(void);
+// in the child: -1 with errno when one could not be set
+int rlimits_apply(void);
+
+/* limit */
+
+// a transient cgroup v2 group under SHELL_CGROUP (or the shell's own
+// group) for one command: memory.max, cpu.max and pids.max, -1 for unset
+struct cgroup_limits {
+    long long mem;
+    double cpus;
+    long long pids;
+};
+
+struct cgroup {
+    char* path;
+    int fd;   // the directory, for clone3(CLONE_INTO_CGROUP)
+};
+
+int cgroup_create(struct cgroup* cg, const struct cgroup_limits* lim);
+// kills whatever the command left running in it, then removes it
+void cgroup_remove(struct cgroup* cg);
+// clone3 into cg, fork plus a write to cgroup.procs where that's missing.
+// The child may only make async-signal-safe calls before it execs.
+pid_t cgroup_fork(struct cgroup* cg);
+
+#endif
@@ -0,0 +1,82 @@
+#include "line_reader.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+void lr_init(struct line_reader* lr, int fd) {
+    memset(lr, 0, sizeof(*lr));
+    lr->fd = fd;
+}
+
+void lr_destroy(struct line_reader* lr) {
+    free(lr->buf);
+    lr_init(lr, -1);
+}
+
+// makes room for one more LR_CHUNK read after end
+static int make_room(struct line_reader* lr) {
+    if (lr->cap - lr->end > LR_CHUNK) return 0;
+
+    // slide the partial line to the front first, grow only if that is not enough
+    if (lr->start > 0) {
+        memmove(lr->buf, lr->buf + lr->start, lr->end - lr->start);
+        lr->end -= lr->start;
+        lr->start = 0;
+        if (lr->cap - lr->end > LR_CHUNK) return 0;
+    }
+
+    size_t cap = lr->cap ? lr->cap : LR_CHUNK;
+    while (cap - lr->end <= LR_CHUNK) cap *= 2;
+    char* buf = realloc(lr->buf, cap);
+    if (!buf) return -1;
+    lr->buf = buf;
+    lr->cap = cap;
+    return 0;
+}
+
+char* lr_next(struct line_reader* lr, size_t* len) {
+    for (;;) {
+        char* line = lr->buf + lr->start;
+        size_t avail = lr->end - lr->start;
+        char* nl = avail > lr->scan ? memchr(line + lr->scan, '\n', avail - lr->scan) : NULL;
+        if (nl) {
+            *nl = '\0';
+            *len = (size_t)(nl - line);
+            lr->start += *len + 1;
+            lr->scan = 0;
+            return line;
+        }
+        lr->scan = avail;
+
+        if (lr->eof) {
+            if (avail == 0) return NULL;
+            // last line without a newline
+            line[avail] = '\0';
+            *len = avail;
+            lr->start = lr->end;
+            lr->scan = 0;
+            return line;
+        }
+
+        if (make_room(lr) < 0) return NULL;
+        ssize_t r = read(lr->fd, lr->buf + lr->end, lr->cap - lr->end - 1);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            return NULL;
+        }
+        if (r == 0) lr->eof = 1;
+        lr->end += (size_t)r;
+    }
+}
+
+int lr_at_end(struct line_reader* lr) {
+    if (lr->start != lr->end) return 0;
+    if (lr->eof) return 1;
+    struct stat st;
+    if (fstat(lr->fd, &st) < 0 || !S_ISREG(st.st_mode)) return 0;
+    off_t pos = lseek(lr->fd, 0, SEEK_CUR);
+    return pos >= 0 && pos >= st.st_size;
+}
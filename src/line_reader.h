@@ -0,0 +1,34 @@
+#ifndef LINE_READER_H
+#define LINE_READER_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#define LR_CHUNK (64 * 1024) // bytes asked of each read(2)
+
+// reads lines from a file descriptor through one reusable buffer. Data
+// comes in LR_CHUNK reads, newlines are found with memchr, and a line is
+// handed out in place (its '\n' replaced by a NUL), so there is no copy
+// and no length limit. Unconsumed bytes slide to the front before the
+// buffer grows.
+struct line_reader {
+    int fd;
+    char* buf;
+    size_t cap;    // allocated bytes, one is always kept for a NUL
+    size_t start;  // first byte not handed out yet
+    size_t end;    // end of the data read so far
+    size_t scan;   // bytes after start already known to hold no '\n'
+    int eof;
+};
+
+void lr_init(struct line_reader* lr, int fd);
+void lr_destroy(struct line_reader* lr);
+// the next line without its newline, valid until the following call.
+// NULL at end of input, or on a read error (errno set).
+char* lr_next(struct line_reader* lr, size_t* len);
+// 1 when lr_next is known to return NULL next, without reading: after EOF,
+// or for a regular file whose every byte has been handed out. A pipe or a
+// terminal could always get more, so for those it is 0 until EOF is seen.
+int lr_at_end(struct line_reader* lr);
+
+#endif
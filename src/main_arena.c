@@ -4,651 +4,144 @@
 #include <string.h>
 #include <limits.h>
 #include <unistd.h>
-#include <ctype.h>
 #include <dirent.h>
 #include <fcntl.h>
-#include <sys/wait.h>
-#include <readline/readline.h>
-#include <readline/history.h>
 
 #include "arena.h"
-
-#define DEFAULT_STR_ALLOC 64
-#define MAX_STR_ALLOC 1024
-
-#define NUM_COMMAND 5
-
-#define DEFAULT_NUM_TOKENS 10
-#define DEFAULT_NUM_ARG 8
-#define DEFAULT_REDIR_CAP 6
-
-enum RedirType {
-    R_IN,
-    R_OUT,
-    R_OUT_APPEND,
-    R_ERR,
-    R_ERR_APPEND,
-    R_NONE
-};
-
-struct Redir {
-    int fd;
-    enum RedirType rd_type;
-    const char* path;
-};
-
-enum TokenType {
-    TOK_WORD,
-    TOK_REDIR,
-    TOK_PIPE,
-    TOK_NONE
-};
-
-struct Token {
-    enum TokenType tok_type;
-    enum RedirType rd_type;
-    int fd;
-    char* text;
-};
-
-struct TokenList {
-    struct Token* tokens;
-    size_t ntoks;
-    size_t tok_cap;
-};
-
-void token_init(struct Token* token) {
-    token->tok_type = TOK_NONE;
-    token->rd_type = R_NONE;
-    token->fd = -1;
-    token->text = NULL;
-}
-
-void toklist_init(struct TokenList* toklist) {
-    toklist->tokens = NULL;
-    toklist->ntoks = 0;
-    toklist->tok_cap = 0;
-}
-
-struct Cmd {
-  size_t argc;
-  char** argv;
-  size_t cap;
-  struct Redir* rds;
-  size_t nrds;
-  size_t rd_cap;
-};
-
-struct Cmd* createCmd();
-void freeCmd(struct Cmd* cmd);
-void initCmd(struct Cmd* cmd);
-void initCmdArgv(struct Cmd* cmd, struct arena* a);
-
-void initCmd(struct Cmd* cmd) {
-  cmd->argc = 0;
-  cmd->argv = NULL;
-  cmd->cap = DEFAULT_NUM_ARG;
-  cmd->rds = NULL;
-  cmd->nrds = 0;
-  cmd->rd_cap = DEFAULT_REDIR_CAP;
-}
-
-void initCmdRedir(struct Cmd* cmd, struct arena* a) {
-    cmd->rds = arena_alloc(a, cmd->rd_cap * sizeof(struct Redir));
-    if (cmd->rds == NULL) {
-        perror("Not enough memory at initCmdRedir");
-        return;
-    }
-}
-
-void initCmdArgv(struct Cmd* cmd, struct arena* a) {
-    cmd->argv = arena_alloc(a, cmd->cap * sizeof(char*));
-    if (cmd->argv == NULL) {
-        perror("Not enough memory at initCmdArgv");
-        return;
-    }
-    for ( size_t i = 0 ; i < cmd->cap ; ++i ) {
-        cmd->argv[i] = NULL;
-    }
-}
-
-int cmdRedirGrow(struct Cmd* cmd, struct arena* a) {
-    size_t old = cmd->rd_cap;
-    size_t new = old * 2;
-
-    struct Redir* v = arena_alloc(a, sizeof(struct Redir) * new);
-    if (!v) return -1;
-
-    memcpy(v, cmd->rds, sizeof(struct Redir) * old);
-    memset(v + old, 0, sizeof(struct Redir) * (new - old));
-
-    cmd->rds = v;
-    cmd->rd_cap  = new;
-    return 0;
-}
-
-int cmdArgvGrow(struct Cmd* cmd, struct arena* a) {
-    size_t old = cmd->cap;
-    size_t new = old * 2;
-
-    char** v = arena_alloc(a, sizeof(char*) * new);
-    if (!v) return -1;
-
-    memcpy(v, cmd->argv, sizeof(char*) * old);
-    memset(v + old, 0, sizeof(char*) * (new - old));
-
-    cmd->argv = v;
-    cmd->cap  = new;
-    return 0;
-}
-
-int tokListGrow(struct TokenList* toklist, struct arena* a) {
-    size_t old = toklist->tok_cap;
-    size_t new = old * 2;
-    if (old == 0) new = DEFAULT_NUM_TOKENS;
-
-    struct Token* v = arena_alloc(a, sizeof(struct Token) * new);
-    if (!v) return -1;
-
-    memcpy(v, toklist->tokens, sizeof(struct Token) * old);
-    memset(v + old, 0, sizeof(struct Token) * (new - old));
-
-    toklist->tokens = v;
-    toklist->tok_cap  = new;
-
-    for (size_t num_tok = old ; num_tok < toklist->tok_cap ; num_tok++) {
-        token_init(&toklist->tokens[num_tok]);
-    }
-
-    return 0;
-}
-
-int toklist_push(struct TokenList* toklist, struct arena* a, struct Token token) {
-    if (toklist->ntoks == toklist->tok_cap) {
-        if (tokListGrow(toklist, a) < 0) return -1;
-    }
-    toklist->tokens[toklist->ntoks++] = token;
-    return 0;
+#include "cmd.h"
+#include "cmd_cache.h"
+#include "dirs.h"
+#include "evloop.h"
+#include "exec.h"
+#include "fdtrack.h"
+#include "hist_index.h"
+#include "line_reader.h"
+#include "parser.h"
+#include "path_index.h"
+#include "pathglob.h"
+#include "prompt.h"
+#include "rl.h"
+#include "server.h"
+#include "vars.h"
+#include "zygote.h"
+
+extern char** environ;
+
+#define HIST_SEARCH_RESULTS 64
+
+static struct hist_index hist_idx;
+struct cmd_cache cmd_cache;
+
+char* readCommand(const char* prompt) {
+  char* line = rl.readline(prompt);
+  if (!line) {
+    return NULL;
+  }
+  if (*line) {
+    rl.add_history(line);
+    hist_index_add(&hist_idx, line);
+  }
+  return line; // caller frees
 }
 
-struct Cmd* createCmd() {
-  struct Cmd* cmd = (struct Cmd*)malloc(sizeof(struct Cmd));
-  initCmd(cmd);
-  return cmd;
-}
+/* history search (Ctrl-R) */
 
-const char* built_in_commands[] = {
-  "exit",
-  "echo",
-  "type",
-  "pwd",
-  "cd",
-  NULL
-};
+// replaces readline's linear reverse-i-search with a lookup in hist_idx
+static int hist_search_key(int count, int key) {
+    (void)count;
+    (void)key;
 
-/* string manipulation utilities */
+    char query[MAX_STR_ALLOC] = {0};
+    size_t qlen = 0;
+    struct hist_match matches[HIST_SEARCH_RESULTS];
+    size_t nmatch = 0;
+    size_t pick = 0;
 
-int isDelimiter(char ch) {
-    if (ch == ' ')
-        return ch;
-    return 0;
-}
-
-static void setToken(struct Token* token, const char* token_str) {
-    if ((!strcmp(token_str, "1>")) || (!strcmp(token_str, ">"))) {
-        token->tok_type = TOK_REDIR;
-        token->fd = 1;
-        token->rd_type = R_OUT;
-        return;
-    }
-    if ((!strcmp(token_str, ">>")) || (!strcmp(token_str, "1>>"))) {
-        token->tok_type = TOK_REDIR;
-        token->fd = 1;
-        token->rd_type = R_OUT_APPEND;
-        return;
-    }
-    if ((!strcmp(token_str, "2>"))) {
-        token->tok_type = TOK_REDIR;
-        token->fd = 2;
-        token->rd_type = R_ERR;
-        return;
+    char* saved_line = strdup(*rl.line_buffer);
+    char* saved_prompt = strdup(*rl.prompt ? *rl.prompt : "");
+    if (!saved_line || !saved_prompt) {
+        free(saved_line);
+        free(saved_prompt);
+        return 0;
     }
-    if ((!strcmp(token_str, "2>>"))) {
-        token->tok_type = TOK_REDIR;
-        token->fd = 2;
-        token->rd_type = R_ERR_APPEND;
-        return;
-    }
-    token->tok_type = TOK_WORD;
-    token->fd = -1;
-    token->rd_type = R_NONE;
-}
-
-static int push_token(struct TokenList* toklist, struct arena* a,
-                      const char* token, int token_len) {
-    if (token_len <= 0) return 0;
-
-    char* mem = arena_alloc(a, (size_t)token_len + 1);
-    if (!mem) return -1;
-
-    memcpy(mem, token, (size_t)token_len);
-    mem[token_len] = '\0';
-
-    struct Token struct_token;
-    struct_token.text = mem;
-    setToken(&struct_token, mem);
-    toklist_push(toklist, a, struct_token);
-    
-    return 0;
-}
-
-static int emit_token(struct TokenList* toklist, struct arena* a, 
-                  char* token, int* token_index) {
-
-    if (*token_index == 0) return 0;
-    if (push_token(toklist, a, token, *token_index) < 0) // push_token should add '\0'
-        return -1;
-    *token_index = 0;
-    token[0] = '\0';
-    return 0;
-
-}
-
-ssize_t tokenize(struct TokenList* toklist, char* str, struct arena *a) {
-    int i = 0;
-    char token[DEFAULT_STR_ALLOC];
-    int n = 0;
 
+    for (;;) {
+        const char* hit = NULL;
+        if (pick < nmatch) hit = hist_index_line(&hist_idx, matches[pick].id);
+
+        char prompt[MAX_STR_ALLOC + 32];
+        snprintf(prompt, sizeof(prompt), "(%sreverse-i-search)`%s': ",
+                 (qlen && !hit) ? "failed " : "", query);
+        rl.set_prompt(prompt);
+        rl.replace_line(hit ? hit : saved_line, 0);
+        *rl.point = *rl.end;
+        if (hit && qlen) {
+            const char* at = strstr(hit, query);
+            if (at) *rl.point = (int)(at - hit);
+        }
+        rl.redisplay();
 
-    token[0] = '\0';
-    while (str[i] != '\0') {
-        char c = str[i];
-        // 1) whitespace: end token
-        if (c == ' ') {
-            if (emit_token(toklist, a, token, &n) < 0) return -1;
-            // skip all spaces
-            do { i++; } while (str[i] == ' ');
+        int c = rl.read_key();
+        if (c == ('r' & 0x1f)) {
+            // next older / lower ranked match
+            if (pick + 1 < nmatch) pick++;
             continue;
         }
-        // 2) single quote: read until closing quote (allow concatenated quotes)
-        if (c == '\'') {
-            i++; // consume opening quote
-            for (;;) {
-                // read quoted content
-                while (str[i] != '\0' && str[i] != '\'') {
-                    if (n + 1 >= DEFAULT_STR_ALLOC) { errno = EOVERFLOW; return -1; }
-                    token[n++] = str[i++];
-                }
-                if (str[i] == '\0') { errno = EINVAL; return -1; } // unmatched quote
-                i++; // consume closing quote
-                // if next char is another quote, concatenate
-                if (str[i] == '\'') { i++; continue; }
-                // quoted segment ended
-                break;
-            }
-            // 注意：不要在這裡 emit，因為你允許 quote 後面緊接著普通字元黏在同一個 token
-            continue;
+        if (c == ('g' & 0x1f)) {
+            rl.replace_line(saved_line, 0);
+            *rl.point = *rl.end;
+            break;
         }
-        // 3) double quote: read until closing quote (allow concatenated quotes)
-        if (c == '\"') {
-            i++; // consume opening quote
-            for (;;) {
-                // read quoted content
-                while (str[i] != '\0' && str[i] != '\"') {
-                    if (n + 1 >= DEFAULT_STR_ALLOC) { errno = EOVERFLOW; return -1; }
-                    if (str[i] == '\\')
-                        if (str[i+1] == '\"' || str[i+1] == '\\') i++;
-                    token[n++] = str[i++];
-                }
-                if (str[i] == '\0') { errno = EINVAL; return -1; } // unmatched quote
-                i++; // consume closing quote
-                // if next char is another quote, concatenate
-                if (str[i] == '\"') { i++; continue; }
-                // quoted segment ended
-                break;
-            }
-            // 注意：不要在這裡 emit，因為你允許 quote 後面緊接著普通字元黏在同一個 token
-            continue;
+        if (c == 127 || c == '\b') {
+            if (qlen) query[--qlen] = '\0';
         }
-        // 4) backslash: read until closing quote (allow concatenated quotes)
-        if (c == '\\') {
-            i++;
+        else if (c >= ' ' && c < 127 && qlen + 1 < sizeof(query)) {
+            query[qlen++] = (char)c;
+            query[qlen] = '\0';
         }
-        // 5) redirect
-        if (isalpha(c)) {
-            if (str[i+1] == '>') {
-                token[n++] = c;
-                i++;
-                token[n++] = str[i++];
-                if (str[i] == '>') {
-                    token[n++] = c;
-                    token[n++] = str[i++];
-                }
-                if (emit_token(toklist, a, token, &n) < 0) return -1;
-            }
+        else {
+            // any other key ends the search and is handled by readline as usual
+            rl.execute_next(c);
+            break;
         }
-        // 6) normal char
-        if (n + 1 >= DEFAULT_STR_ALLOC) { errno = EOVERFLOW; return -1; }
-        token[n++] = str[i++];
+        nmatch = hist_index_search(&hist_idx, query, matches, HIST_SEARCH_RESULTS);
+        pick = 0;
     }
-    // end of input: emit last token
-    if (emit_token(toklist, a, token, &n) < 0) return -1;
-    return 0;
-}
-
-static void printTokenType(enum TokenType tok_type) {
-    if (tok_type == TOK_WORD) printf("WORD");
-    if (tok_type == TOK_REDIR) printf("REDIR");
-    if (tok_type == TOK_PIPE) printf("PIPE");
-    if (tok_type == TOK_NONE) printf("NONE");
-}
 
-static void printRedirType(enum RedirType rd_type) {
-    if (rd_type == R_IN) printf("R_IN");
-    if (rd_type == R_OUT) printf("R_OUT");
-    if (rd_type == R_OUT_APPEND) printf("R_OUT_APPEND");
-    if (rd_type == R_ERR) printf("R_ERR");
-    if (rd_type == R_ERR_APPEND) printf("R_ERR_APPEND");
-    if (rd_type == R_NONE) printf("R_NONE");
-}
-
-void print_toklist(struct TokenList* toklist) {
-    size_t num_tokens = toklist->ntoks;
-
-    printf("number of tokens: %zu\n", toklist->ntoks);
-    printf("toklist token caps: %zu\n", toklist->tok_cap);
-
-    for ( size_t i = 0 ; i < num_tokens ; ++i ) {
-        struct Token token = toklist->tokens[i];
-        printTokenType(token.tok_type);
-        printf("{ (%s), fd: %d, ", token.text, token.fd);
-        printRedirType(token.rd_type);
-        printf("}\n");
-    }
-
-}
-
-int push_argv(struct Cmd* cmd, struct arena* a, char* text) {
-    if (cmd->argc + 1 >= cmd->cap ) {
-        if (cmdArgvGrow(cmd, a) < 0) return -1;
-    }
-    cmd->argv[cmd->argc++] = text;
-    cmd->argv[cmd->argc] = NULL;
+    rl.set_prompt(saved_prompt);
+    rl.redisplay();
+    free(saved_line);
+    free(saved_prompt);
     return 0;
 }
 
-/*
-enum RedirType {
-    R_IN, R_OUT, R_OUT_APPEND,
-    R_ERR, R_ERR_APPEND, R_NONE
-};
-
-struct Redir {
-    int fd;
-    enum RedirType rd_type;
-    const char* path;
-};
-
-enum TokenType {
-    TOK_WORD, TOK_REDIR,
-    TOK_PIPE, TOK_NONE
-};
+/* autocompletion */
 
-struct Token {
-    enum TokenType tok_type;
-    enum RedirType rd_type;
-    int fd;
-    char* text;
+// names from the PATH index for one completion, handed out by cmd_gen
+struct name_list {
+    char** names;
+    size_t n, cap, next;
 };
-*/
-
-static int parse_toklist(struct Cmd* cmd, struct TokenList* toklist, struct arena* a) {
-    for ( size_t i = 0 ; i < toklist->ntoks ; ++i ) {
-        struct Token current_token = toklist->tokens[i];
-        if (current_token.tok_type == TOK_WORD) {
-            if (cmd->argc + 1 >= cmd->cap)
-                if (cmdArgvGrow(cmd, a) < 0) return -1;
-            cmd->argv[cmd->argc++] = current_token.text;
-        }
-        else if (current_token.tok_type == TOK_REDIR) {
-            if (cmd->nrds >= cmd->rd_cap)
-                if (cmdRedirGrow(cmd, a) < 0) return -1;
-            cmd->rds[cmd->nrds].fd = current_token.fd;
-            cmd->rds[cmd->nrds].rd_type = current_token.rd_type;
-            i++;
-            struct Token next_token = toklist->tokens[i];
-            if (next_token.tok_type != TOK_WORD) {
-                // temporarily print out error message
-                printf("A WORD should be right after REDIRECT operator\n");
-                return -1;
-            }
-            cmd->rds[cmd->nrds++].path = next_token.text;
-        }
-    }
-    return 0;
-}
-
-static void chomp_newline(char *s) {
-  if (!s) return;
-  size_t n = strlen(s);
-  if (n && s[n-1] == '\n') s[n-1] = '\0';
-}
-
-// ssize_t getline(char **lineptr, size_t *n, FILE *stream); POSIX getline signature
-// lineptr: actual memory to store string
-// n: buffer max capacity
-// stream: valid stream
-
-// return read character
-ssize_t my_getline(char **lineptr, size_t *n, FILE *stream) {
-
-  if (!lineptr || !n || !stream) {
-    errno = EINVAL;
-    return -1;
-  }
-
-  if (*lineptr == NULL || *n == 0) {
-    *lineptr = (char*)malloc(DEFAULT_STR_ALLOC);
-    *n = DEFAULT_STR_ALLOC;
-  }
-
-  int c = 0;
-  size_t num_char = 0;
-  while ((c = fgetc(stream)) != EOF) {
-    if (num_char + 1 >= *n) {
-      size_t new_cap = (*n <= (MAX_STR_ALLOC / 2)) ? (*n * 2) : MAX_STR_ALLOC;
-      if (new_cap <= *n) {
-        errno = ENOMEM;
-        return -1;
-      }
-      char* temp = realloc(*lineptr, new_cap * sizeof(char*));
-      if (temp == NULL) {
-        errno = ENOMEM;
-        return -1;
-      }
-      (*lineptr) = temp;
-      *n = new_cap;
-    }
-
-    (*lineptr)[num_char++] = (char) c;
-
-    if (c == '\n') {
-      break;
-    }
-  }
-
-  if (num_char == 0 && c == EOF) {
-    return -1;
-  }
-
-  (*lineptr)[num_char] = '\0';
-  return num_char;
-
-}
-
-char* readCommand() {
-  // ssize_t r = my_getline(&cmd, &cap, stream);
-  // ssize_t r = getline(&cmd, &cap, stream);
-  char* line = readline("$ ");
-  if (!line) {
-    return NULL;
-  }
-  if (*line) add_history(line);
-  return line; // caller frees
-}
-
-/* command verifications */
-
-int isValidCommand(char* cmd) {
-  int rt = 0;
-  for ( int i = 0 ; i < NUM_COMMAND ; i++ ) {
-    if (strcmp(cmd, built_in_commands[i]) == 0) {
-      rt = 1;
-    }
-  }
-  return rt;
-}
-
-int isBuiltinCommand(char* cmd) {
-  int rt = 0;
-  for ( int i = 0 ; i < NUM_COMMAND ; i++ ) {
-    if (strcmp(cmd, built_in_commands[i]) == 0) {
-      rt = 1;
-    }
-  }
-  return rt;
-}
-
-int isExit(char* cmd) {
-  if (strcmp(cmd, "exit") == 0) {
-    return 1;
-  }
-  return 0;
-}
-
-int isEcho(char* cmd) {
-  if (strcmp(cmd, "echo") == 0) {
-    return 1;
-  }
-  return 0;
-}
-
-int isType(char* cmd) {
-  if (strcmp(cmd, "type") == 0) {
-    return 1;
-  }
-  return 0;
-}
-
-int isPwd(char* cmd) {
-  if (strcmp(cmd, "pwd") == 0) {
-    return 1;
-  }
-  return 0;
-}
-
-int isCd(char* cmd) {
-  if (strcmp(cmd, "cd") == 0) {
-    return 1;
-  }
-  return 0;
-}
-
-/* critical functions */
-char* find_path_executable(char* path, char* type_arg) {
-    char* save = NULL;
-    char* rt = NULL;
-    for ( char* dir = strtok_r(path, ":", &save) ;
-          dir ;
-          dir = strtok_r(NULL, ":", &save)) {
-
-        char full_path[PATH_MAX] = {0};
-        snprintf(full_path, sizeof(full_path), "%s/%s", dir, type_arg);
-        
-        if (access(full_path, X_OK) == 0) {
-            rt = strdup(full_path); 
-            free(path);
-            return rt;
-        }
-    }
-    free(path);
-    return NULL;
-}
 
-static int open_for_redir(const struct Redir* r) {
-    int flags = 0;
-    mode_t mode = 0644;
-    switch (r->rd_type) {
-        case R_IN:
-            flags = O_RDONLY;
-            break;
-        case R_OUT:
-            flags = O_WRONLY | O_CREAT | O_TRUNC;
-            break;
-        case R_OUT_APPEND:
-            flags = O_WRONLY | O_CREAT | O_APPEND;
-            break;
-        case R_ERR:
-            flags = O_WRONLY | O_CREAT | O_TRUNC;
-            break;
-        case R_ERR_APPEND:
-            flags = O_WRONLY | O_CREAT | O_APPEND;
-            break;
-        default:
-            errno = EINVAL;
-            return -1;
-    }
-    return open(r->path, flags, mode);
-}
-
-int run_process(struct Cmd* cmd) {
-    pid_t pid = fork();
-    // child
-    if (pid == 0) {
-        for ( size_t i = 0 ; i < cmd->nrds ; ++i ) {
-            int new_fd = open_for_redir(&cmd->rds[i]);
-            if (new_fd < 0) {
-                perror("open");
-                _exit(1);
-            }
-            // dup2(src, dst): 把 new_fd 複製到「要被重導向的 fd」
-            if (dup2(new_fd, cmd->rds[i].fd) < 0) {
-                perror("dup2");
-                _exit(1);
-            }
-            close(new_fd);
-        }
-        execvp(cmd->argv[0], cmd->argv);
-        perror("execvp");
-        _exit(127);
-    }
-    // parent
-    else if (pid > 0) {
-        int status;
-        waitpid(pid, &status, 0);
+static void name_list_add(const char* name, void* arg) {
+    struct name_list* l = arg;
+    if (name[0] == '.') return; // hidden, as in the readdir scan below
+    if (l->n == l->cap) {
+        size_t cap = l->cap ? l->cap * 2 : 64;
+        char** names = realloc(l->names, cap * sizeof(*names));
+        if (!names) return;
+        l->names = names;
+        l->cap = cap;
     }
-    else {
-        perror("fork");
-        return -1;
-    }
-    return 0;
+    char* copy = strdup(name);
+    if (copy) l->names[l->n++] = copy;
 }
 
-int changeDir(char* destDir) {
-
-    if (strcmp(destDir, "~") == 0) {
-        destDir = getenv("HOME");
-        destDir = strdup(destDir);
-    }
-
-    if (chdir(destDir) == -1) {
-        // perror("cd");
-        return -1;
-    }
-    return 0;
+static void name_list_clear(struct name_list* l) {
+    for ( size_t k = 0 ; k < l->n ; ++k ) free(l->names[k]);
+    l->n = l->next = 0;
 }
 
-/* autocompletion */
 static char* cmd_gen(const char* text, int state) {
     static int i;
     static size_t len;
@@ -657,6 +150,8 @@ static char* cmd_gen(const char* text, int state) {
     static char* save = NULL;
     static char* dir;
     static DIR* dp;
+    static struct name_list indexed;
+    static int use_index;
 
     // if initial state
     if (state == 0) {
@@ -667,13 +162,22 @@ static char* cmd_gen(const char* text, int state) {
         path_copy = NULL;
         save = NULL;
         dir = NULL;
-        const char* p = getenv("PATH");
+        const char* p = vars_get(&shell_vars, "PATH");
         if (p) path_copy = strdup(p);
+        name_list_clear(&indexed);
+        use_index = p && pidx_each_prefix(p, text, name_list_add, &indexed) == 0;
     }
     while (built_in_commands[i]) {
         const char* s = built_in_commands[i++];
         if (strncmp(s, text, len) == 0) return strdup(s);
     }
+    if (use_index) {
+        // readline takes ownership of what we return
+        if (indexed.next == indexed.n) return NULL;
+        char* s = indexed.names[indexed.next];
+        indexed.names[indexed.next++] = NULL;
+        return s;
+    }
     while (1) {
 
         if (!path_copy) return NULL;
@@ -707,141 +211,275 @@ static char* cmd_gen(const char* text, int state) {
 static char** my_completion(const char* text, int start, int end) {
     (void)end;
     if (start == 0) {
-        return rl_completion_matches(text, cmd_gen);
+        return rl.completion_matches(text, cmd_gen);
     }
     return NULL;
 }
 
-/* main */
-
-int main() {
-  // Flush after every printf
-  setbuf(stdout, NULL);
+/* input */
 
-  rl_bind_key('\t', rl_complete);
-  rl_attempted_completion_function = my_completion;
+struct input {
+    struct line_reader lr; // script, piped stdin, or a terminal without readline
+    int interactive;       // prompt before every line
+    char* rl_line;         // last line from readline, freed by the next call
+};
 
-  struct arena a;
-  arena_init(&a);
+// the next line without its newline, valid until the following call
+static char* next_line(struct input* in, int continuation, size_t* len) {
+    if (in->interactive) {
+        const char* ps = vars_get(&shell_vars, continuation ? "PS2" : "PS1");
+        if (!ps) ps = continuation ? "> " : "$ ";
+        const char* prompt = prompt_render(ps, exec_last_status());
+        if (rl.loaded) {
+            free(in->rl_line);
+            in->rl_line = readCommand(prompt);
+            if (in->rl_line) *len = strlen(in->rl_line);
+            return in->rl_line;
+        }
+        fputs(prompt, stdout);
+    }
+    errno = 0;
+    char* line = lr_next(&in->lr, len);
+    if (!line && errno) perror("read");
+    return line;
+}
+
+// appends line to the continuation buffer, after a newline unless it is empty
+static int join_line(char** buf, size_t* len, size_t* cap, const char* line, size_t n) {
+    size_t need = *len + n + 2;
+    if (need > *cap) {
+        size_t new_cap = *cap ? *cap : DEFAULT_STR_ALLOC;
+        while (new_cap < need) new_cap *= 2;
+        char* p = realloc(*buf, new_cap);
+        if (!p) return -1;
+        *buf = p;
+        *cap = new_cap;
+    }
+    if (*len) (*buf)[(*len)++] = '\n';
+    memcpy(*buf + *len, line, n);
+    *len += n;
+    (*buf)[*len] = '\0';
+    return 0;
+}
 
-  // TODO: Uncomment the code below to pass the first stage
-  while (1) {
-    // printf("$ ");
-
-    char* cmd_str = readCommand();
-    if (!cmd_str) return 0;
-    chomp_newline(cmd_str);
-    struct Cmd cmd;
-    initCmd(&cmd);
-    initCmdArgv(&cmd, &a);
-    initCmdRedir(&cmd, &a);
-    struct TokenList toklist;
-    toklist_init(&toklist);
-    tokenize(&toklist, cmd_str, &a);
+// compiles text through the command cache. Returns PARSE_INCOMPLETE when
+// text ends inside a quote or compound command.
+static int compile_text(const char* text, struct arena* a, struct Node** out) {
+    struct Node* node = cmd_cache_get(&cmd_cache, text);
+    if (!node) {
+        struct TokenList toklist;
+        toklist_init(&toklist);
+        int rc = (int)tokenize(&toklist, text, a);
+        if (rc == PARSE_INCOMPLETE) {
+            arena_reset(a);
+            return rc;
+        }
+        if (rc < 0) {
+            perror("tokenize");
+            arena_reset(a);
+            return -1;
+        }
 
 #ifdef TOKENIZER_DEBUG
-    print_toklist(&toklist);
-    free(cmd_str);
-    arena_destroy(&a);
-    return 0;
+        print_toklist(&toklist);
 #endif
 
-    parse_toklist(&cmd, &toklist, &a);
-
-    /*TODO:
-    1. check toklist implementation works or not
-    2. add tokenizer to handle redirect operator
-    3. add parser layer to interpret toklist(Token layer)
-    4. hook up parser result to cmd
-    */
+        struct arena* tree_arena = cmd_cache_begin(&cmd_cache);
+        rc = parse_program(&toklist, tree_arena, &node);
+        arena_reset(a);
+        if (rc < 0) {
+            cmd_cache_abort(&cmd_cache);
+            return rc;
+        }
+        cmd_cache_put(&cmd_cache, text, node);
+    }
+    *out = node;
+    return 0;
+}
 
-    char* exe_name = cmd.argv[0];
+// compiles text through the command cache and runs it. Returns
+// PARSE_INCOMPLETE when text ends inside a quote or compound command.
+// last: no input follows, the shell exits after text (see exec_node_last)
+static int run_text(const char* text, struct arena* a, int last) {
+    struct Node* node;
+    int rc = compile_text(text, a, &node);
+    if (rc < 0) return rc;
+    if (last) exec_node_last(node, a);
+    else exec_node(node, a);
+    arena_reset(a);
+    return 0;
+}
 
-    /* get PATH */
-    char* path = getenv("PATH");
-    if (!path) {
-        errno = EINVAL;
-        return -1;
+// a -c string or a --server request: the whole input in one piece, after
+// which the process exits with the returned status
+static int run_command_string(const char* text, struct arena* a) {
+    int rc = run_text(text, a, 1);
+    if (rc == PARSE_INCOMPLETE) {
+        fprintf(stderr, "syntax error: unexpected end of file\n");
+    }
+    return rc < 0 ? 2 : exec_exit_code();
+}
+
+// the command a line starts with, if it is a plain word (nothing to expand)
+static const char* first_command(const struct Node* n) {
+    while (n) {
+        switch (n->type) {
+            case N_SEQ: case N_AND: case N_OR: n = n->bin.left; break;
+            case N_PIPE: n = n->pipe.nstages ? n->pipe.stages[0] : NULL; break;
+            case N_NOT: case N_GROUP: case N_SUBSHELL: n = n->child; break;
+            case N_REDIR: n = n->redir.body; break;
+            case N_CMD: {
+                if (n->cmd.argc == 0) return NULL;
+                const char* w = n->cmd.argv[0];
+                return w[strspn(w, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_.+-")]
+                           ? NULL : w;
+            }
+            default: return NULL;
+        }
     }
+    return NULL;
+}
 
-    if (!isBuiltinCommand(exe_name)) {
-        // check if PATH can find that executable
+// a --server request before it is forked off (see server.h): the parse
+// lands in the server's command cache, the lookup in the path index
+static int prime_command_string(const char* text, struct arena* a) {
+    struct Node* node;
+    int rc = compile_text(text, a, &node);
+    if (rc == PARSE_INCOMPLETE) {
+        fprintf(stderr, "syntax error: unexpected end of file\n");
+    }
+    if (rc < 0) return 2;
+    const char* name = first_command(node);
+    const char* path = vars_get(&shell_vars, "PATH");
+    if (name && path && !isBuiltinCommand((char*)name)) {
         char* path_copy = strdup(path);
-        if (!path_copy) {
-            errno = ENOMEM;
-            return -1;
-        }
-        char* full_path = find_path_executable(path_copy, exe_name);
-        if (full_path) {
-            run_process(&cmd); 
-            free(full_path);
-        }
-        else {
-            printf("%s: command not found\n", cmd_str);
-        }
+        if (path_copy) free(find_path_executable(path_copy, (char*)name));
     }
-    else {
-      if (isExit(exe_name)) {
-        free(cmd_str);
-        break;
-      }
-      else if (isEcho(exe_name)) {
-        run_process(&cmd);
-        /*
-        for ( size_t num_arg = 1 ; num_arg < cmd.argc-1 ; num_arg++ ) {
-          printf("%s ", cmd.argv[num_arg]);
-        }
-        printf("%s\n", cmd.argv[cmd.argc-1]);
-        */
-      }
-      else if (isType(exe_name)) {
-        char* type_arg = cmd.argv[1];
-        if (cmd.argc >= 2) {
-          if (isBuiltinCommand(type_arg)) {
-            printf("%s is a shell builtin\n", type_arg);
-          }
-          else {
-            // try to parse PATH and find executable
-            char* path = getenv("PATH");
-            if (!path) {
-                errno = EINVAL;
-                return -1;
-            }
-            char* path_copy = strdup(path);
-            if (!path_copy) {
-                errno = ENOMEM;
-                return -1;
-            }
-            char* full_path = find_path_executable(path_copy, type_arg);
-            if (full_path) {
-                printf("%s is %s\n", type_arg, full_path);
-            }
-            else if (!isValidCommand(type_arg)) {
-                printf("%s: not found\n", type_arg);
-            }
-          }
+    return 0;
+}
+
+// reads complete commands (joining continuation lines) until EOF or exit.
+// A complete line runs straight from the reader's buffer.
+static void run_input(struct input* in, struct arena* a) {
+    char* buf = NULL;
+    size_t blen = 0;
+    size_t bcap = 0;
+    int pending = 0;
+    while (!exec_exit_requested()) {
+        size_t len;
+        char* line = next_line(in, pending, &len);
+        if (!line) {
+            if (pending) fprintf(stderr, "syntax error: unexpected end of file\n");
+            break;
         }
-      }
-      else if (isPwd(exe_name)) {
-        char cwd[PATH_MAX];
-        if (getcwd(cwd, sizeof(cwd)) == NULL) {
-            perror("getcwd");
-            return -1;
+        if (!pending) blen = 0;
+        if (pending && join_line(&buf, &blen, &bcap, line, len) < 0) {
+            perror("realloc");
+            break;
         }
-        printf("%s\n", cwd);
-      }
-      else if (isCd(exe_name)) {
-        // currently suppose argc == 2
-        if (changeDir(cmd.argv[1]) == -1) {
-            printf("cd: %s: No such file or directory\n", cmd.argv[1]);
+
+        int last = !in->interactive && lr_at_end(&in->lr);
+        if (run_text(pending ? buf : line, a, last) == PARSE_INCOMPLETE) {
+            if (!pending && join_line(&buf, &blen, &bcap, line, len) < 0) {
+                perror("realloc");
+                break;
+            }
+            pending = 1;
+            continue;
         }
-      }
+        pending = 0;
     }
-    arena_reset(&a);
-    free(cmd_str);
+    free(buf);
+}
+
+/* main */
+
+int main(int argc, char** argv) {
+  // Flush after every printf
+  setbuf(stdout, NULL);
+
+  // before anything else is loaded or allocated, see zygote.h
+  const char* zygote = getenv(ZYGOTE_ENV);
+  if (zygote && *zygote && strcmp(zygote, "0") != 0 && zygote_start() < 0) {
+    perror("zygote");
   }
-  arena_destroy(&a);
 
-  return 0;
-}
+  const char* command = NULL;
+  const char* server = NULL;
+  int script = -1;
+  if (argc >= 3 && strcmp(argv[1], "-c") == 0) {
+    command = argv[2];
+  }
+  else if (argc >= 3 && strcmp(argv[1], "--server") == 0) {
+    server = argv[2];
+  }
+  else if (argc >= 2) {
+    script = open(argv[1], O_RDONLY | O_CLOEXEC);
+    if (script < 0) {
+      perror(argv[1]);
+      return 127;
+    }
+    fd_track(script, "script");
+  }
+  // a server keeps its children's PATH lookups in the index unless told not to
+  const char* path_index = getenv(PIDX_ENV);
+  if (path_index ? *path_index && strcmp(path_index, "0") != 0 : server != NULL) pidx_enable();
+
+  if (vars_init(&shell_vars, environ) < 0) {
+    perror("vars_init");
+    return 1;
+  }
+  // $0 is the script (or the -c name operand), the rest are $1 ...
+  if (command && argc >= 4) vars_set_args(&shell_vars, argv + 3, argc - 3);
+  else if (script >= 0) vars_set_args(&shell_vars, argv + 1, argc - 1);
+  else vars_set_args(&shell_vars, argv, 1);
+  dirs_init(&dir_stack);
+
+  // stdin that is not a terminal is read like a script: no prompt, and
+  // readline is never loaded
+  struct input in = { .interactive = 0, .rl_line = NULL };
+  lr_init(&in.lr, script >= 0 ? script : STDIN_FILENO);
+  in.interactive = !command && !server && script < 0 && isatty(STDIN_FILENO);
+
+  if (in.interactive && rl_load() == 0) {
+    rl.bind_key('\t', rl.complete);
+    *rl.attempted_completion_function = my_completion;
+    rl.bind_key('r' & 0x1f, hist_search_key);
+    *rl.event_hook = prompt_event_hook;
+  }
+  hist_index_init(&hist_idx);
+
+  struct arena a;
+  arena_init(&a);
+  cmd_cache_init(&cmd_cache);
+
+  int status;
+  if (command) {
+    status = run_command_string(command, &a);
+  }
+  else if (server) {
+    server_main(server, prime_command_string, run_command_string, &a);
+    perror(server);
+    status = 1;
+  }
+  else {
+    run_input(&in, &a);
+    status = exec_exit_code();
+  }
 
+  fd_close(script);
+  lr_destroy(&in.lr);
+  free(in.rl_line);
+  arena_destroy(&a);
+  hist_index_destroy(&hist_idx);
+  cmd_cache_destroy(&cmd_cache);
+  prompt_destroy();
+  zygote_stop();
+  ev_destroy();
+  pidx_close();
+  dirs_destroy(&dir_stack);
+  vars_destroy(&shell_vars);
+  glob_cache_destroy();
+
+  return status;
+}
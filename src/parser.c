@@ -0,0 +1,925 @@
+#include "parser.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+
+/* string manipulation utilities */
+
+int isDelimiter(char ch) {
+    if (ch == ' ')
+        return ch;
+    return 0;
+}
+
+/* tokenizer: line -> slices of it */
+
+// the word being collected: a slice of the line until a piece of it turns
+// out not to follow the previous one, from then on a copy in toklist->extra
+struct word {
+    size_t start;
+    size_t len;
+    int quoted;
+    int copied;
+};
+
+static int extra_append(struct TokenList* toklist, struct arena* a, const char* s, size_t n) {
+    if (toklist->extra_len + n > toklist->extra_cap) {
+        size_t cap = toklist->extra_cap ? toklist->extra_cap : DEFAULT_STR_ALLOC;
+        while (cap < toklist->extra_len + n) cap *= 2;
+        if (cap > UINT32_MAX) { errno = EOVERFLOW; return -1; }
+        char* v = arena_alloc(a, cap);
+        if (!v) return -1;
+        if (toklist->extra_len) memcpy(v, toklist->extra, toklist->extra_len);
+        toklist->extra = v;
+        toklist->extra_cap = cap;
+    }
+    memcpy(toklist->extra + toklist->extra_len, s, n);
+    toklist->extra_len += n;
+    return 0;
+}
+
+// adds str[i, i+n) to the word
+static int word_add(struct TokenList* toklist, struct arena* a, struct word* w, size_t i, size_t n) {
+    if (!w->copied) {
+        if (w->len == 0) w->start = i;
+        if (w->start + w->len == i) {
+            w->len += n;
+            return 0;
+        }
+        // a \<newline> was dropped in between
+        size_t start = toklist->extra_len;
+        if (extra_append(toklist, a, toklist->src + w->start, w->len) < 0) return -1;
+        w->start = start;
+        w->copied = 1;
+    }
+    if (extra_append(toklist, a, toklist->src + i, n) < 0) return -1;
+    w->len += n;
+    return 0;
+}
+
+static void word_reset(struct TokenList* toklist, struct word* w) {
+    if (w->copied) toklist->extra_len = w->start; // it was the last thing appended
+    w->len = 0;
+    w->quoted = 0;
+    w->copied = 0;
+}
+
+static int emit_word(struct TokenList* toklist, struct arena* a, struct word* w) {
+    // '' and "" are real (empty) arguments
+    if (w->len == 0 && !w->quoted) return 0;
+
+    struct Token struct_token;
+    token_init(&struct_token);
+    struct_token.tok_type = TOK_WORD;
+    struct_token.off = (uint32_t)w->start;
+    struct_token.len = (uint32_t)w->len;
+    struct_token.quoted = w->quoted;
+    struct_token.copied = w->copied;
+    if (toklist_push(toklist, a, struct_token) < 0) return -1;
+
+    w->len = 0;
+    w->quoted = 0;
+    w->copied = 0;
+    return 0;
+}
+
+static int push_op(struct TokenList* toklist, struct arena* a,
+                   enum TokenType tok_type, long i, int len) {
+    struct Token struct_token;
+    token_init(&struct_token);
+    struct_token.tok_type = tok_type;
+    struct_token.off = (uint32_t)i;
+    struct_token.len = (uint32_t)len;
+    return toklist_push(toklist, a, struct_token);
+}
+
+// recognises the control operators at str[i], returns their length or 0
+static int scan_op(const char* str, long i, enum TokenType* tok_type) {
+    switch (str[i]) {
+        case '\n': *tok_type = TOK_NEWLINE; return 1;
+        case ';':  *tok_type = TOK_SEMI;    return 1;
+        case '(':  *tok_type = TOK_LPAREN;  return 1;
+        case ')':  *tok_type = TOK_RPAREN;  return 1;
+        case '&':
+            if (str[i+1] == '&') { *tok_type = TOK_AND_IF; return 2; }
+            *tok_type = TOK_AMP;
+            return 1;
+        case '|':
+            if (str[i+1] == '|') { *tok_type = TOK_OR_IF; return 2; }
+            *tok_type = TOK_PIPE;
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static int is_subst_start(const char* s, long i) {
+    return s[i] == '`' || (s[i] == '$' && s[i+1] == '(');
+}
+
+// index just past the $(...) or `...` starting at s[i], -1 if unterminated
+long subst_end(const char* s, long i) {
+    if (s[i] == '`') {
+        for ( i++ ; s[i] != '\0' ; i++ ) {
+            if (s[i] == '\\' && s[i+1] != '\0') i++;
+            else if (s[i] == '`') return i + 1;
+        }
+        return -1;
+    }
+
+    int depth = 0;
+    i += 2;
+    while (s[i] != '\0') {
+        char c = s[i];
+        if (c == '\\' && s[i+1] != '\0') {
+            i += 2;
+        }
+        else if (c == '\'') {
+            const char* q = strchr(s + i + 1, '\'');
+            if (!q) return -1;
+            i = q - s + 1;
+        }
+        else if (c == '\"') {
+            for ( i++ ; s[i] != '\0' && s[i] != '\"' ; ) {
+                if (s[i] == '\\' && s[i+1] != '\0') i += 2;
+                else if (is_subst_start(s, i)) {
+                    i = subst_end(s, i);
+                    if (i < 0) return -1;
+                }
+                else i++;
+            }
+            if (s[i] == '\0') return -1;
+            i++;
+        }
+        else if (is_subst_start(s, i)) {
+            i = subst_end(s, i);
+            if (i < 0) return -1;
+        }
+        else {
+            if (c == '(') depth++;
+            else if (c == ')' && depth-- == 0) return i + 1;
+            i++;
+        }
+    }
+    return -1;
+}
+
+// a << whose body starts after the next newline
+struct heredoc {
+    size_t tok;     // index of the delimiter word
+    int strip_tabs; // <<-
+};
+
+// recognises the redirection operator at str[i], returns its length or 0
+static int scan_redir(const char* str, long i, enum RedirType* rd_type, int* fd) {
+    char c = str[i];
+    char c1 = str[i+1];
+    if (c == '&' && c1 == '>') {
+        *fd = 1;
+        if (str[i+2] == '>') { *rd_type = R_OUT_BOTH_APPEND; return 3; }
+        *rd_type = R_OUT_BOTH;
+        return 2;
+    }
+    if (c == '<') {
+        *fd = 0;
+        if (c1 == '<' && str[i+2] == '-') { *rd_type = R_HEREDOC; return 3; }
+        if (c1 == '<') { *rd_type = R_HEREDOC; return 2; }
+        if (c1 == '>') { *rd_type = R_RDWR;    return 2; }
+        if (c1 == '&') { *rd_type = R_DUP_IN;  return 2; }
+        *rd_type = R_IN;
+        return 1;
+    }
+    if (c == '>') {
+        *fd = 1;
+        if (c1 == '>') { *rd_type = R_OUT_APPEND; return 2; }
+        if (c1 == '&') { *rd_type = R_DUP_OUT;    return 2; }
+        if (c1 == '|') { *rd_type = R_OUT;        return 2; }
+        *rd_type = R_OUT;
+        return 1;
+    }
+    return 0;
+}
+
+static int push_redir(struct TokenList* toklist, struct arena* a, enum RedirType rd_type,
+                      int fd, long i, int len, struct heredoc* pending, int* npending) {
+    struct Token struct_token;
+    token_init(&struct_token);
+    struct_token.tok_type = TOK_REDIR;
+    struct_token.fd = fd;
+    struct_token.rd_type = rd_type;
+    struct_token.off = (uint32_t)i;
+    struct_token.len = (uint32_t)len;
+    if (rd_type == R_HEREDOC) {
+        if (*npending >= MAX_HEREDOCS) { errno = EOVERFLOW; return -1; }
+        struct heredoc* h = &pending[(*npending)++];
+        h->strip_tabs = (len == 3);
+        h->tok = toklist->ntoks + 1;
+    }
+    return toklist_push(toklist, a, struct_token);
+}
+
+// delimiter with quotes removed; any quoting turns off body expansion
+static char* heredoc_delim(const char* raw, size_t len, struct arena* a, int* quoted) {
+    char* d = arena_alloc(a, len + 1);
+    if (!d) return NULL;
+    size_t n = 0;
+    *quoted = 0;
+    for ( size_t i = 0 ; i < len ; ++i ) {
+        char c = raw[i];
+        if (c == '\'' || c == '"') {
+            *quoted = 1;
+            continue;
+        }
+        if (c == '\\' && i + 1 < len) {
+            *quoted = 1;
+            c = raw[++i];
+        }
+        d[n++] = c;
+    }
+    d[n] = '\0';
+    return d;
+}
+
+// str[*i] starts the line after the one holding the <<s: their bodies are
+// taken from here in order and become the text of the delimiter tokens
+static int read_heredocs(struct TokenList* toklist, struct arena* a, const char* str, long* i,
+                         struct heredoc* pending, int npending) {
+    for ( int h = 0 ; h < npending ; ++h ) {
+        if (pending[h].tok >= toklist->ntoks) continue; // parse_program reports it
+        struct Token* delim_tok = &toklist->tokens[pending[h].tok];
+        if (delim_tok->tok_type != TOK_WORD) continue;
+
+        int quoted;
+        char* delim = heredoc_delim(tok_text(toklist, delim_tok), delim_tok->len, a, &quoted);
+        if (!delim) return -1;
+        size_t dlen = strlen(delim);
+
+        // find the delimiter line first, the body is everything before it
+        long start = *i;
+        long pos = start;
+        long body_end = -1;
+        while (str[pos] != '\0') {
+            long line = pos;
+            if (pending[h].strip_tabs) while (str[line] == '\t') line++;
+            const char* nl = strchr(str + line, '\n');
+            size_t llen = nl ? (size_t)(nl - (str + line)) : strlen(str + line);
+            if (llen == dlen && strncmp(str + line, delim, dlen) == 0) {
+                body_end = pos;
+                pos = nl ? (nl - str) + 1 : line + (long)llen;
+                break;
+            }
+            if (!nl) break;
+            pos = (nl - str) + 1;
+        }
+        if (body_end < 0) { errno = EINVAL; return PARSE_INCOMPLETE; }
+
+        delim_tok->copied = 0;
+        delim_tok->off = (uint32_t)start;
+        delim_tok->len = (uint32_t)(body_end - start);
+        if (pending[h].strip_tabs) {
+            // only <<- bodies differ from the line, one copy line by line
+            size_t off = toklist->extra_len;
+            for ( long k = start ; k < body_end ; ) {
+                while (str[k] == '\t') k++;
+                long e = k;
+                while (e < body_end && str[e] != '\n') e++;
+                if (e < body_end) e++;
+                if (extra_append(toklist, a, str + k, (size_t)(e - k)) < 0) return -1;
+                k = e;
+            }
+            delim_tok->copied = 1;
+            delim_tok->off = (uint32_t)off;
+            delim_tok->len = (uint32_t)(toklist->extra_len - off);
+        }
+        if (quoted) toklist->tokens[pending[h].tok - 1].rd_type = R_HEREDOC_QUOTED;
+        *i = pos;
+    }
+    return 0;
+}
+
+// bytes that end a run of ordinary word characters
+#define WORD_SPECIAL " \t\n;&|()<>'\"\\$`"
+
+ssize_t tokenize(struct TokenList* toklist, const char* str, struct arena *a) {
+    size_t src_len = strlen(str);
+    if (src_len > UINT32_MAX) { errno = EOVERFLOW; return -1; }
+    toklist->src = str;
+    toklist->src_len = src_len;
+
+    long i = 0;
+    struct word w = { 0, 0, 0, 0 };
+    struct heredoc pending[MAX_HEREDOCS];
+    int npending = 0;
+
+    while (str[i] != '\0') {
+        char c = str[i];
+        // 1) whitespace: end token
+        if (c == ' ' || c == '\t') {
+            if (emit_word(toklist, a, &w) < 0) return -1;
+            // skip all spaces
+            do { i++; } while (str[i] == ' ' || str[i] == '\t');
+            continue;
+        }
+        // comment: only at the start of a word
+        if (c == '#' && w.len == 0 && !w.quoted) {
+            while (str[i] != '\0' && str[i] != '\n') i++;
+            continue;
+        }
+        // redirections, an unquoted word of digits right before one is its fd
+        enum RedirType rd_type;
+        int rd_fd;
+        int rd_len = scan_redir(str, i, &rd_type, &rd_fd);
+        if (rd_len) {
+            int all_digits = (w.len > 0 && w.len <= MAX_FD_DIGITS && !w.quoted && c != '&');
+            const char* digits = (w.copied ? toklist->extra : str) + w.start;
+            int fd = 0;
+            for ( size_t k = 0 ; k < w.len && all_digits ; ++k ) {
+                all_digits = isdigit((unsigned char)digits[k]);
+                fd = fd * 10 + (digits[k] - '0');
+            }
+            if (all_digits) {
+                rd_fd = fd;
+                word_reset(toklist, &w);
+            }
+            else if (emit_word(toklist, a, &w) < 0) return -1;
+            if (push_redir(toklist, a, rd_type, rd_fd, i, rd_len, pending, &npending) < 0) return -1;
+            i += rd_len;
+            continue;
+        }
+        // control operators end the current word and are tokens of their own
+        enum TokenType op_type;
+        int op_len = scan_op(str, i, &op_type);
+        if (op_len) {
+            if (emit_word(toklist, a, &w) < 0) return -1;
+            if (push_op(toklist, a, op_type, i, op_len) < 0) return -1;
+            i += op_len;
+            if (op_type == TOK_NEWLINE && npending) {
+                int rc = read_heredocs(toklist, a, str, &i, pending, npending);
+                if (rc < 0) return rc;
+                npending = 0;
+            }
+            continue;
+        }
+        long end;
+        // 2) single quote: kept in the word, quotes are removed by expand_word
+        if (c == '\'') {
+            const char* q = strchr(str + i + 1, '\'');
+            if (!q) { errno = EINVAL; return PARSE_INCOMPLETE; } // unmatched quote
+            end = q - str + 1;
+            w.quoted = 1;
+        }
+        // 3) double quote: kept as well, only \" and substitutions need skipping over
+        else if (c == '\"') {
+            end = i + 1;
+            while (str[end] != '\0' && str[end] != '\"') {
+                if (is_subst_start(str, end)) {
+                    end = subst_end(str, end);
+                    if (end < 0) { errno = EINVAL; return PARSE_INCOMPLETE; } // unterminated
+                    continue;
+                }
+                if (str[end] == '\\' && str[end+1] != '\0') end++;
+                end++;
+            }
+            if (str[end] == '\0') { errno = EINVAL; return PARSE_INCOMPLETE; } // unmatched quote
+            end++;
+            w.quoted = 1;
+        }
+        // 4) backslash: keep it with the escaped char for expand_word
+        else if (c == '\\') {
+            // trailing backslash continues on the next line
+            if (str[i+1] == '\0') { errno = EINVAL; return PARSE_INCOMPLETE; }
+            if (str[i+1] == '\n') { i += 2; continue; }
+            end = i + 2;
+            w.quoted = 1;
+        }
+        // $(...) and `...` stay part of the word, the command inside is only
+        // tokenized when the word is expanded
+        else if (is_subst_start(str, i)) {
+            end = subst_end(str, i);
+            if (end < 0) { errno = EINVAL; return PARSE_INCOMPLETE; } // unterminated
+        }
+        // 6) ordinary chars, as many as there are
+        else {
+            end = i + 1 + (long)strcspn(str + i + 1, WORD_SPECIAL);
+        }
+        if (word_add(toklist, a, &w, (size_t)i, (size_t)(end - i)) < 0) return -1;
+        i = end;
+    }
+    // end of input: emit last token
+    if (emit_word(toklist, a, &w) < 0) return -1;
+    // the bodies of these are still to come
+    if (npending) { errno = EINVAL; return PARSE_INCOMPLETE; }
+    return 0;
+}
+
+static void printTokenType(enum TokenType tok_type) {
+    if (tok_type == TOK_WORD) printf("WORD");
+    if (tok_type == TOK_REDIR) printf("REDIR");
+    if (tok_type == TOK_PIPE) printf("PIPE");
+    if (tok_type == TOK_AND_IF) printf("AND_IF");
+    if (tok_type == TOK_OR_IF) printf("OR_IF");
+    if (tok_type == TOK_SEMI) printf("SEMI");
+    if (tok_type == TOK_AMP) printf("AMP");
+    if (tok_type == TOK_NEWLINE) printf("NEWLINE");
+    if (tok_type == TOK_LPAREN) printf("LPAREN");
+    if (tok_type == TOK_RPAREN) printf("RPAREN");
+    if (tok_type == TOK_NONE) printf("NONE");
+}
+
+static void printRedirType(enum RedirType rd_type) {
+    if (rd_type == R_IN) printf("R_IN");
+    if (rd_type == R_OUT) printf("R_OUT");
+    if (rd_type == R_OUT_APPEND) printf("R_OUT_APPEND");
+    if (rd_type == R_RDWR) printf("R_RDWR");
+    if (rd_type == R_DUP_IN) printf("R_DUP_IN");
+    if (rd_type == R_DUP_OUT) printf("R_DUP_OUT");
+    if (rd_type == R_OUT_BOTH) printf("R_OUT_BOTH");
+    if (rd_type == R_OUT_BOTH_APPEND) printf("R_OUT_BOTH_APPEND");
+    if (rd_type == R_HEREDOC) printf("R_HEREDOC");
+    if (rd_type == R_HEREDOC_QUOTED) printf("R_HEREDOC_QUOTED");
+    if (rd_type == R_NONE) printf("R_NONE");
+}
+
+void print_toklist(struct TokenList* toklist) {
+    size_t num_tokens = toklist->ntoks;
+
+    printf("number of tokens: %zu\n", toklist->ntoks);
+    printf("toklist token caps: %zu\n", toklist->tok_cap);
+
+    for ( size_t i = 0 ; i < num_tokens ; ++i ) {
+        struct Token token = toklist->tokens[i];
+        printTokenType(token.tok_type);
+        if (token.tok_type == TOK_NEWLINE) printf("{ (newline), fd: %d, ", token.fd);
+        else printf("{ (%.*s), fd: %d, ", (int)token.len, tok_text(toklist, &token), token.fd);
+        printRedirType(token.rd_type);
+        printf("}\n");
+    }
+
+}
+
+
+/* parser: TokenList -> Node tree */
+
+struct Parser {
+    struct TokenList* toks;
+    size_t pos;
+    struct arena* a;
+    int err;        // syntax error already reported
+    int incomplete; // ran out of tokens inside an open construct
+    char* line;     // copy of the tokenized line in a, see word_text
+};
+
+static struct Token* peek(struct Parser* p) {
+    if (p->pos >= p->toks->ntoks) return NULL;
+    return &p->toks->tokens[p->pos];
+}
+
+static int failed(struct Parser* p) {
+    return p->err || p->incomplete;
+}
+
+static int is_keyword(const struct Parser* p, const struct Token* tok, const char* kw) {
+    if (!tok || tok->tok_type != TOK_WORD || tok->quoted) return 0;
+    size_t n = strlen(kw);
+    return tok->len == n && memcmp(tok_text(p->toks, tok), kw, n) == 0;
+}
+
+static void syntax_error(struct Parser* p, const struct Token* tok) {
+    if (failed(p)) return;
+    if (!tok || tok->tok_type == TOK_NEWLINE) {
+        fprintf(stderr, "syntax error near unexpected token `newline'\n");
+    }
+    else {
+        fprintf(stderr, "syntax error near unexpected token `%.*s'\n",
+                (int)tok->len, tok_text(p->toks, tok));
+    }
+    p->err = 1;
+}
+
+// words in the tree can't point into the tokenized line: the caller reuses
+// it and cached trees outlive it. The line is copied into the tree's arena
+// once and every word is cut out of that copy in place, which works since
+// two words are always separated by a byte no other word needs.
+static char* word_text(struct Parser* p, const struct Token* tok) {
+    const struct TokenList* toklist = p->toks;
+    if (tok->copied) {
+        char* s = arena_alloc(p->a, (size_t)tok->len + 1);
+        if (!s) return NULL;
+        memcpy(s, toklist->extra + tok->off, tok->len);
+        s[tok->len] = '\0';
+        return s;
+    }
+    if (!p->line) {
+        p->line = arena_alloc(p->a, toklist->src_len + 1);
+        if (!p->line) return NULL;
+        memcpy(p->line, toklist->src, toklist->src_len + 1);
+    }
+    p->line[tok->off + tok->len] = '\0';
+    return p->line + tok->off;
+}
+
+// consumes keyword kw, running out of input means the caller should read more
+static int expect(struct Parser* p, const char* kw) {
+    struct Token* tok = peek(p);
+    if (!tok) {
+        p->incomplete = 1;
+        return -1;
+    }
+    if (!is_keyword(p, tok, kw)) {
+        syntax_error(p, tok);
+        return -1;
+    }
+    p->pos++;
+    return 0;
+}
+
+static void skip_newlines(struct Parser* p) {
+    struct Token* tok;
+    while ((tok = peek(p)) && tok->tok_type == TOK_NEWLINE) p->pos++;
+}
+
+static int is_list_end(const struct Parser* p, const struct Token* tok) {
+    static const char* enders[] = { "then", "elif", "else", "fi", "do", "done", "}", NULL };
+    if (tok->tok_type == TOK_RPAREN) return 1;
+    for ( size_t i = 0 ; enders[i] ; ++i ) {
+        if (is_keyword(p, tok, enders[i])) return 1;
+    }
+    return 0;
+}
+
+static struct Node* new_node(struct Parser* p, enum NodeType type) {
+    struct Node* n = arena_calloc(p->a, 1, sizeof(struct Node));
+    if (!n) {
+        perror("Not enough memory at new_node");
+        p->err = 1;
+        return NULL;
+    }
+    n->type = type;
+    return n;
+}
+
+static struct Node* new_bin(struct Parser* p, enum NodeType type,
+                            struct Node* left, struct Node* right) {
+    struct Node* n = new_node(p, type);
+    if (!n) return NULL;
+    n->bin.left = left;
+    n->bin.right = right;
+    return n;
+}
+
+static struct Node* parse_list(struct Parser* p);
+static struct Node* parse_command(struct Parser* p);
+
+// a list that has to contain at least one command, e.g. the body of do ... done
+static struct Node* parse_body(struct Parser* p) {
+    struct Node* n = parse_list(p);
+    if (!n && !failed(p)) {
+        struct Token* tok = peek(p);
+        if (!tok) p->incomplete = 1;
+        else syntax_error(p, tok);
+    }
+    return n;
+}
+
+// tok is a REDIR that was just consumed, its target word comes next
+static int parse_redir(struct Parser* p, struct Cmd* cmd, struct Token* tok) {
+    struct Token* target = peek(p);
+    if (!target || target->tok_type != TOK_WORD) {
+        syntax_error(p, target);
+        return -1;
+    }
+    p->pos++;
+    if (cmd->nrds >= cmd->rd_cap)
+        if (cmdRedirGrow(cmd, p->a) < 0) {
+            p->err = 1;
+            return -1;
+        }
+    cmd->rds[cmd->nrds].fd = tok->fd;
+    cmd->rds[cmd->nrds].rd_type = tok->rd_type;
+    cmd->rds[cmd->nrds].path = word_text(p, target);
+    if (!cmd->rds[cmd->nrds++].path) {
+        p->err = 1;
+        return -1;
+    }
+    return 0;
+}
+
+// redirections after a compound command wrap it in an N_REDIR
+static struct Node* with_redirs(struct Parser* p, struct Node* body) {
+    struct Token* tok = peek(p);
+    if (!body || !tok || tok->tok_type != TOK_REDIR) return body;
+
+    struct Node* n = new_node(p, N_REDIR);
+    if (!n) return NULL;
+    n->redir.body = body;
+    struct Cmd* cmd = &n->redir.rds;
+    initCmd(cmd);
+    initCmdRedir(cmd, p->a);
+    if (!cmd->rds) {
+        p->err = 1;
+        return NULL;
+    }
+    while ((tok = peek(p)) && tok->tok_type == TOK_REDIR) {
+        p->pos++;
+        if (parse_redir(p, cmd, tok) < 0) return NULL;
+    }
+    return n;
+}
+
+static struct Node* parse_simple(struct Parser* p) {
+    struct Node* n = new_node(p, N_CMD);
+    if (!n) return NULL;
+    struct Cmd* cmd = &n->cmd;
+    initCmd(cmd);
+    initCmdArgv(cmd, p->a);
+    initCmdRedir(cmd, p->a);
+    if (!cmd->argv || !cmd->rds) {
+        p->err = 1;
+        return NULL;
+    }
+
+    struct Token* tok;
+    while ((tok = peek(p)) && (tok->tok_type == TOK_WORD || tok->tok_type == TOK_REDIR)) {
+        p->pos++;
+        if (tok->tok_type == TOK_WORD) {
+            char* text = word_text(p, tok);
+            if (!text || push_argv(cmd, p->a, text) < 0) {
+                p->err = 1;
+                return NULL;
+            }
+            continue;
+        }
+        if (parse_redir(p, cmd, tok) < 0) return NULL;
+    }
+    return n;
+}
+
+// if list then list [elif list then list]... [else list] fi
+static struct Node* parse_if(struct Parser* p) {
+    struct Node* n = new_node(p, N_IF);
+    if (!n) return NULL;
+    n->cond.cond = parse_body(p);
+    if (failed(p) || expect(p, "then") < 0) return NULL;
+    n->cond.then_part = parse_body(p);
+    if (failed(p)) return NULL;
+
+    struct Token* tok = peek(p);
+    if (is_keyword(p, tok, "elif")) {
+        p->pos++;
+        n->cond.else_part = parse_if(p);
+        return failed(p) ? NULL : n; // the nested if consumed the fi
+    }
+    if (is_keyword(p, tok, "else")) {
+        p->pos++;
+        n->cond.else_part = parse_body(p);
+        if (failed(p)) return NULL;
+    }
+    if (expect(p, "fi") < 0) return NULL;
+    return n;
+}
+
+// while/until list do list done
+static struct Node* parse_loop(struct Parser* p, enum NodeType type) {
+    struct Node* n = new_node(p, type);
+    if (!n) return NULL;
+    n->loop.cond = parse_body(p);
+    if (failed(p) || expect(p, "do") < 0) return NULL;
+    n->loop.body = parse_body(p);
+    if (failed(p) || expect(p, "done") < 0) return NULL;
+    return n;
+}
+
+// for name [in word...] ; do list done
+static struct Node* parse_for(struct Parser* p) {
+    struct Token* tok = peek(p);
+    if (!tok) {
+        p->incomplete = 1;
+        return NULL;
+    }
+    if (tok->tok_type != TOK_WORD) {
+        syntax_error(p, tok);
+        return NULL;
+    }
+    p->pos++;
+
+    struct Node* n = new_node(p, N_FOR);
+    if (!n) return NULL;
+    n->forl.var = word_text(p, tok);
+
+    // the word list reuses Cmd's argv growth
+    struct Cmd words;
+    initCmd(&words);
+    initCmdArgv(&words, p->a);
+    if (!n->forl.var || !words.argv) {
+        p->err = 1;
+        return NULL;
+    }
+
+    skip_newlines(p);
+    tok = peek(p);
+    if (is_keyword(p, tok, "in")) {
+        p->pos++;
+        while ((tok = peek(p)) && tok->tok_type == TOK_WORD) {
+            p->pos++;
+            char* text = word_text(p, tok);
+            if (!text || push_argv(&words, p->a, text) < 0) {
+                p->err = 1;
+                return NULL;
+            }
+        }
+        if (!tok) {
+            p->incomplete = 1;
+            return NULL;
+        }
+        if (tok->tok_type != TOK_SEMI && tok->tok_type != TOK_NEWLINE) {
+            syntax_error(p, tok);
+            return NULL;
+        }
+        p->pos++;
+    }
+    else if (tok && tok->tok_type == TOK_SEMI) {
+        p->pos++;
+    }
+    n->forl.words = words.argv;
+    n->forl.nwords = words.argc;
+
+    skip_newlines(p);
+    if (expect(p, "do") < 0) return NULL;
+    n->forl.body = parse_body(p);
+    if (failed(p) || expect(p, "done") < 0) return NULL;
+    return n;
+}
+
+static struct Node* parse_command(struct Parser* p) {
+    struct Token* tok = peek(p);
+    if (!tok) {
+        p->incomplete = 1;
+        return NULL;
+    }
+    if (tok->tok_type == TOK_LPAREN) {
+        p->pos++;
+        struct Node* n = new_node(p, N_SUBSHELL);
+        if (!n) return NULL;
+        n->child = parse_body(p);
+        if (failed(p)) return NULL;
+        tok = peek(p);
+        if (!tok) {
+            p->incomplete = 1;
+            return NULL;
+        }
+        if (tok->tok_type != TOK_RPAREN) {
+            syntax_error(p, tok);
+            return NULL;
+        }
+        p->pos++;
+        return with_redirs(p, n);
+    }
+    if (tok->tok_type == TOK_WORD && !tok->quoted) {
+        if (is_keyword(p, tok, "if")) { p->pos++; return with_redirs(p, parse_if(p)); }
+        if (is_keyword(p, tok, "while")) { p->pos++; return with_redirs(p, parse_loop(p, N_WHILE)); }
+        if (is_keyword(p, tok, "until")) { p->pos++; return with_redirs(p, parse_loop(p, N_UNTIL)); }
+        if (is_keyword(p, tok, "for")) { p->pos++; return with_redirs(p, parse_for(p)); }
+        if (is_keyword(p, tok, "{")) {
+            p->pos++;
+            struct Node* n = new_node(p, N_GROUP);
+            if (!n) return NULL;
+            n->child = parse_body(p);
+            if (failed(p) || expect(p, "}") < 0) return NULL;
+            return with_redirs(p, n);
+        }
+        if (is_list_end(p, tok)) {
+            syntax_error(p, tok);
+            return NULL;
+        }
+    }
+    if (tok->tok_type == TOK_WORD || tok->tok_type == TOK_REDIR) {
+        return parse_simple(p);
+    }
+    syntax_error(p, tok);
+    return NULL;
+}
+
+// [!] command [| command]...
+static struct Node* parse_pipeline(struct Parser* p) {
+    int negate = 0;
+    if (is_keyword(p, peek(p), "!")) {
+        p->pos++;
+        negate = 1;
+    }
+
+    struct Node* first = parse_command(p);
+    if (!first) return NULL;
+
+    struct Node* n = first;
+    struct Token* tok = peek(p);
+    if (tok && tok->tok_type == TOK_PIPE) {
+        // collect stages with the same doubling growth as argv
+        size_t cap = 4;
+        size_t nstages = 0;
+        struct Node** stages = arena_alloc(p->a, cap * sizeof(struct Node*));
+        if (!stages) {
+            p->err = 1;
+            return NULL;
+        }
+        stages[nstages++] = first;
+        while ((tok = peek(p)) && tok->tok_type == TOK_PIPE) {
+            p->pos++;
+            skip_newlines(p);
+            struct Node* stage = parse_command(p);
+            if (!stage) return NULL;
+            if (nstages == cap) {
+                struct Node** v = arena_alloc(p->a, 2 * cap * sizeof(struct Node*));
+                if (!v) {
+                    p->err = 1;
+                    return NULL;
+                }
+                memcpy(v, stages, cap * sizeof(struct Node*));
+                stages = v;
+                cap *= 2;
+            }
+            stages[nstages++] = stage;
+        }
+        n = new_node(p, N_PIPE);
+        if (!n) return NULL;
+        n->pipe.stages = stages;
+        n->pipe.nstages = nstages;
+    }
+
+    if (negate) {
+        struct Node* not = new_node(p, N_NOT);
+        if (!not) return NULL;
+        not->child = n;
+        n = not;
+    }
+    return n;
+}
+
+// pipeline [&& pipeline | || pipeline]...
+static struct Node* parse_and_or(struct Parser* p) {
+    struct Node* left = parse_pipeline(p);
+    if (!left) return NULL;
+
+    struct Token* tok;
+    while ((tok = peek(p)) && (tok->tok_type == TOK_AND_IF || tok->tok_type == TOK_OR_IF)) {
+        enum NodeType type = (tok->tok_type == TOK_AND_IF) ? N_AND : N_OR;
+        p->pos++;
+        skip_newlines(p);
+        struct Node* right = parse_pipeline(p);
+        if (!right) return NULL;
+        left = new_bin(p, type, left, right);
+        if (!left) return NULL;
+    }
+    return left;
+}
+
+// and_or [; and_or | newline and_or]...  stops in front of a closing keyword
+static struct Node* parse_list(struct Parser* p) {
+    struct Node* list = NULL;
+    for (;;) {
+        skip_newlines(p);
+        struct Token* tok = peek(p);
+        if (!tok || is_list_end(p, tok)) break;
+
+        struct Node* n = parse_and_or(p);
+        if (!n) return NULL;
+        list = list ? new_bin(p, N_SEQ, list, n) : n;
+        if (!list) return NULL;
+
+        tok = peek(p);
+        if (!tok) break;
+        if (tok->tok_type == TOK_SEMI || tok->tok_type == TOK_NEWLINE) {
+            p->pos++;
+            continue;
+        }
+        if (tok->tok_type == TOK_AMP) {
+            fprintf(stderr, "background jobs are not supported\n");
+            p->err = 1;
+            return NULL;
+        }
+        break;
+    }
+    return list;
+}
+
+// returns 0 and *out (NULL for an empty line), -1 on a syntax error or
+// PARSE_INCOMPLETE when more input is needed to close a construct
+int parse_program(struct TokenList* toklist, struct arena* a, struct Node** out) {
+    struct Parser p = { toklist, 0, a, 0, 0, NULL };
+    *out = NULL;
+
+    struct Node* n = parse_list(&p);
+    if (p.incomplete) return PARSE_INCOMPLETE;
+    if (p.err) return -1;
+
+    struct Token* tok = peek(&p);
+    if (tok) {
+        syntax_error(&p, tok);
+        return -1;
+    }
+    *out = n;
+    return 0;
+}
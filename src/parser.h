@@ -0,0 +1,75 @@
+#ifndef PARSER_H
+#define PARSER_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "arena.h"
+#include "cmd.h"
+
+// tokenize/parse_program ran out of input inside a quote or compound command
+#define PARSE_INCOMPLETE -2
+// here-documents started on one line
+#define MAX_HEREDOCS 16
+// longest digit word taken as the fd of a following redirection
+#define MAX_FD_DIGITS 4
+
+enum NodeType {
+    N_CMD,
+    N_PIPE,
+    N_AND,
+    N_OR,
+    N_SEQ,
+    N_NOT,
+    N_IF,
+    N_WHILE,
+    N_UNTIL,
+    N_FOR,
+    N_GROUP,
+    N_SUBSHELL,
+    N_REDIR
+};
+
+// the whole tree lives in one arena so a parsed line can be cached and
+// re-run without touching the tokenizer again
+struct Node {
+    enum NodeType type;
+    union {
+        struct Cmd cmd; // N_CMD
+        struct {
+            struct Node* left;
+            struct Node* right;
+        } bin; // N_AND, N_OR, N_SEQ
+        struct {
+            struct Node** stages;
+            size_t nstages;
+        } pipe; // N_PIPE
+        struct {
+            struct Node* cond;
+            struct Node* then_part;
+            struct Node* else_part; // NULL or another N_IF for elif
+        } cond; // N_IF
+        struct {
+            struct Node* cond;
+            struct Node* body;
+        } loop; // N_WHILE, N_UNTIL
+        struct {
+            const char* var;
+            char** words;
+            size_t nwords;
+            struct Node* body;
+        } forl; // N_FOR
+        struct {
+            struct Node* body;
+            struct Cmd rds; // argc == 0, only the redirections
+        } redir; // N_REDIR: a compound command with redirections
+        struct Node* child; // N_NOT, N_GROUP, N_SUBSHELL
+    };
+};
+
+ssize_t tokenize(struct TokenList* toklist, const char* str, struct arena* a);
+long subst_end(const char* s, long i);
+void print_toklist(struct TokenList* toklist);
+int parse_program(struct TokenList* toklist, struct arena* a, struct Node** out);
+
+#endif
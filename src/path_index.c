@@ -0,0 +1,391 @@
+#define _GNU_SOURCE // O_NOFOLLOW, faccessat on a dirfd
+#include "path_index.h"
+#include "fdtrack.h"
+#include "hash.h"
+#include "vars.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define PIDX_SIZE (PIDX_HEADER_SIZE + PIDX_SLOTS * sizeof(struct pidx_slot) + PIDX_STRINGS)
+
+_Static_assert(sizeof(struct pidx_header) <= PIDX_HEADER_SIZE, "pidx header too big");
+
+static struct {
+    int enabled;
+    char* base;            // the mapping, NULL: none for this PATH
+    char* path;            // the PATH the mapping is for
+    char* file;
+    ino_t ino;
+    uint64_t checked_gen;  // the generation last compared with the directories
+    struct timespec checked_at;
+} pidx;
+
+static struct pidx_header* header(void) {
+    return (struct pidx_header*)pidx.base;
+}
+
+static struct pidx_slot* slots(void) {
+    return (struct pidx_slot*)(pidx.base + PIDX_HEADER_SIZE);
+}
+
+static char* strings(void) {
+    return pidx.base + PIDX_HEADER_SIZE + PIDX_SLOTS * sizeof(struct pidx_slot);
+}
+
+static uint64_t load_gen(int order) {
+    return __atomic_load_n(&header()->generation, order);
+}
+
+// a string from the mapped area, NULL when off is out of range: a reader
+// may look at half-written data before its generation check fails
+static const char* string_at(uint32_t off, uint32_t len) {
+    if (off >= len || len > PIDX_STRINGS) return NULL;
+    const char* s = strings() + off;
+    return memchr(s, '\0', len - off) ? s : NULL;
+}
+
+/* PATH */
+
+// PATH's directories the way find_path_executable walks them: empty ones
+// skipped. 0 when one is relative (the result depends on the cwd) or
+// there are too many.
+static size_t split_path(char* copy, char** dirs) {
+    size_t n = 0;
+    char* save = NULL;
+    for ( char* d = strtok_r(copy, ":", &save) ; d ; d = strtok_r(NULL, ":", &save) ) {
+        if (d[0] != '/' || n == PIDX_MAX_DIRS) return 0;
+        dirs[n++] = d;
+    }
+    return n;
+}
+
+static void dir_sig(const char* dir, struct pidx_dir* out) {
+    struct stat st;
+    memset(out, 0, sizeof(*out));
+    if (stat(dir, &st) < 0) return;
+    out->dev = st.st_dev;
+    out->ino = st.st_ino;
+    out->mtime_sec = st.st_mtim.tv_sec;
+    out->mtime_nsec = st.st_mtim.tv_nsec;
+}
+
+// whether the index describes path and its directories as they are now
+static int fresh(const char* path) {
+    struct pidx_header* h = header();
+    uint64_t gen = load_gen(__ATOMIC_ACQUIRE);
+    if ((gen & 1) || gen == 0 || h->magic != PIDX_MAGIC || h->version != PIDX_VERSION || h->racy) {
+        return 0;
+    }
+    const char* built_for = string_at(h->path_off, h->strings_len);
+    if (!built_for || strcmp(built_for, path) != 0) return 0;
+
+    char* copy = strdup(path);
+    char* dirs[PIDX_MAX_DIRS];
+    size_t n = copy ? split_path(copy, dirs) : 0;
+    int ok = (n == h->ndirs);
+    for ( size_t i = 0 ; ok && i < n ; ++i ) {
+        struct pidx_dir now;
+        dir_sig(dirs[i], &now);
+        const struct pidx_dir* then = &h->dirs[i];
+        ok = now.dev == then->dev && now.ino == then->ino &&
+             now.mtime_sec == then->mtime_sec && now.mtime_nsec == then->mtime_nsec;
+    }
+    free(copy);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return ok && load_gen(__ATOMIC_RELAXED) == gen;
+}
+
+// whether generation gen of the index is a build for path, however old:
+// the file may hold another PATH's
+static int built_for(const char* path, uint64_t gen) {
+    struct pidx_header* h = header();
+    if ((gen & 1) || gen == 0 || h->magic != PIDX_MAGIC || h->version != PIDX_VERSION) return 0;
+    const char* p = string_at(h->path_off, h->strings_len);
+    int ok = p && strcmp(p, path) == 0;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return ok && load_gen(__ATOMIC_RELAXED) == gen;
+}
+
+/* building */
+
+struct builder {
+    uint32_t strings_len;
+    uint32_t nnames;
+    int overflow;
+};
+
+static uint32_t add_string(struct builder* b, const char* s) {
+    size_t n = strlen(s) + 1;
+    if (b->strings_len + n > PIDX_STRINGS) {
+        b->overflow = 1;
+        return 0;
+    }
+    uint32_t off = b->strings_len;
+    memcpy(strings() + off, s, n);
+    b->strings_len += (uint32_t)n;
+    return off;
+}
+
+// the first directory to have a name wins, like in a PATH search
+static void add_name(struct builder* b, uint32_t nslots, const char* name, uint32_t dir) {
+    size_t len = strlen(name);
+    uint64_t hash = hash_bytes(name, len);
+    struct pidx_slot* s = slots();
+    for ( uint32_t i = (uint32_t)hash & (nslots - 1) ; ; i = (i + 1) & (nslots - 1) ) {
+        if (s[i].name_off == 0) {
+            if (2 * (b->nnames + 1) > nslots) {
+                b->overflow = 1;
+                return;
+            }
+            uint32_t off = add_string(b, name);
+            if (b->overflow) return;
+            s[i] = (struct pidx_slot){ .hash = hash, .name_off = off, .dir = dir };
+            b->nnames++;
+            return;
+        }
+        if (s[i].hash == hash && strcmp(strings() + s[i].name_off, name) == 0) return;
+    }
+}
+
+// holding the lock: everything but the generation rewritten
+static void build(const char* path) {
+    struct pidx_header* h = header();
+    char* copy = strdup(path);
+    char* dirs[PIDX_MAX_DIRS];
+    size_t ndirs = copy ? split_path(copy, dirs) : 0;
+    struct timespec start;
+    clock_gettime(CLOCK_REALTIME, &start);
+
+    struct builder b = { .strings_len = 1 };
+    strings()[0] = '\0';
+    h->path_off = add_string(&b, path);
+    h->ndirs = (uint32_t)ndirs;
+    h->racy = 0;
+    h->built_at = start.tv_sec;
+    for ( size_t i = 0 ; i < ndirs ; ++i ) {
+        // before the scan: a change during it shows up as a newer mtime later
+        dir_sig(dirs[i], &h->dirs[i]);
+        h->dirs[i].name_off = add_string(&b, dirs[i]);
+        long long age = (long long)(start.tv_sec - h->dirs[i].mtime_sec) * 1000000000LL +
+                        (start.tv_nsec - h->dirs[i].mtime_nsec);
+        if (age < PIDX_RACY_NS && age > -PIDX_RACY_NS) h->racy = 1;
+    }
+    uint32_t nslots = PIDX_SLOTS;
+    memset(slots(), 0, nslots * sizeof(struct pidx_slot));
+    for ( size_t i = 0 ; i < ndirs && !b.overflow ; ++i ) {
+        int dfd = open(dirs[i], O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        DIR* dp = dfd >= 0 ? fdopendir(dfd) : NULL;
+        if (!dp) {
+            if (dfd >= 0) close(dfd);
+            continue;
+        }
+        struct dirent* ent;
+        while (!b.overflow && (ent = readdir(dp)) != NULL) {
+            // the same test find_path_executable makes
+            if (faccessat(dfd, ent->d_name, X_OK, 0) != 0) continue;
+            add_name(&b, nslots, ent->d_name, (uint32_t)i);
+        }
+        closedir(dp);
+    }
+    h->nslots = b.overflow ? 0 : nslots;
+    h->nnames = b.nnames;
+    h->strings_len = b.strings_len;
+    h->magic = PIDX_MAGIC;
+    h->version = PIDX_VERSION;
+    free(copy);
+}
+
+static void rebuild(const char* path) {
+    // flock() belongs to the open file, which forked subshells share with
+    // us: two pipeline stages would both hold it through one fd
+    int lfd = open(pidx.file, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    struct stat st;
+    if (lfd < 0) return;
+    if (fstat(lfd, &st) < 0 || st.st_ino != pidx.ino || flock(lfd, LOCK_EX) < 0) {
+        close(lfd);
+        return;
+    }
+    // someone else may have done it while we waited; another PATH that
+    // built this file recently keeps it, so two PATHs never take turns
+    // rebuilding it on every lookup
+    uint64_t cur = load_gen(__ATOMIC_RELAXED);
+    struct pidx_header* h = header();
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    int kept = !(cur & 1) && cur != 0 && h->magic == PIDX_MAGIC && h->version == PIDX_VERSION &&
+               !built_for(path, cur) && now.tv_sec - h->built_at < PIDX_KEEP_SEC;
+    if (!kept && !fresh(path)) {
+        uint64_t gen = load_gen(__ATOMIC_RELAXED);
+        gen += (gen & 1) ? 2 : 1; // odd: a build died half way
+        __atomic_store_n(&header()->generation, gen, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        build(path);
+        __atomic_store_n(&header()->generation, gen + 1, __ATOMIC_RELEASE);
+    }
+    close(lfd);
+}
+
+/* mapping */
+
+void pidx_enable(void) {
+    pidx.enabled = 1;
+}
+
+void pidx_close(void) {
+    if (pidx.base) munmap(pidx.base, PIDX_SIZE);
+    free(pidx.path);
+    free(pidx.file);
+    pidx.base = NULL;
+    pidx.path = NULL;
+    pidx.file = NULL;
+}
+
+// maps the index for path. A failure, or a PATH split_path refuses, is
+// remembered until PATH changes: lookups scan PATH themselves then.
+static void map_for(const char* path) {
+    pidx_close();
+    pidx.path = strdup(path);
+    pidx.checked_gen = 1; // odd: never checked, a new file (generation 0) included
+    char* copy = strdup(path);
+    char* dirs[PIDX_MAX_DIRS];
+    size_t ndirs = copy ? split_path(copy, dirs) : 0;
+    free(copy);
+    if (ndirs == 0) return;
+    const char* dir = vars_get(&shell_vars, "XDG_RUNTIME_DIR");
+    if (!dir || !*dir) dir = "/dev/shm";
+    char file[PATH_MAX];
+    snprintf(file, sizeof(file), "%s/shell-path-%u-%u", dir, (unsigned)geteuid(),
+             (unsigned)(hash_bytes(path, strlen(path)) % PIDX_FILES));
+
+    int fd = fd_track(open(file, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0600), "path index");
+    struct stat st;
+    // /dev/shm is shared: only a file of our own is trusted
+    if (fd < 0 || fstat(fd, &st) < 0 || st.st_uid != geteuid() ||
+        (st.st_size < (off_t)PIDX_SIZE && ftruncate(fd, PIDX_SIZE) < 0)) {
+        if (fd >= 0) fd_close(fd);
+        return;
+    }
+    void* base = mmap(NULL, PIDX_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    // the mapping is all we need: a kept fd would take a number scripts use
+    fd_close(fd);
+    if (base == MAP_FAILED) return;
+    pidx.base = base;
+    pidx.file = strdup(file);
+    pidx.ino = st.st_ino;
+}
+
+static long long ms_since(const struct timespec* t) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - t->tv_sec) * 1000LL + (now.tv_nsec - t->tv_nsec) / 1000000;
+}
+
+// a mapped index that matches path, rebuilt first when the directories
+// changed (checked at most every PIDX_RECHECK_MS unless force)
+static int ready(const char* path, int force) {
+    if (!pidx.enabled) return 0;
+    if (!pidx.path || strcmp(pidx.path, path) != 0) map_for(path);
+    if (!pidx.base || !pidx.file) return 0;
+    uint64_t gen = load_gen(__ATOMIC_ACQUIRE);
+    if (!force && gen == pidx.checked_gen && ms_since(&pidx.checked_at) < PIDX_RECHECK_MS) {
+        return 1;
+    }
+    if (!fresh(path)) rebuild(path);
+    gen = load_gen(__ATOMIC_ACQUIRE);
+    if (!built_for(path, gen)) return 0;
+    pidx.checked_gen = gen;
+    clock_gettime(CLOCK_MONOTONIC, &pidx.checked_at);
+    return 1;
+}
+
+/* reading */
+
+static int lookup(const char* name, char* out, size_t outsz) {
+    struct pidx_header* h = header();
+    size_t len = strlen(name);
+    uint64_t hash = hash_bytes(name, len);
+    uint64_t gen = load_gen(__ATOMIC_ACQUIRE);
+    uint32_t nslots = h->nslots;
+    uint32_t slen = h->strings_len;
+    // a generation ready() didn't check may be another PATH's build
+    if (gen != pidx.checked_gen || nslots == 0 || nslots > PIDX_SLOTS || (nslots & (nslots - 1))) {
+        return -1;
+    }
+
+    int found = 0;
+    const struct pidx_slot* s = slots();
+    uint32_t i = (uint32_t)hash & (nslots - 1);
+    for ( uint32_t probes = 0 ; probes < nslots ; ++probes, i = (i + 1) & (nslots - 1) ) {
+        struct pidx_slot slot = s[i];
+        if (slot.name_off == 0) break;
+        if (slot.hash != hash) continue;
+        const char* n = string_at(slot.name_off, slen);
+        if (!n || strcmp(n, name) != 0) continue;
+        const char* dir = slot.dir < PIDX_MAX_DIRS ? string_at(h->dirs[slot.dir].name_off, slen) : NULL;
+        found = dir && (size_t)snprintf(out, outsz, "%s/%s", dir, name) < outsz;
+        if (!found) return -1;
+        break;
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return load_gen(__ATOMIC_RELAXED) == gen ? found : -1;
+}
+
+int pidx_lookup(const char* path, const char* name, char* out, size_t outsz) {
+    if (!ready(path, 0)) return -1;
+    int r = lookup(name, out, outsz);
+    // a miss may be a command installed since the last check
+    if (r == 0 && ready(path, 1)) r = lookup(name, out, outsz);
+    return r;
+}
+
+int pidx_each_prefix(const char* path, const char* prefix,
+                     void (*fn)(const char* name, void* arg), void* arg) {
+    if (!ready(path, 0)) return -1;
+    struct pidx_header* h = header();
+    uint64_t gen = load_gen(__ATOMIC_ACQUIRE);
+    uint32_t nslots = h->nslots;
+    uint32_t slen = h->strings_len;
+    if (gen != pidx.checked_gen || nslots == 0 || nslots > PIDX_SLOTS) return -1;
+
+    // copied out first: fn only sees names from a consistent table
+    size_t plen = strlen(prefix);
+    size_t cap = 4096, used = 0;
+    char* names = malloc(cap);
+    if (!names) return -1;
+    const struct pidx_slot* s = slots();
+    for ( uint32_t i = 0 ; i < nslots ; ++i ) {
+        const char* n = s[i].name_off ? string_at(s[i].name_off, slen) : NULL;
+        if (!n || strncmp(n, prefix, plen) != 0) continue;
+        size_t len = strlen(n) + 1;
+        if (used + len > cap) {
+            char* bigger = realloc(names, cap * 2 + len);
+            if (!bigger) {
+                free(names);
+                return -1;
+            }
+            names = bigger;
+            cap = cap * 2 + len;
+        }
+        memcpy(names + used, n, len);
+        used += len;
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (load_gen(__ATOMIC_RELAXED) != gen) {
+        free(names);
+        return -1;
+    }
+    for ( size_t off = 0 ; off < used ; off += strlen(names + off) + 1 ) fn(names + off, arg);
+    free(names);
+    return 0;
+}
@@ -0,0 +1,73 @@
+#ifndef PATH_INDEX_H
+#define PATH_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PIDX_ENV "SHELL_PATH_INDEX"  // set (and not "0") to use the shared index
+#define PIDX_MAGIC 0x70696478u
+#define PIDX_VERSION 2
+#define PIDX_MAX_DIRS 64             // longer PATHs are scanned as before
+#define PIDX_SLOTS (64u * 1024u)     // hash slots, at most half of them used
+#define PIDX_STRINGS (2u << 20)      // names and directories
+#define PIDX_HEADER_SIZE 4096
+#define PIDX_RECHECK_MS 1000         // how stale a hit may be
+#define PIDX_RACY_NS 100000000LL     // a directory changed this close to a build is rescanned
+#define PIDX_FILES 4                 // index files per user, PATHs share them by hash
+#define PIDX_KEEP_SEC 10             // another PATH's index is only taken over once this old
+
+// Every shell on a host resolves the same PATH over and over: the index
+// is a hash table of command name -> PATH directory in a file under
+// $XDG_RUNTIME_DIR (or /dev/shm) that all of them map. A user has at most
+// PIDX_FILES of them, whatever PATHs their scripts set: a PATH goes to the
+// file its hash picks, and takes it over from another PATH once that
+// one's build is PIDX_KEEP_SEC old (until then it scans PATH itself).
+// Whoever finds it stale (a PATH directory's mtime moved, or nobody
+// built it yet) rebuilds it in place under flock(); the others keep
+// scanning PATH themselves meanwhile. Readers never lock: the generation
+// is odd during a rebuild and changes with it, so a lookup that saw the
+// same even generation before and after read a consistent table.
+//
+// File layout: the header (with a signature of every PATH directory),
+// PIDX_SLOTS slots, then the string area. Offset 0 of the string area is
+// a NUL, so name_off 0 marks an empty slot.
+
+struct pidx_dir {
+    uint64_t dev;
+    uint64_t ino;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint32_t name_off;
+    uint32_t pad;
+};
+
+struct pidx_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t generation; // accessed atomically
+    uint32_t path_off;   // the PATH this was built for
+    uint32_t ndirs;
+    uint32_t nslots;     // a power of two, 0: too big to index
+    uint32_t nnames;
+    uint32_t strings_len;
+    uint32_t racy;       // a directory changed during the build
+    int64_t built_at;    // CLOCK_REALTIME seconds
+    struct pidx_dir dirs[PIDX_MAX_DIRS];
+};
+
+struct pidx_slot {
+    uint64_t hash;
+    uint32_t name_off;
+    uint32_t dir;
+};
+
+void pidx_enable(void);
+void pidx_close(void);
+// puts dir/name for the first PATH directory with an executable name into
+// out. 1: found, 0: PATH has none, -1: no usable index, scan PATH instead
+int pidx_lookup(const char* path, const char* name, char* out, size_t outsz);
+// calls fn for every indexed name starting with prefix, -1 as above
+int pidx_each_prefix(const char* path, const char* prefix,
+                     void (*fn)(const char* name, void* arg), void* arg);
+
+#endif
@@ -0,0 +1,498 @@
+#define _GNU_SOURCE // getdents64
+#include "pathglob.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* compiled patterns */
+
+static void set_bit(uint64_t* set, unsigned char c) {
+    set[c >> 6] |= 1ull << (c & 63);
+}
+
+static int has_bit(const uint64_t* set, unsigned char c) {
+    return (set[c >> 6] >> (c & 63)) & 1;
+}
+
+// s[i] is '[', fills op and returns the index past ']', or 0 if unclosed
+static size_t compile_class(struct glob_op* op, const char* s, size_t n, size_t i) {
+    memset(op->set, 0, sizeof(op->set));
+    i++;
+    int negate = 0;
+    if (i < n && (s[i] == '!' || s[i] == '^')) {
+        negate = 1;
+        i++;
+    }
+    int first = 1;
+    while (i < n && (s[i] != ']' || first)) {
+        first = 0;
+        unsigned char lo = (unsigned char)s[i];
+        if (lo == '\\' && i + 1 < n) lo = (unsigned char)s[++i];
+        i++;
+        unsigned char hi = lo;
+        if (i + 1 < n && s[i] == '-' && s[i+1] != ']') {
+            hi = (unsigned char)s[i+1];
+            if (hi == '\\' && i + 2 < n) {
+                hi = (unsigned char)s[i+2];
+                i++;
+            }
+            i += 2;
+        }
+        for ( unsigned c = lo ; c <= hi ; ++c ) set_bit(op->set, (unsigned char)c);
+    }
+    if (i >= n) return 0;
+    if (negate) {
+        for ( int k = 0 ; k < 4 ; ++k ) op->set[k] = ~op->set[k];
+    }
+    // never match the path separator
+    op->set['/' >> 6] &= ~(1ull << ('/' & 63));
+    op->type = G_CLASS;
+    return i + 1;
+}
+
+// s[0..n) uses backslash to quote metacharacters (see expand_word)
+int glob_compile(struct glob_pat* p, const char* s, size_t n, struct arena* a) {
+    memset(p, 0, sizeof(*p));
+    p->ops = arena_alloc(a, (n + 1) * sizeof(struct glob_op));
+    p->text = arena_alloc(a, n + 1);
+    if (!p->ops || !p->text) return -1;
+    p->globstar = (n == 2 && s[0] == '*' && s[1] == '*');
+
+    char* lits = p->text;
+    size_t nl = 0;
+    struct glob_op* lit = NULL;
+    size_t i = 0;
+    while (i < n) {
+        char c = s[i];
+        struct glob_op* op = &p->ops[p->nops];
+        if (c == '*' || c == '?' || c == '[') {
+            size_t next = i + 1;
+            if (c == '*') {
+                op->type = G_STAR;
+                while (next < n && s[next] == '*') next++;
+            }
+            else if (c == '?') {
+                op->type = G_ANY;
+                p->min_len++;
+            }
+            else if ((next = compile_class(op, s, n, i)) == 0) {
+                goto literal; // unclosed '[' is an ordinary character
+            }
+            else {
+                p->min_len++;
+            }
+            p->has_meta = 1;
+            p->nops++;
+            lit = NULL;
+            i = next;
+            continue;
+        }
+literal:
+        if (c == '\\' && i + 1 < n) c = s[++i];
+        i++;
+        if (!lit) {
+            lit = &p->ops[p->nops++];
+            lit->type = G_LIT;
+            lit->lit = lits + nl;
+            lit->len = 0;
+        }
+        lits[nl++] = c;
+        lit->len++;
+        p->min_len++;
+    }
+    lits[nl] = '\0';
+    p->text_len = nl;
+    p->dot_ok = p->nops && p->ops[0].type == G_LIT && p->ops[0].lit[0] == '.';
+    return 0;
+}
+
+// greedy match, backtracking only to the most recent '*': O(len) for the
+// usual *.ext patterns and never worse than O(len * nops)
+int glob_match(const struct glob_pat* p, const char* name, size_t len) {
+    if (len < p->min_len) return 0;
+    const struct glob_op* last = p->nops ? &p->ops[p->nops - 1] : NULL;
+    if (last && last->type == G_LIT &&
+        memcmp(name + len - last->len, last->lit, last->len) != 0) {
+        return 0;
+    }
+
+    size_t pi = 0;
+    size_t ni = 0;
+    size_t star_pi = SIZE_MAX;
+    size_t star_ni = 0;
+    for (;;) {
+        if (pi < p->nops) {
+            const struct glob_op* op = &p->ops[pi];
+            switch (op->type) {
+                case G_STAR:
+                    if (pi + 1 == p->nops) return 1;
+                    star_pi = pi++;
+                    star_ni = ni;
+                    continue;
+                case G_LIT:
+                    if (len - ni >= op->len && memcmp(name + ni, op->lit, op->len) == 0) {
+                        ni += op->len;
+                        pi++;
+                        continue;
+                    }
+                    break;
+                case G_ANY:
+                    if (ni < len) {
+                        ni++;
+                        pi++;
+                        continue;
+                    }
+                    break;
+                case G_CLASS:
+                    if (ni < len && has_bit(op->set, (unsigned char)name[ni])) {
+                        ni++;
+                        pi++;
+                        continue;
+                    }
+                    break;
+            }
+        }
+        else if (ni == len) {
+            return 1;
+        }
+        if (star_pi == SIZE_MAX || star_ni >= len) return 0;
+        pi = star_pi + 1;
+        ni = ++star_ni;
+    }
+}
+
+/* directory listings */
+
+struct glob_dir {
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    int stable;        // may be reused while mtime is unchanged
+    int refs;          // in use by the current walk, must not be evicted
+    int cached;        // lives in dir_cache (else freed on release)
+    uint64_t last_use;
+
+    char* names;       // NUL separated
+    size_t names_len;
+    size_t names_cap;
+    uint32_t* offs;
+    unsigned char* types;
+    size_t n;
+    size_t cap;
+};
+
+static struct glob_dir dir_cache[GLOB_DIR_CACHE];
+static uint64_t dir_clock;
+
+static void dir_free(struct glob_dir* d) {
+    free(d->names);
+    free(d->offs);
+    free(d->types);
+    memset(d, 0, sizeof(*d));
+}
+
+static int dir_push(struct glob_dir* d, const char* name, unsigned char type) {
+    size_t len = strlen(name) + 1;
+    if (d->names_len + len > d->names_cap) {
+        size_t cap = d->names_cap ? d->names_cap : 4096;
+        while (cap < d->names_len + len) cap *= 2;
+        char* v = realloc(d->names, cap);
+        if (!v) return -1;
+        d->names = v;
+        d->names_cap = cap;
+    }
+    if (d->n == d->cap) {
+        size_t cap = d->cap ? d->cap * 2 : 64;
+        uint32_t* offs = realloc(d->offs, cap * sizeof(uint32_t));
+        if (!offs) return -1;
+        d->offs = offs;
+        unsigned char* types = realloc(d->types, cap);
+        if (!types) return -1;
+        d->types = types;
+        d->cap = cap;
+    }
+    memcpy(d->names + d->names_len, name, len);
+    d->offs[d->n] = (uint32_t)d->names_len;
+    d->types[d->n] = type;
+    d->names_len += len;
+    d->n++;
+    return 0;
+}
+
+// one pass of getdents64 over the whole directory
+static int dir_read(struct glob_dir* d, int fd) {
+    char* buf = malloc(GLOB_DENTS_BUF);
+    if (!buf) return -1;
+    for (;;) {
+        ssize_t nread = getdents64(fd, buf, GLOB_DENTS_BUF);
+        if (nread < 0 && errno == EINTR) continue;
+        if (nread < 0) {
+            free(buf);
+            return -1;
+        }
+        if (nread == 0) break;
+        for ( ssize_t off = 0 ; off < nread ; ) {
+            struct dirent64* de = (struct dirent64*)(buf + off);
+            off += de->d_reclen;
+            const char* name = de->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                continue;
+            }
+            if (dir_push(d, name, de->d_type) < 0) {
+                free(buf);
+                return -1;
+            }
+        }
+    }
+    free(buf);
+    return 0;
+}
+
+static int ts_eq(struct timespec a, struct timespec b) {
+    return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+}
+
+// the listing of path ("" is the current directory), NULL if unreadable
+static struct glob_dir* dir_get(const char* path) {
+    int fd = open(*path ? path : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return NULL;
+    }
+
+    struct glob_dir* victim = NULL;
+    int same_busy = 0;
+    for ( size_t i = 0 ; i < GLOB_DIR_CACHE ; ++i ) {
+        struct glob_dir* d = &dir_cache[i];
+        if (d->cached && d->dev == st.st_dev && d->ino == st.st_ino) {
+            if (d->stable && ts_eq(d->mtime, st.st_mtim)) {
+                close(fd);
+                d->refs++;
+                d->last_use = ++dir_clock;
+                return d;
+            }
+            // stale: reread into the same slot unless the walk still uses it
+            if (d->refs) same_busy = 1;
+            else victim = d;
+            break;
+        }
+    }
+    // otherwise an empty slot, else the least recently used idle one
+    for ( size_t i = 0 ; !victim && !same_busy && i < GLOB_DIR_CACHE ; ++i ) {
+        struct glob_dir* d = &dir_cache[i];
+        if (d->refs) continue;
+        if (!d->cached) {
+            victim = d;
+            break;
+        }
+        if (!victim || d->last_use < victim->last_use) victim = d;
+    }
+
+    struct glob_dir* d = victim;
+    if (d) dir_free(d);
+    else if (!(d = calloc(1, sizeof(*d)))) {
+        close(fd);
+        return NULL;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    if (dir_read(d, fd) < 0) {
+        close(fd);
+        if (victim) dir_free(d);
+        else free(d);
+        return NULL;
+    }
+    close(fd);
+
+    long long age = (long long)(now.tv_sec - st.st_mtim.tv_sec) * 1000000000LL +
+                    (now.tv_nsec - st.st_mtim.tv_nsec);
+    d->dev = st.st_dev;
+    d->ino = st.st_ino;
+    d->mtime = st.st_mtim;
+    d->stable = age >= GLOB_STABLE_NSEC;
+    d->cached = (victim != NULL);
+    d->refs = 1;
+    d->last_use = ++dir_clock;
+    return d;
+}
+
+static void dir_release(struct glob_dir* d) {
+    d->refs--;
+    if (!d->cached) {
+        dir_free(d);
+        free(d);
+    }
+}
+
+void glob_cache_destroy(void) {
+    for ( size_t i = 0 ; i < GLOB_DIR_CACHE ; ++i ) dir_free(&dir_cache[i]);
+}
+
+/* walking */
+
+struct glob_walk {
+    struct Cmd* out;
+    struct arena* a;
+    struct glob_pat* comps;
+    size_t ncomps;
+    int want_dir; // pattern ended in '/'
+    size_t nmatches;
+    char path[PATH_MAX];
+};
+
+// w->path names the entry, type is its d_type
+static int is_dir_at(struct glob_walk* w, unsigned char type, int follow) {
+    if (type == DT_DIR) return 1;
+    if (type != DT_UNKNOWN && !(type == DT_LNK && follow)) return 0;
+    struct stat st;
+    int rc = follow ? stat(w->path, &st) : lstat(w->path, &st);
+    return rc == 0 && S_ISDIR(st.st_mode);
+}
+
+static int add_match(struct glob_walk* w, size_t len) {
+    char* s = arena_alloc(w->a, len + 1);
+    if (!s) return -1;
+    memcpy(s, w->path, len);
+    s[len] = '\0';
+    if (push_argv(w->out, w->a, s) < 0) return -1;
+    w->nmatches++;
+    return 0;
+}
+
+// appends name to the prefix, 0 if it doesn't fit in PATH_MAX
+static size_t append(struct glob_walk* w, size_t plen, const char* name, size_t len) {
+    if (plen + len + 2 > sizeof(w->path)) return 0;
+    memcpy(w->path + plen, name, len);
+    w->path[plen + len] = '\0';
+    return plen + len;
+}
+
+// path[0..plen) is empty or ends in '/'
+static int walk(struct glob_walk* w, size_t ci, size_t plen) {
+    const struct glob_pat* p = &w->comps[ci];
+    int last = (ci + 1 == w->ncomps);
+
+    if (!p->has_meta) {
+        size_t len = append(w, plen, p->text, p->text_len);
+        if (!len) return 0;
+        if (!last) {
+            w->path[len] = '/';
+            return walk(w, ci + 1, len + 1);
+        }
+        struct stat st;
+        if (lstat(w->path, &st) < 0) return 0;
+        if (w->want_dir) {
+            if (!is_dir_at(w, DT_UNKNOWN, 1)) return 0;
+            w->path[len++] = '/';
+        }
+        return add_match(w, len);
+    }
+
+    w->path[plen] = '\0';
+    struct glob_dir* d = dir_get(w->path);
+    if (!d) return 0;
+
+    int rc = 0;
+    // ** matches zero or more directories, it never follows symlinks
+    if (p->globstar && !last) {
+        rc = walk(w, ci + 1, plen);
+        for ( size_t i = 0 ; rc == 0 && i < d->n ; ++i ) {
+            const char* name = d->names + d->offs[i];
+            if (name[0] == '.') continue;
+            size_t len = append(w, plen, name, strlen(name));
+            if (!len || !is_dir_at(w, d->types[i], 0)) continue;
+            w->path[len] = '/';
+            rc = walk(w, ci, len + 1);
+        }
+        dir_release(d);
+        return rc;
+    }
+
+    for ( size_t i = 0 ; rc == 0 && i < d->n ; ++i ) {
+        const char* name = d->names + d->offs[i];
+        if (name[0] == '.' && !p->dot_ok) continue;
+        size_t nlen = (i + 1 < d->n ? d->offs[i + 1] : d->names_len) - d->offs[i] - 1;
+        if (!glob_match(p, name, nlen)) continue;
+
+        size_t len = append(w, plen, name, nlen);
+        if (!len) continue;
+        if (last) {
+            if (w->want_dir) {
+                if (!is_dir_at(w, d->types[i], 1)) continue;
+                w->path[len++] = '/';
+            }
+            rc = add_match(w, len);
+        }
+        else if (is_dir_at(w, d->types[i], 1)) {
+            w->path[len] = '/';
+            rc = walk(w, ci + 1, len + 1);
+        }
+    }
+    dir_release(d);
+    return rc;
+}
+
+static int cmp_str(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+// appends the sorted paths pattern matches to out->argv; returns how many,
+// 0 when nothing matched (or pattern has no unquoted metacharacter)
+int glob_expand(struct Cmd* out, const char* pattern, struct arena* a) {
+    size_t n = strlen(pattern);
+    struct glob_walk* w = malloc(sizeof(*w));
+    if (!w) return -1;
+    w->out = out;
+    w->a = a;
+    w->nmatches = 0;
+    w->want_dir = 0;
+    w->ncomps = 0;
+    w->comps = arena_alloc(a, (n / 2 + 1) * sizeof(struct glob_pat));
+    if (!w->comps) {
+        free(w);
+        return -1;
+    }
+
+    size_t plen = 0;
+    size_t i = 0;
+    if (pattern[0] == '/') {
+        w->path[plen++] = '/';
+        while (pattern[i] == '/') i++;
+    }
+    int any_meta = 0;
+    while (i < n) {
+        size_t start = i;
+        while (i < n && pattern[i] != '/') {
+            if (pattern[i] == '\\' && i + 1 < n) i++;
+            i++;
+        }
+        struct glob_pat* p = &w->comps[w->ncomps++];
+        if (glob_compile(p, pattern + start, i - start, a) < 0) {
+            free(w);
+            return -1;
+        }
+        any_meta |= p->has_meta;
+        while (i < n && pattern[i] == '/') i++;
+        if (i == n && pattern[n - 1] == '/') w->want_dir = 1;
+    }
+
+    int rc = 0;
+    size_t start = out->argc;
+    if (any_meta && w->ncomps) rc = walk(w, 0, plen);
+    size_t found = w->nmatches;
+    free(w);
+    if (rc < 0) return -1;
+    qsort(out->argv + start, found, sizeof(char*), cmp_str);
+    return (int)found;
+}
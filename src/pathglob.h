@@ -0,0 +1,49 @@
+#ifndef PATHGLOB_H
+#define PATHGLOB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "cmd.h"
+
+#define GLOB_DIR_CACHE 16
+#define GLOB_DENTS_BUF (64 * 1024)
+// a listing is only reused when its directory was last modified at least
+// this long before it was read, so a change within the same mtime tick
+// can never be missed
+#define GLOB_STABLE_NSEC 1000000000LL
+
+enum glob_op_type {
+    G_LIT,   // a run of literal bytes
+    G_ANY,   // ?
+    G_STAR,  // *
+    G_CLASS  // [...]
+};
+
+struct glob_op {
+    enum glob_op_type type;
+    uint32_t len;       // G_LIT
+    const char* lit;    // G_LIT
+    uint64_t set[4];    // G_CLASS, one bit per byte value
+};
+
+// one path component compiled once, then matched against every entry of a
+// directory without going through fnmatch
+struct glob_pat {
+    struct glob_op* ops;
+    size_t nops;
+    size_t min_len;   // no shorter name can match
+    int has_meta;     // 0: text is the unescaped literal component
+    int dot_ok;       // starts with a literal '.', may match hidden names
+    int globstar;     // the component is exactly **
+    char* text;
+    size_t text_len;
+};
+
+int glob_compile(struct glob_pat* p, const char* s, size_t n, struct arena* a);
+int glob_match(const struct glob_pat* p, const char* name, size_t len);
+int glob_expand(struct Cmd* out, const char* pattern, struct arena* a);
+void glob_cache_destroy(void);
+
+#endif
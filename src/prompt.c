@@ -0,0 +1,374 @@
+#define _GNU_SOURCE // pipe2
+#include "prompt.h"
+#include "dirs.h"
+#include "rl.h"
+#include "vars.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+/* worker */
+
+// the worker owns nothing but its request; results go into git_cache and
+// are picked up by the REPL thread under the same lock
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static pthread_t worker;
+static int worker_started;
+static int worker_quit;
+
+static char want_dir[PATH_MAX];  // "": nothing to do
+static char want_path[PATH_MAX]; // $PATH when the request was made
+static char** want_env;          // the exported variables then, owned by whoever takes it
+static struct git_seg git_cache[PROMPT_GIT_CACHE];
+static unsigned long git_stamp;
+static atomic_int git_ready;     // a result arrived since the last redraw
+
+// the .git directory for dir, following a "gitdir:" file in worktrees
+static int find_git_dir(const char* dir, char* out, size_t n) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s", dir);
+    for (;;) {
+        size_t len = strlen(path);
+        snprintf(out, n, "%s/.git", len > 1 ? path : "");
+        struct stat st;
+        if (stat(out, &st) == 0) {
+            if (S_ISDIR(st.st_mode)) return 0;
+            FILE* f = fopen(out, "re");
+            if (!f) return -1;
+            char line[PATH_MAX];
+            int ok = fgets(line, sizeof(line), f) && strncmp(line, "gitdir: ", 8) == 0;
+            fclose(f);
+            if (!ok) return -1;
+            line[strcspn(line, "\n")] = '\0';
+            if (line[8] == '/') snprintf(out, n, "%s", line + 8);
+            else snprintf(out, n, "%s/%s", len > 1 ? path : "", line + 8);
+            return 0;
+        }
+        char* slash = strrchr(path, '/');
+        if (!slash || len <= 1) return -1;
+        if (slash == path) slash[1] = '\0';
+        else *slash = '\0';
+    }
+}
+
+// branch name from HEAD, or the abbreviated commit when detached
+static int read_head(const char* git_dir, char* out, size_t n) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/HEAD", git_dir);
+    FILE* f = fopen(path, "re");
+    if (!f) return -1;
+    char line[256];
+    int ok = fgets(line, sizeof(line), f) != NULL;
+    fclose(f);
+    if (!ok) return -1;
+    line[strcspn(line, "\n")] = '\0';
+    if (strncmp(line, "ref: refs/heads/", 16) == 0) snprintf(out, n, "%s", line + 16);
+    else snprintf(out, n, "%.7s", line);
+    return 0;
+}
+
+// the first executable "git" on path
+static int find_git(const char* path, char* out, size_t n) {
+    const char* s = path;
+    while (*s) {
+        const char* end = strchr(s, ':');
+        size_t len = end ? (size_t)(end - s) : strlen(s);
+        snprintf(out, n, "%.*s/git", (int)len, len ? s : ".");
+        if (access(out, X_OK) == 0) return 0;
+        if (!end) break;
+        s = end + 1;
+    }
+    return -1;
+}
+
+// runs git status in dir with env: 1 when tracked files changed, 0 when
+// clean, -1 when unknown
+static int git_dirty(const char* dir, const char* path, char** env) {
+    char git[PATH_MAX];
+    if (find_git(path, git, sizeof(git)) < 0) return -1;
+
+    // not fd_track()ed: its table belongs to the REPL thread. Close-on-exec
+    // keeps the pipe out of everything exec'd meanwhile.
+    int p[2];
+    if (pipe2(p, O_CLOEXEC) < 0) return -1;
+
+    posix_spawn_file_actions_t fa;
+    posix_spawn_file_actions_init(&fa);
+    posix_spawn_file_actions_addopen(&fa, 0, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_adddup2(&fa, p[1], 1);
+    posix_spawn_file_actions_addopen(&fa, 2, "/dev/null", O_WRONLY, 0);
+    // this thread blocks every signal, git must not inherit that
+    posix_spawnattr_t attr;
+    sigset_t none;
+    sigemptyset(&none);
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setsigmask(&attr, &none);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+    char* argv[] = { "git", "--no-optional-locks", "-C", (char*)dir,
+                     "status", "--porcelain", "-uno", NULL };
+    pid_t pid;
+    int rc = posix_spawn(&pid, git, &fa, &attr, argv, env);
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&fa);
+    close(p[1]);
+    if (rc != 0) {
+        close(p[0]);
+        return -1;
+    }
+
+    char buf[4096];
+    ssize_t r;
+    size_t total = 0;
+    while ((r = read(p[0], buf, sizeof(buf))) != 0) {
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0) break;
+        total += (size_t)r;
+    }
+    close(p[0]);
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) return -1;
+    return total > 0;
+}
+
+static void compute_git(const char* dir, const char* path, char** env, char* out, size_t n) {
+    char git_dir[PATH_MAX];
+    char branch[PROMPT_GIT_MAX / 2];
+    out[0] = '\0';
+    if (find_git_dir(dir, git_dir, sizeof(git_dir)) < 0) return;
+    if (read_head(git_dir, branch, sizeof(branch)) < 0) return;
+    int dirty = git_dirty(dir, path, env);
+    snprintf(out, n, " (%s%s)", branch, dirty > 0 ? "*" : "");
+}
+
+static struct git_seg* cache_find(const char* dir) {
+    for ( int i = 0 ; i < PROMPT_GIT_CACHE ; ++i ) {
+        if (strcmp(git_cache[i].dir, dir) == 0) return &git_cache[i];
+    }
+    return NULL;
+}
+
+static void cache_store(const char* dir, const char* text) {
+    struct git_seg* e = cache_find(dir);
+    if (!e) {
+        e = &git_cache[0];
+        for ( int i = 1 ; i < PROMPT_GIT_CACHE ; ++i ) {
+            if (git_cache[i].stamp < e->stamp) e = &git_cache[i];
+        }
+        snprintf(e->dir, sizeof(e->dir), "%s", dir);
+    }
+    snprintf(e->text, sizeof(e->text), "%s", text);
+    e->stamp = ++git_stamp;
+}
+
+static void* worker_main(void* arg) {
+    (void)arg;
+    char dir[PATH_MAX];
+    char path[PATH_MAX];
+    char text[PROMPT_GIT_MAX];
+    char* no_env[] = { NULL };
+
+    pthread_mutex_lock(&lock);
+    for (;;) {
+        while (!worker_quit && want_dir[0] == '\0') pthread_cond_wait(&wake, &lock);
+        if (worker_quit) break;
+        memcpy(dir, want_dir, sizeof(dir));
+        memcpy(path, want_path, sizeof(path));
+        char** env = want_env;
+        want_env = NULL;
+        want_dir[0] = '\0';
+        pthread_mutex_unlock(&lock);
+
+        compute_git(dir, path, env ? env : no_env, text, sizeof(text));
+        free(env);
+
+        pthread_mutex_lock(&lock);
+        struct git_seg* old = cache_find(dir);
+        int changed = !old || strcmp(old->text, text) != 0;
+        cache_store(dir, text);
+        if (changed) atomic_store(&git_ready, 1);
+    }
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+// envp and its strings copied into one allocation
+static char** env_copy(char** envp) {
+    size_t count = 0, bytes = 0;
+    for ( char** e = envp ; e && *e ; ++e, ++count ) bytes += strlen(*e) + 1;
+    char** copy = malloc((count + 1) * sizeof(char*) + bytes);
+    if (!copy) return NULL;
+    char* p = (char*)(copy + count + 1);
+    for ( size_t i = 0 ; i < count ; ++i ) {
+        size_t len = strlen(envp[i]) + 1;
+        memcpy(p, envp[i], len);
+        copy[i] = p;
+        p += len;
+    }
+    copy[count] = NULL;
+    return copy;
+}
+
+// asks for dir's git segment; a newer request replaces one not yet started
+static void request_git(const char* dir) {
+    // GIT_DIR, HOME and the like as exported in the shell; copied here,
+    // since the shell's envp changes under the worker
+    char** env = env_copy(vars_envp(&shell_vars));
+    pthread_mutex_lock(&lock);
+    if (!worker_started) {
+        // signals go to the REPL thread, never to the worker
+        sigset_t all, old;
+        sigfillset(&all);
+        pthread_sigmask(SIG_SETMASK, &all, &old);
+        worker_started = pthread_create(&worker, NULL, worker_main, NULL) == 0;
+        pthread_sigmask(SIG_SETMASK, &old, NULL);
+    }
+    const char* path = vars_get(&shell_vars, "PATH");
+    snprintf(want_dir, sizeof(want_dir), "%s", dir);
+    snprintf(want_path, sizeof(want_path), "%s", path ? path : "");
+    free(want_env);
+    want_env = env;
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&lock);
+}
+
+void prompt_destroy(void) {
+    pthread_mutex_lock(&lock);
+    int started = worker_started;
+    worker_quit = 1;
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&lock);
+    if (started) pthread_join(worker, NULL);
+    worker_started = 0;
+    free(want_env);
+    want_env = NULL;
+}
+
+/* rendering */
+
+static char rendered[PROMPT_MAX];
+static char cur_tmpl[PROMPT_MAX]; // the template currently on screen
+static int cur_status;
+
+struct pbuf {
+    char* p;
+    size_t len;
+    size_t cap;
+};
+
+static void put_n(struct pbuf* b, const char* s, size_t n) {
+    if (b->len + n >= b->cap) n = b->cap - b->len - 1;
+    memcpy(b->p + b->len, s, n);
+    b->len += n;
+    b->p[b->len] = '\0';
+}
+
+static void put_s(struct pbuf* b, const char* s) {
+    put_n(b, s, strlen(s));
+}
+
+static void put_cwd(struct pbuf* b, int base_only) {
+    const char* pwd = dirs_pwd(&dir_stack);
+    if (!pwd) {
+        put_s(b, "?");
+        return;
+    }
+    if (base_only) {
+        const char* slash = strrchr(pwd, '/');
+        put_s(b, (slash && slash[1]) ? slash + 1 : pwd);
+        return;
+    }
+    const char* home = vars_get(&shell_vars, "HOME");
+    size_t hlen = home ? strlen(home) : 0;
+    if (hlen > 1 && strncmp(pwd, home, hlen) == 0 && (pwd[hlen] == '\0' || pwd[hlen] == '/')) {
+        put_s(b, "~");
+        pwd += hlen;
+    }
+    put_s(b, pwd);
+}
+
+static void put_git(struct pbuf* b, int ask) {
+    const char* pwd = dirs_pwd(&dir_stack);
+    if (!pwd) return;
+    pthread_mutex_lock(&lock);
+    struct git_seg* e = cache_find(pwd);
+    if (e) put_s(b, e->text);
+    pthread_mutex_unlock(&lock);
+    if (ask) request_git(pwd);
+}
+
+// expands tmpl into rendered; ask: start the worker on async segments
+static const char* render(const char* tmpl, int status, int ask) {
+    static char host[64];
+    struct pbuf b = { rendered, 0, sizeof(rendered) };
+    rendered[0] = '\0';
+
+    for ( const char* s = tmpl ; *s ; ++s ) {
+        if (*s != '\\' || s[1] == '\0') {
+            put_n(&b, s, 1);
+            continue;
+        }
+        char num[16];
+        const char* v;
+        switch (*++s) {
+        case 'w': put_cwd(&b, 0); break;
+        case 'W': put_cwd(&b, 1); break;
+        case 'u':
+            v = vars_get(&shell_vars, "USER");
+            put_s(&b, v ? v : "");
+            break;
+        case 'h':
+            if (!host[0] && gethostname(host, sizeof(host) - 1) == 0) host[strcspn(host, ".")] = '\0';
+            put_s(&b, host);
+            break;
+        case '?':
+            snprintf(num, sizeof(num), "%d", status);
+            put_s(&b, num);
+            break;
+        case '$': put_s(&b, geteuid() == 0 ? "#" : "$"); break;
+        case 'n': put_s(&b, "\n"); break;
+        case 'e': put_s(&b, "\033"); break;
+        case '[': put_s(&b, "\001"); break; // RL_PROMPT_START_IGNORE
+        case ']': put_s(&b, "\002"); break; // RL_PROMPT_END_IGNORE
+        case 'g': put_git(&b, ask); break;
+        default:
+            put_n(&b, s - 1, 2);
+            break;
+        }
+    }
+    return rendered;
+}
+
+// the result stays valid until the next call
+const char* prompt_render(const char* tmpl, int status) {
+    snprintf(cur_tmpl, sizeof(cur_tmpl), "%s", tmpl);
+    cur_status = status;
+    atomic_store(&git_ready, 0);
+    return render(cur_tmpl, status, 1);
+}
+
+// rl_event_hook: readline calls this while it waits for a key, redraw the
+// prompt when the worker finished a segment that is on screen
+int prompt_event_hook(void) {
+    if (!cur_tmpl[0] || !atomic_exchange(&git_ready, 0)) return 0;
+    char before[PROMPT_MAX];
+    memcpy(before, rendered, sizeof(before));
+    render(cur_tmpl, cur_status, 0);
+    if (strcmp(before, rendered) != 0) {
+        rl.set_prompt(rendered);
+        rl.redisplay();
+    }
+    return 0;
+}
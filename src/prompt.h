@@ -0,0 +1,31 @@
+#ifndef PROMPT_H
+#define PROMPT_H
+
+#include <stddef.h>
+#include <limits.h>
+
+#define PROMPT_MAX 1024
+#define PROMPT_GIT_CACHE 8   // directories whose git segment is remembered
+#define PROMPT_GIT_MAX 128
+
+// PS1/PS2 escapes:
+//   \w cwd (~ for HOME)   \W its last component   \u $USER   \h host
+//   \? last exit status   \$ # for root, else $   \n newline   \\ backslash
+//   \[ \] wrap non-printing sequences   \e escape
+//   \g " (branch)" or " (branch*)" when dirty, computed on a worker thread
+//
+// \g never blocks the prompt: it shows the last value cached for the
+// directory (or nothing) and is redrawn by prompt_event_hook once the
+// worker has the current one.
+
+struct git_seg {
+    char dir[PATH_MAX];        // "": unused slot
+    char text[PROMPT_GIT_MAX];
+    unsigned long stamp;       // for replacing the oldest
+};
+
+const char* prompt_render(const char* tmpl, int status);
+int prompt_event_hook(void);
+void prompt_destroy(void);
+
+#endif
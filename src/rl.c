@@ -0,0 +1,90 @@
+#include "rl.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#ifndef SHELL_STATIC
+#include <dlfcn.h>
+#endif
+
+struct rl_lib rl;
+
+#ifdef SHELL_STATIC
+
+#include <readline/history.h>
+
+int rl_load(void) {
+    if (rl.loaded) return 0;
+    rl.readline = readline;
+    rl.add_history = add_history;
+    rl.bind_key = rl_bind_key;
+    rl.complete = rl_complete;
+    rl.completion_matches = rl_completion_matches;
+    rl.set_prompt = rl_set_prompt;
+    rl.redisplay = rl_redisplay;
+    rl.replace_line = rl_replace_line;
+    rl.read_key = rl_read_key;
+    rl.execute_next = rl_execute_next;
+    rl.line_buffer = &rl_line_buffer;
+    rl.prompt = &rl_prompt;
+    rl.point = &rl_point;
+    rl.end = &rl_end;
+    rl.event_hook = &rl_event_hook;
+    rl.attempted_completion_function = &rl_attempted_completion_function;
+    rl.loaded = 1;
+    return 0;
+}
+
+#else
+
+static void* handle;
+
+// dlsym into a typed slot; any symbol missing fails the whole load
+static int sym(void** slot, const char* name) {
+    *slot = dlsym(handle, name);
+    return *slot ? 0 : -1;
+}
+
+int rl_load(void) {
+    if (rl.loaded) return 0;
+    static const char* const libs[] = RL_LIBS;
+    for ( size_t i = 0 ; !handle && i < sizeof(libs) / sizeof(libs[0]) ; ++i ) {
+        handle = dlopen(libs[i], RTLD_NOW | RTLD_LOCAL);
+    }
+    if (!handle) {
+        fprintf(stderr, "readline: %s\n", dlerror());
+        errno = ENOENT;
+        return -1;
+    }
+
+    int rc = 0;
+    rc |= sym((void**)&rl.readline, "readline");
+    rc |= sym((void**)&rl.add_history, "add_history");
+    rc |= sym((void**)&rl.bind_key, "rl_bind_key");
+    rc |= sym((void**)&rl.complete, "rl_complete");
+    rc |= sym((void**)&rl.completion_matches, "rl_completion_matches");
+    rc |= sym((void**)&rl.set_prompt, "rl_set_prompt");
+    rc |= sym((void**)&rl.redisplay, "rl_redisplay");
+    rc |= sym((void**)&rl.replace_line, "rl_replace_line");
+    rc |= sym((void**)&rl.read_key, "rl_read_key");
+    rc |= sym((void**)&rl.execute_next, "rl_execute_next");
+    rc |= sym((void**)&rl.line_buffer, "rl_line_buffer");
+    rc |= sym((void**)&rl.prompt, "rl_prompt");
+    rc |= sym((void**)&rl.point, "rl_point");
+    rc |= sym((void**)&rl.end, "rl_end");
+    rc |= sym((void**)&rl.event_hook, "rl_event_hook");
+    rc |= sym((void**)&rl.attempted_completion_function, "rl_attempted_completion_function");
+    if (rc < 0) {
+        fprintf(stderr, "readline: %s\n", dlerror());
+        dlclose(handle);
+        handle = NULL;
+        memset(&rl, 0, sizeof(rl));
+        errno = ENOENT;
+        return -1;
+    }
+    rl.loaded = 1;
+    return 0;
+}
+
+#endif
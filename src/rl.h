@@ -0,0 +1,39 @@
+#ifndef RL_H
+#define RL_H
+
+#include <stdio.h>
+#include <readline/readline.h>
+
+// readline (and terminfo behind it) is only needed at an interactive
+// terminal, so it is not linked in: rl_load dlopens it the first time a
+// prompt is shown, and everything else goes through these pointers.
+// A -DSHELL_STATIC build links readline and fills them in directly.
+
+#define RL_LIBS { "libreadline.so.8", "libreadline.so" }
+
+struct rl_lib {
+    int loaded;
+    char* (*readline)(const char* prompt);
+    void (*add_history)(const char* line);
+    int (*bind_key)(int key, rl_command_func_t* fn);
+    rl_command_func_t* complete;
+    char** (*completion_matches)(const char* text, rl_compentry_func_t* gen);
+    int (*set_prompt)(const char* prompt);
+    void (*redisplay)(void);
+    void (*replace_line)(const char* text, int clear_undo);
+    int (*read_key)(void);
+    int (*execute_next)(int c);
+
+    char** line_buffer;
+    char** prompt;
+    int* point;
+    int* end;
+    rl_hook_func_t** event_hook;
+    rl_completion_func_t** attempted_completion_function;
+};
+
+extern struct rl_lib rl;
+
+int rl_load(void);
+
+#endif
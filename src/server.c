@@ -0,0 +1,327 @@
+#define _GNU_SOURCE // accept4, MSG_CMSG_CLOEXEC, struct ucred
+#include "server.h"
+#include "dirs.h"
+#include "fdtrack.h"
+#include "vars.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+// a connection whose command is running
+struct client {
+    int conn;  // -1: free slot
+    int pidfd; // readable once the command's process exits
+    pid_t pid; // also its process group
+    int gone;  // the client hung up, conn is no longer watched
+};
+
+static int listen_on(const char* path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    // a socket left behind by an earlier server, never any other file
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path);
+
+    int fd = fd_track(socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0), "server socket");
+    if (fd < 0) return -1;
+    // a request runs as us: only we may connect, whatever our umask. The
+    // socket is 0600 from bind on, start_client checks the peer too.
+    mode_t mask = umask(077);
+    int rc = bind(fd, (struct sockaddr*)&addr, sizeof(addr));
+    umask(mask);
+    if (rc < 0 || listen(fd, SOMAXCONN) < 0) {
+        int err = errno;
+        fd_close(fd);
+        errno = err;
+        return -1;
+    }
+    return fd;
+}
+
+static int recv_all(int fd, char* buf, size_t n) {
+    size_t got = 0;
+    while (got < n) {
+        ssize_t r = recv(fd, buf + got, n - got, 0);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return -1;
+        got += (size_t)r;
+    }
+    return 0;
+}
+
+static void close_fds(int fds[SERVER_NFDS]) {
+    for ( int k = 0 ; k < SERVER_NFDS ; ++k ) {
+        if (fds[k] >= 0) close(fds[k]);
+        fds[k] = -1;
+    }
+}
+
+// reads one request into a malloc'd buffer, the fds it carried go to fds
+static char* read_request(int conn, int fds[SERVER_NFDS], size_t* len) {
+    struct server_req req;
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * SERVER_NFDS)];
+        struct cmsghdr align;
+    } ctl;
+    struct iovec iov = { .iov_base = &req, .iov_len = sizeof(req) };
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = ctl.buf,
+        .msg_controllen = sizeof(ctl.buf),
+    };
+
+    for ( int k = 0 ; k < SERVER_NFDS ; ++k ) fds[k] = -1;
+    ssize_t r;
+    do {
+        r = recvmsg(conn, &msg, MSG_CMSG_CLOEXEC | MSG_WAITALL);
+    } while (r < 0 && errno == EINTR);
+    if (r < 0) return NULL;
+
+    for ( struct cmsghdr* c = CMSG_FIRSTHDR(&msg) ; c ; c = CMSG_NXTHDR(&msg, c) ) {
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) continue;
+        size_t n = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        if (n > SERVER_NFDS) n = SERVER_NFDS;
+        memcpy(fds, CMSG_DATA(c), n * sizeof(int));
+    }
+
+    int ok = (r == (ssize_t)sizeof(req) && !(msg.msg_flags & MSG_CTRUNC) &&
+              req.magic == SERVER_MAGIC && req.len > 0 && req.len <= SERVER_MAX_REQ);
+    for ( int k = 0 ; k < SERVER_NFDS ; ++k ) ok = ok && fds[k] >= 0;
+    char* text = ok ? malloc(req.len + 1) : NULL;
+    if (!text || recv_all(conn, text, req.len) < 0) {
+        free(text);
+        close_fds(fds);
+        errno = EPROTO;
+        return NULL;
+    }
+    text[req.len] = '\0';
+    *len = req.len;
+    return text;
+}
+
+// the strings after the command become $0, $1 ... The array (NULL for
+// just the command: $0 stays the server's) is the caller's to free;
+// text[len] is the NUL read_request added, so the last string ends.
+static char** set_args(const char* text, size_t len) {
+    const char* end = text + len;
+    const char* first = text + strlen(text) + 1;
+    size_t n = 0;
+    for ( const char* s = first ; s < end ; s += strlen(s) + 1 ) n++;
+    if (n == 0) return NULL;
+
+    char** args = malloc(n * sizeof(char*));
+    if (!args) return NULL;
+    const char* s = first;
+    for ( size_t k = 0 ; k < n ; ++k ) {
+        args[k] = (char*)s;
+        s += strlen(s) + 1;
+    }
+    vars_set_args(&shell_vars, args, n);
+    return args;
+}
+
+// in the forked copy of the server: becomes the client's command and never
+// returns. The client's fds turn into 0-2 and its directory into ours.
+static void serve_child(int conn, const struct client* clients, int lfd,
+                        const char* text, size_t len, int fds[SERVER_NFDS], int primed,
+                        server_run_fn run, struct arena* a) {
+    // a group of its own, so a signal from the client reaches all of it
+    setpgid(0, 0);
+    fd_close(lfd);
+    for ( size_t i = 0 ; i < SERVER_MAX_CLIENTS ; ++i ) {
+        if (clients[i].conn < 0) continue;
+        fd_close(clients[i].conn);
+        fd_close(clients[i].pidfd);
+    }
+
+    // 0-2 are open in the server, so the received fds are all above them
+    for ( int k = 0 ; k < 3 ; ++k ) {
+        if (dup2(fds[k], k) < 0) _exit(2);
+        close(fds[k]);
+    }
+    int cwd_failed = fchdir(fds[3]) < 0;
+    close(fds[3]);
+    fd_close(conn);
+    if (cwd_failed) {
+        perror("server: working directory");
+        _exit(2);
+    }
+    if (primed) _exit(primed);
+
+    // the server's own PWD means nothing here
+    dirs_destroy(&dir_stack);
+    vars_unset(&shell_vars, "PWD");
+    dirs_init(&dir_stack);
+    char** args = set_args(text, len);
+    int status = run(text, a);
+    free(args);
+    _exit(status);
+}
+
+static int exit_status(int status) {
+    if (WIFEXITED(status)) return WEXITSTATUS(status);
+    if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+    return 1;
+}
+
+// reaps the client's command and sends its status back
+static void finish(struct client* c) {
+    int status;
+    while (waitpid(c->pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            status = -1;
+            break;
+        }
+    }
+    int32_t reply = status < 0 ? 1 : exit_status(status);
+    // a client that went away is no reason to die of SIGPIPE
+    send(c->conn, &reply, sizeof(reply), MSG_NOSIGNAL);
+    fd_close(c->conn);
+    fd_close(c->pidfd);
+    c->conn = -1;
+    c->pidfd = -1;
+}
+
+// a signal the client forwards while its command runs, or its hangup: a
+// command never outlives the client it writes to
+static void client_input(struct client* c) {
+    int32_t sig;
+    ssize_t r = recv(c->conn, &sig, sizeof(sig), MSG_DONTWAIT);
+    if (r < 0 && (errno == EAGAIN || errno == EINTR)) return;
+    if (r == (ssize_t)sizeof(sig)) {
+        if (sig > 0 && sig < NSIG) kill(-c->pid, sig);
+        return;
+    }
+    kill(-c->pid, SIGKILL);
+    c->gone = 1;
+}
+
+static int start_client(int lfd, struct client* clients, struct client* slot,
+                        server_prime_fn prime, server_run_fn run, struct arena* a) {
+    int conn = fd_track(accept4(lfd, NULL, NULL, SOCK_CLOEXEC), "server client");
+    if (conn < 0) return (errno == EINTR || errno == ECONNABORTED) ? 0 : -1;
+
+    // a socket path another user can reach (a shared directory, a chmod)
+    // still only runs commands for our own uid
+    struct ucred cred;
+    socklen_t cred_len = sizeof(cred);
+    if (getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) < 0 || cred.uid != geteuid()) {
+        fd_close(conn);
+        return 0;
+    }
+
+    // the request is read here so its parse and PATH lookup stay warm for
+    // the next one; a client that doesn't send it holds us up this long
+    struct timeval tv = { .tv_sec = SERVER_READ_MS / 1000, .tv_usec = SERVER_READ_MS % 1000 * 1000 };
+    int fds[SERVER_NFDS];
+    size_t len;
+    char* text = setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) == 0
+                     ? read_request(conn, fds, &len) : NULL;
+    if (!text) {
+        perror("server: request");
+        fd_close(conn);
+        return 0;
+    }
+    // a syntax error is reported once, to the client
+    int saved = fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 0);
+    if (saved >= 0) dup2(fds[2], STDERR_FILENO);
+    int primed = prime(text, a);
+    if (saved >= 0) {
+        dup2(saved, STDERR_FILENO);
+        close(saved);
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) serve_child(conn, clients, lfd, text, len, fds, primed, run, a);
+    close_fds(fds);
+    free(text);
+    if (pid < 0) {
+        perror("server: fork");
+        fd_close(conn);
+        return 0;
+    }
+    // set on both sides, whichever runs first
+    setpgid(pid, pid);
+    slot->conn = conn;
+    slot->pid = pid;
+    slot->gone = 0;
+    slot->pidfd = fd_track((int)syscall(SYS_pidfd_open, pid, 0), "server pidfd");
+    // without pidfds (before Linux 5.3) every command is waited for in turn
+    if (slot->pidfd < 0) finish(slot);
+    return 0;
+}
+
+int server_main(const char* path, server_prime_fn prime, server_run_fn run, struct arena* a) {
+    for ( int fd = 0 ; fd < 3 ; ++fd ) {
+        if (fcntl(fd, F_GETFD) < 0 && open("/dev/null", O_RDWR) < 0) return -1;
+    }
+    int lfd = listen_on(path);
+    if (lfd < 0) return -1;
+
+    struct client clients[SERVER_MAX_CLIENTS];
+    for ( size_t i = 0 ; i < SERVER_MAX_CLIENTS ; ++i ) {
+        clients[i].conn = -1;
+        clients[i].pidfd = -1;
+    }
+    struct pollfd pfds[2 * SERVER_MAX_CLIENTS + 1];
+    size_t owner[2 * SERVER_MAX_CLIENTS + 1];
+
+    for (;;) {
+        size_t n = 0;
+        struct client* free_slot = NULL;
+        for ( size_t i = 0 ; i < SERVER_MAX_CLIENTS ; ++i ) {
+            if (clients[i].conn < 0) {
+                if (!free_slot) free_slot = &clients[i];
+                continue;
+            }
+            pfds[n] = (struct pollfd){ .fd = clients[i].pidfd, .events = POLLIN };
+            owner[n++] = i;
+            if (clients[i].gone) continue;
+            pfds[n] = (struct pollfd){ .fd = clients[i].conn, .events = POLLIN };
+            owner[n++] = i;
+        }
+        // with every slot busy new connections wait in the listen backlog
+        size_t lidx = n;
+        if (free_slot) pfds[n++] = (struct pollfd){ .fd = lfd, .events = POLLIN };
+
+        if (poll(pfds, n, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        for ( size_t k = 0 ; k < lidx ; ++k ) {
+            struct client* c = &clients[owner[k]];
+            // the pidfd comes first: a finished client's conn is closed
+            if (!pfds[k].revents || c->conn < 0) continue;
+            if (pfds[k].fd == c->pidfd) finish(c);
+            else client_input(c);
+        }
+        if (free_slot && pfds[lidx].revents & POLLIN &&
+            start_client(lfd, clients, free_slot, prime, run, a) < 0) {
+            break;
+        }
+    }
+
+    int err = errno;
+    fd_close(lfd);
+    unlink(path);
+    errno = err;
+    return -1;
+}
@@ -0,0 +1,47 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdint.h>
+
+#include "arena.h"
+
+// shell --server SOCK keeps one started shell around and runs the command
+// lines clients send over a Unix socket, each in a forked copy of it, so a
+// `sh -c` replacement costs a connect and a fork instead of a whole exec
+// and startup. The server reads and primes every request itself before
+// forking: the line is parsed into its command cache and the command's
+// PATH lookup goes through the path index, so a line or command seen
+// before costs the child neither a parse nor a PATH scan.
+//
+// A request is one message: a server_req header carrying the client's
+// stdin, stdout, stderr and working directory as SCM_RIGHTS fds, followed
+// by req.len bytes of NUL-terminated strings, the command and then $0, $1
+// ... Output never passes through the server, the command writes straight
+// to the client's fds. While it runs the client may send signal numbers,
+// one int32_t each, which go to the command's process group; a client that
+// hangs up takes the command down with SIGKILL. The reply is the exit
+// status as an int32_t.
+
+#define SERVER_MAGIC 0x73687631u  // "shv1"
+#define SERVER_NFDS 4             // stdin, stdout, stderr, cwd
+#define SERVER_MAX_REQ (1u << 20) // command and arguments
+#define SERVER_MAX_CLIENTS 64     // commands running at once
+#define SERVER_READ_MS 1000       // a client gets this long to send its request
+
+struct server_req {
+    uint32_t magic;
+    uint32_t len;
+};
+
+// warms the server's caches for a command line before it is forked off.
+// Returns 0, or the exit status of a line that doesn't parse, having said
+// why on stderr (the client's, at that point).
+typedef int (*server_prime_fn)(const char* text, struct arena* a);
+// runs one command line in a forked copy of the server, returns its exit
+// status. It is the last thing that process does, see exec_node_last.
+typedef int (*server_run_fn)(const char* text, struct arena* a);
+
+// serves requests on path until a fatal error, returns -1 with errno set
+int server_main(const char* path, server_prime_fn prime, server_run_fn run, struct arena* a);
+
+#endif
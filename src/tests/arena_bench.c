@@ -0,0 +1,142 @@
+// arena_bench.c
+// Build (example):
+//   gcc -std=gnu2x -Wall -Wextra -O2 -g -pthread arena.c tests/arena_bench.c -o arena_bench
+//
+// Usage: arena_bench [-n rounds] [-t max_threads]
+//
+// Allocation throughput of 1..max_threads threads (8 by default, doubling)
+// that each allocate 4 MB in 64 byte pieces and reset, -n rounds (500 by
+// default), three ways. A round is four times the POOL_CACHE blocks a
+// thread keeps, so most of its blocks go through the shared pool:
+//   locked  one arena shared behind a mutex, what a worker would have
+//           to do without per-thread arenas
+//   malloc  an arena per thread, blocks from malloc/free
+//   pool    an arena per thread on a shared block pool (see arena.h)
+// Reported as nanoseconds per allocation, wall clock over all threads.
+
+#define _GNU_SOURCE // clock_gettime
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "../arena.h"
+
+#define DEFAULT_ROUNDS 500
+#define DEFAULT_THREADS 8
+#define ROUND_BYTES (4u * POOL_CACHE * BLOCK_SIZE)
+#define PIECE 64
+
+enum mode { M_LOCKED, M_MALLOC, M_POOL };
+static const char* mode_names[] = { "locked", "malloc", "pool" };
+
+struct run {
+    enum mode mode;
+    long rounds;
+    struct block_pool pool;
+    struct arena shared;
+    pthread_mutex_t lock;
+    pthread_barrier_t start;
+};
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void* work(void* arg) {
+    struct run* r = arg;
+    struct arena own;
+    if (r->mode == M_POOL) arena_init_pool(&own, &r->pool);
+    else arena_init(&own);
+    pthread_barrier_wait(&r->start);
+
+    for ( long i = 0 ; i < r->rounds ; ++i ) {
+        for ( unsigned n = 0 ; n < ROUND_BYTES / PIECE ; ++n ) {
+            char* p;
+            if (r->mode == M_LOCKED) {
+                pthread_mutex_lock(&r->lock);
+                p = arena_alloc(&r->shared, PIECE);
+                // a reset by another thread may free it once unlocked
+                if (p) p[0] = (char)n;
+                pthread_mutex_unlock(&r->lock);
+            }
+            else {
+                p = arena_alloc(&own, PIECE);
+                if (p) p[0] = (char)n; // touch it, as a real user would
+            }
+            if (!p) abort();
+        }
+        if (r->mode == M_LOCKED) {
+            // the shared arena can only be reset once nobody uses it:
+            // take turns by resetting whenever it grew past one round
+            pthread_mutex_lock(&r->lock);
+            if (arena_used(&r->shared) >= ROUND_BYTES) arena_reset(&r->shared);
+            pthread_mutex_unlock(&r->lock);
+        }
+        else {
+            arena_reset(&own);
+        }
+    }
+    arena_destroy(&own);
+    return NULL;
+}
+
+// nanoseconds per allocation
+static double measure(enum mode mode, int threads, long rounds) {
+    struct run r = { .mode = mode, .rounds = rounds };
+    pool_init(&r.pool);
+    arena_init(&r.shared);
+    pthread_mutex_init(&r.lock, NULL);
+    pthread_barrier_init(&r.start, NULL, (unsigned)threads + 1);
+    pthread_t tids[threads];
+    for ( int t = 0 ; t < threads ; ++t ) {
+        if (pthread_create(&tids[t], NULL, work, &r) != 0) {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+    pthread_barrier_wait(&r.start);
+    double t0 = now_ns();
+    for ( int t = 0 ; t < threads ; ++t ) pthread_join(tids[t], NULL);
+    double t = now_ns() - t0;
+
+    pthread_barrier_destroy(&r.start);
+    pthread_mutex_destroy(&r.lock);
+    arena_destroy(&r.shared);
+    pool_destroy(&r.pool);
+    return t / ((double)threads * rounds * (ROUND_BYTES / PIECE));
+}
+
+int main(int argc, char** argv) {
+    long rounds = DEFAULT_ROUNDS;
+    int max_threads = DEFAULT_THREADS;
+    for ( int i = 1 ; i + 1 < argc ; i += 2 ) {
+        if (strcmp(argv[i], "-n") == 0) rounds = atol(argv[i + 1]);
+        else if (strcmp(argv[i], "-t") == 0) max_threads = atoi(argv[i + 1]);
+    }
+    if (rounds <= 0 || max_threads <= 0 || argc % 2 == 0) {
+        fprintf(stderr, "usage: %s [-n rounds] [-t max_threads]\n", argv[0]);
+        return 2;
+    }
+
+    printf("%ld rounds of %u x %d byte allocations per thread, ns per allocation\n",
+           rounds, ROUND_BYTES / PIECE, PIECE);
+    printf("threads");
+    for ( size_t m = 0 ; m < sizeof(mode_names) / sizeof(mode_names[0]) ; ++m ) {
+        printf(" %9s", mode_names[m]);
+    }
+    printf("\n");
+    for ( int threads = 1 ; threads <= max_threads ; threads *= 2 ) {
+        printf("%7d", threads);
+        for ( enum mode m = M_LOCKED ; m <= M_POOL ; ++m ) {
+            // the locked arena gets no faster with threads: fewer rounds
+            long n = m == M_LOCKED ? (rounds + threads - 1) / threads : rounds;
+            printf(" %9.2f", measure(m, threads, n));
+        }
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,156 @@
+// arena_mt_test.c
+// Build (example):
+//   gcc -std=gnu2x -Wall -Wextra -O1 -g -pthread arena.c tests/arena_mt_test.c -o arena_mt_test
+// With the thread sanitizer:
+//   gcc -std=gnu2x -Wall -Wextra -O1 -g -fsanitize=thread arena.c tests/arena_mt_test.c -o arena_mt_test
+//
+// Usage: arena_mt_test [threads] [rounds]
+//
+// Worker threads with arenas on one block pool (see arena.h) allocate,
+// fill and check memory, reset, release to marks and destroy their
+// arenas, while whole generations of workers come and go so blocks move
+// between threads through the pool and the per-thread caches. A block
+// handed to two arenas at once shows up as a clobbered fill pattern.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "../arena.h"
+
+#define DEFAULT_THREADS 8
+#define DEFAULT_ROUNDS 300
+#define GENERATIONS 4
+#define LIVE 256 // allocations checked at once
+
+struct worker {
+    struct block_pool* pool;
+    unsigned id;
+    long rounds;
+    int failed;
+};
+
+struct live {
+    unsigned char* p;
+    size_t size;
+    unsigned char val;
+};
+
+static unsigned next_rand(unsigned* x) {
+    *x = *x * 1103515245u + 12345u;
+    return *x >> 8;
+}
+
+static int check(const struct live* l, size_t n, unsigned id, const char* when) {
+    for ( size_t i = 0 ; i < n ; ++i ) {
+        for ( size_t k = 0 ; k < l[i].size ; ++k ) {
+            if (l[i].p[k] != l[i].val) {
+                fprintf(stderr, "[FAIL] thread %u %s: allocation %zu byte %zu is 0x%02x, not 0x%02x\n",
+                        id, when, i, k, l[i].p[k], l[i].val);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+// fills live[from..n) with new allocations, mostly small, now and then
+// bigger than a block (never pooled)
+static int fill(struct arena* a, struct live* live, size_t from, size_t n, unsigned* x) {
+    for ( size_t i = from ; i < n ; ++i ) {
+        unsigned r = next_rand(x);
+        size_t size = r % 64 == 0 ? BLOCK_SIZE + r % 4096 : 1 + r % 2048;
+        live[i].p = arena_alloc(a, size);
+        if (!live[i].p) return -1;
+        live[i].size = size;
+        live[i].val = (unsigned char)next_rand(x);
+        memset(live[i].p, live[i].val, size);
+    }
+    return 0;
+}
+
+static void* work(void* arg) {
+    struct worker* w = arg;
+    struct live* live = malloc(LIVE * sizeof(*live));
+    unsigned x = w->id * 2654435761u + 1;
+    struct arena a;
+    if (!live) {
+        w->failed = 1;
+        return NULL;
+    }
+    arena_init_pool(&a, w->pool);
+    for ( long r = 0 ; r < w->rounds && !w->failed ; ++r ) {
+        if (fill(&a, live, 0, LIVE / 2, &x) < 0) {
+            w->failed = 1;
+            break;
+        }
+        // everything after the mark goes, the first half must survive
+        struct arena_mark mark = arena_get_mark(&a);
+        if (fill(&a, live, LIVE / 2, LIVE, &x) < 0 || check(live, LIVE, w->id, "before release") < 0) {
+            w->failed = 1;
+            break;
+        }
+        arena_release(&a, mark);
+        if (check(live, LIVE / 2, w->id, "after release") < 0) {
+            w->failed = 1;
+            break;
+        }
+        // now and then all blocks go back, not all but one
+        if (next_rand(&x) % 4 == 0) arena_destroy(&a);
+        else arena_reset(&a);
+    }
+    arena_destroy(&a);
+    free(live);
+    return NULL;
+}
+
+int main(int argc, char** argv) {
+    int threads = argc > 1 ? atoi(argv[1]) : DEFAULT_THREADS;
+    long rounds = argc > 2 ? atol(argv[2]) : DEFAULT_ROUNDS;
+    if (threads <= 0 || rounds <= 0) {
+        fprintf(stderr, "usage: %s [threads] [rounds]\n", argv[0]);
+        return 2;
+    }
+    struct block_pool pool;
+    pool_init(&pool);
+    pthread_t* tids = malloc((size_t)threads * sizeof(*tids));
+    struct worker* ws = calloc((size_t)threads, sizeof(*ws));
+    if (!tids || !ws) {
+        perror("malloc");
+        return 1;
+    }
+
+    int failed = 0;
+    for ( int g = 0 ; g < GENERATIONS && !failed ; ++g ) {
+        printf("[TEST] generation %d: %d threads x %ld rounds\n", g, threads, rounds);
+        for ( int t = 0 ; t < threads ; ++t ) {
+            ws[t] = (struct worker){ .pool = &pool, .id = (unsigned)(g * threads + t), .rounds = rounds };
+            int rc = pthread_create(&tids[t], NULL, work, &ws[t]);
+            if (rc != 0) {
+                fprintf(stderr, "pthread_create: %s\n", strerror(rc));
+                return 1;
+            }
+        }
+        for ( int t = 0 ; t < threads ; ++t ) {
+            pthread_join(tids[t], NULL);
+            failed |= ws[t].failed;
+        }
+        if (!failed) puts("  OK");
+    }
+
+    // the main thread's arena takes blocks the workers left in the pool
+    struct arena a;
+    arena_init_pool(&a, &pool);
+    unsigned x = 1;
+    struct live live[LIVE];
+    if (!failed && (fill(&a, live, 0, LIVE, &x) < 0 || check(live, LIVE, 0, "main") < 0)) failed = 1;
+    arena_destroy(&a);
+    pool_destroy(&pool);
+    free(tids);
+    free(ws);
+    if (failed) return 1;
+    puts("\nAll threaded arena tests passed.");
+    return 0;
+}
@@ -0,0 +1,171 @@
+// cat_bench.c
+// Build (example):
+//   gcc -std=gnu2x -Wall -Wextra -O2 -g tests/cat_bench.c -o cat_bench
+//
+// Usage: cat_bench [-n lines] [-s megabytes] shell
+//
+// The cat builtin (copy_fd, see copyfd.h) against /bin/cat, both run by
+// the same shell:
+//   throughput  `cat big > file` and `cat big` into a pipe this program
+//               drains, best of 3, for a file of -s MB (256 by default)
+//   latency     a script of -n lines (2000 by default) of `cat small > file`
+//               on a 4 KB file, per line
+// Everything lives in a temporary directory under /tmp, removed after.
+
+#define _GNU_SOURCE // posix_spawn, clock_gettime, mkdtemp
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+extern char** environ;
+
+#define DEFAULT_LINES 2000
+#define DEFAULT_MB 256
+#define SMALL_SIZE 4096
+#define RUNS 3
+
+static const char* cats[] = { "cat", "/bin/cat" };
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int write_file(const char* path, size_t size) {
+    static char chunk[1 << 20];
+    unsigned x = 12345;
+    for ( size_t i = 0 ; i < sizeof(chunk) ; ++i ) {
+        x = x * 1103515245 + 12345;
+        chunk[i] = (char)(x >> 16);
+    }
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return -1;
+    for ( size_t done = 0 ; done < size ; ) {
+        size_t n = size - done < sizeof(chunk) ? size - done : sizeof(chunk);
+        if (write(fd, chunk, n) != (ssize_t)n) {
+            close(fd);
+            return -1;
+        }
+        done += n;
+    }
+    return close(fd);
+}
+
+// runs shell with argv, its stdout into a pipe drained here when drain is
+// set, else /dev/null. Microseconds, or -1.
+static double run(char** argv, int drain) {
+    int pfd[2] = { -1, -1 };
+    posix_spawn_file_actions_t fa;
+    posix_spawn_file_actions_init(&fa);
+    if (drain) {
+        if (pipe2(pfd, O_CLOEXEC) < 0) return -1;
+        posix_spawn_file_actions_adddup2(&fa, pfd[1], 1);
+    }
+    else posix_spawn_file_actions_addopen(&fa, 1, "/dev/null", O_WRONLY, 0);
+
+    double t0 = now_us();
+    pid_t pid;
+    int rc = posix_spawn(&pid, argv[0], &fa, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&fa);
+    if (drain) close(pfd[1]);
+    if (rc != 0) {
+        fprintf(stderr, "%s: %s\n", argv[0], strerror(rc));
+        if (drain) close(pfd[0]);
+        return -1;
+    }
+    if (drain) {
+        static char buf[1 << 16];
+        while (read(pfd[0], buf, sizeof(buf)) > 0) {}
+        close(pfd[0]);
+    }
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) return -1;
+    }
+    double t = now_us() - t0;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "%s %s: failed (status %d)\n", argv[0], argv[1], status);
+        return -1;
+    }
+    return t;
+}
+
+static double best_of(char** argv, int drain) {
+    double best = -1;
+    for ( int r = 0 ; r < RUNS ; ++r ) {
+        double t = run(argv, drain);
+        if (t < 0) return -1;
+        if (best < 0 || t < best) best = t;
+    }
+    return best;
+}
+
+int main(int argc, char** argv) {
+    long lines = DEFAULT_LINES;
+    long mb = DEFAULT_MB;
+    int i = 1;
+    for ( ; i + 1 < argc && argv[i][0] == '-' ; i += 2 ) {
+        if (strcmp(argv[i], "-n") == 0) lines = atol(argv[i + 1]);
+        else if (strcmp(argv[i], "-s") == 0) mb = atol(argv[i + 1]);
+        else break;
+    }
+    if (i + 1 != argc || lines <= 0 || mb <= 0) {
+        fprintf(stderr, "usage: %s [-n lines] [-s megabytes] shell\n", argv[0]);
+        return 2;
+    }
+    char* shell = argv[i];
+
+    char dir[] = "/tmp/cat_bench.XXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    char big[64], small[64], out[64], script[64], cmd[256];
+    snprintf(big, sizeof(big), "%s/big", dir);
+    snprintf(small, sizeof(small), "%s/small", dir);
+    snprintf(out, sizeof(out), "%s/out", dir);
+    snprintf(script, sizeof(script), "%s/script", dir);
+    int status = 1;
+    if (write_file(big, (size_t)mb << 20) < 0 || write_file(small, SMALL_SIZE) < 0) {
+        perror("write");
+        goto out;
+    }
+
+    printf("%s, %ld MB file, %ld x %d byte file\n", shell, mb, lines, SMALL_SIZE);
+    for ( size_t c = 0 ; c < sizeof(cats) / sizeof(cats[0]) ; ++c ) {
+        char* sh_argv[] = { shell, "-c", cmd, NULL };
+        snprintf(cmd, sizeof(cmd), "%s %s > %s", cats[c], big, out);
+        double to_file = best_of(sh_argv, 0);
+        snprintf(cmd, sizeof(cmd), "%s %s", cats[c], big);
+        double to_pipe = best_of(sh_argv, 1);
+
+        FILE* f = fopen(script, "w");
+        if (!f) {
+            perror(script);
+            goto out;
+        }
+        for ( long l = 0 ; l < lines ; ++l ) fprintf(f, "%s %s > %s\n", cats[c], small, out);
+        fclose(f);
+        char* script_argv[] = { shell, script, NULL };
+        double small_total = run(script_argv, 0);
+        if (to_file < 0 || to_pipe < 0 || small_total < 0) goto out;
+
+        printf("%-9s to file %8.1f MB/s   to pipe %8.1f MB/s   small file %7.1fus per cat\n",
+               cats[c], mb / (to_file / 1e6), mb / (to_pipe / 1e6), small_total / lines);
+    }
+    status = 0;
+out:
+    unlink(big);
+    unlink(small);
+    unlink(out);
+    unlink(script);
+    rmdir(dir);
+    return status;
+}
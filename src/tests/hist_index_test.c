@@ -0,0 +1,97 @@
+// hist_index_test.c
+// Build (example):
+//   gcc -std=c11 -Wall -Wextra -O2 -g arena.c hist_index.c tests/hist_index_test.c -I. -o hist_index_test
+
+#define _POSIX_C_SOURCE 200809L // clock_gettime
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+#include "hist_index.h"
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void test_dedupe(void) {
+    puts("[TEST] dedupe");
+    struct hist_index h;
+    hist_index_init(&h);
+
+    assert(hist_index_add(&h, "ls -la") == 0);
+    assert(hist_index_add(&h, "ls -la") == 0);
+    assert(hist_index_add(&h, "") == 0);
+    assert(h.nentries == 1);
+    assert(h.entries[0].count == 2);
+
+    hist_index_destroy(&h);
+    puts("  OK");
+}
+
+static void test_search_ranking(void) {
+    puts("[TEST] search_ranking");
+    struct hist_index h;
+    hist_index_init(&h);
+
+    hist_index_add(&h, "git status");
+    hist_index_add(&h, "make -j8");
+    hist_index_add(&h, "git commit -m wip");
+    hist_index_add(&h, "git status");
+    hist_index_add(&h, "git status");
+
+    struct hist_match m[8];
+    size_t n = hist_index_search(&h, "git", m, 8);
+    assert(n == 2);
+    // frequent and recent wins
+    assert(strcmp(hist_index_line(&h, m[0].id), "git status") == 0);
+    assert(strcmp(hist_index_line(&h, m[1].id), "git commit -m wip") == 0);
+
+    // short queries fall back to a scan
+    n = hist_index_search(&h, "-j", m, 8);
+    assert(n == 1);
+    assert(strcmp(hist_index_line(&h, m[0].id), "make -j8") == 0);
+
+    // every trigram present but not adjacent
+    n = hist_index_search(&h, "git make", m, 8);
+    assert(n == 0);
+
+    hist_index_destroy(&h);
+    puts("  OK");
+}
+
+static void test_million_entries(void) {
+    puts("[TEST] million_entries");
+    struct hist_index h;
+    hist_index_init(&h);
+
+    char line[128];
+    double t0 = now_ms();
+    for ( int i = 0 ; i < 1000000 ; ++i ) {
+        snprintf(line, sizeof(line), "cmd%d --flag=%d /var/log/file%d.log", i % 5000, i, i % 97);
+        assert(hist_index_add(&h, line) == 0);
+    }
+    double t1 = now_ms();
+
+    struct hist_match m[64];
+    size_t n = hist_index_search(&h, "--flag=123456 ", m, 64);
+    double t2 = now_ms();
+    assert(n == 1);
+    assert(strstr(hist_index_line(&h, m[0].id), "--flag=123456 ") != NULL);
+
+    printf("  build: %.1f ms, search: %.3f ms\n", t1 - t0, t2 - t1);
+
+    hist_index_destroy(&h);
+    puts("  OK");
+}
+
+int main(void) {
+    test_dedupe();
+    test_search_ranking();
+    test_million_entries();
+    puts("\nAll hist_index tests passed.");
+    return 0;
+}
@@ -0,0 +1,149 @@
+// path_index_test.c
+// Build (example):
+//   gcc -std=gnu2x -Wall -Wextra -O0 -g path_index.c fdtrack.c vars.c tests/path_index_test.c -o path_index_test
+//
+// The shared PATH index (see path_index.h) on a temporary directory tree
+// under /tmp, used as $XDG_RUNTIME_DIR too: hits and misses, names
+// starting with '.', a command added after the index was built, the
+// PATHs it must refuse (-1, so the caller scans PATH itself): a relative
+// entry, and more than PIDX_MAX_DIRS directories, and many PATHs sharing
+// PIDX_FILES files without ever answering for the wrong one.
+
+#define _GNU_SOURCE // mkdtemp
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "../path_index.h"
+#include "../vars.h"
+
+static char root[] = "/tmp/path_index_test.XXXXXX";
+static int failures;
+
+static void expect(int cond, const char* what) {
+    if (!cond) {
+        fprintf(stderr, "[FAIL] %s\n", what);
+        failures++;
+    }
+}
+
+static void make_exe(const char* dir, const char* name) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0755);
+    if (fd < 0 || write(fd, "#!/bin/sh\n", 10) != 10) {
+        perror(path);
+        exit(1);
+    }
+    close(fd);
+}
+
+static void make_dir(char* out, size_t n, const char* name) {
+    snprintf(out, n, "%s/%s", root, name);
+    if (mkdir(out, 0755) < 0) {
+        perror(out);
+        exit(1);
+    }
+}
+
+// removes root and everything one level below it
+static void cleanup(void) {
+    DIR* top = opendir(root);
+    struct dirent* d;
+    while (top && (d = readdir(top)) != NULL) {
+        if (strcmp(d->d_name, ".") == 0 || strcmp(d->d_name, "..") == 0) continue;
+        char sub[512];
+        snprintf(sub, sizeof(sub), "%s/%s", root, d->d_name);
+        DIR* dp = opendir(sub);
+        struct dirent* e;
+        while (dp && (e = readdir(dp)) != NULL) {
+            char f[1024];
+            snprintf(f, sizeof(f), "%s/%s", sub, e->d_name);
+            unlink(f);
+        }
+        if (dp) closedir(dp);
+        if (rmdir(sub) < 0) unlink(sub);
+    }
+    if (top) closedir(top);
+    rmdir(root);
+}
+
+int main(void) {
+    if (!mkdtemp(root)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    if (vars_init(&shell_vars, NULL) < 0 || vars_set(&shell_vars, "XDG_RUNTIME_DIR", root, 0) < 0) {
+        perror("vars");
+        return 1;
+    }
+    char a[256], b[256], path[512], out[1024];
+    make_dir(a, sizeof(a), "a");
+    make_dir(b, sizeof(b), "b");
+    make_exe(a, "one");
+    make_exe(b, "one");
+    make_exe(b, "two");
+    make_exe(b, ".hidden");
+    pidx_enable();
+
+    puts("[TEST] lookups");
+    snprintf(path, sizeof(path), "%s:%s", a, b);
+    expect(pidx_lookup(path, "one", out, sizeof(out)) == 1 && strncmp(out, a, strlen(a)) == 0,
+           "first directory wins");
+    expect(pidx_lookup(path, "two", out, sizeof(out)) == 1 && strncmp(out, b, strlen(b)) == 0,
+           "found in the second directory");
+    expect(pidx_lookup(path, ".hidden", out, sizeof(out)) == 1, "names starting with '.'");
+    expect(pidx_lookup(path, "three", out, sizeof(out)) == 0, "miss");
+    make_exe(a, "three");
+    expect(pidx_lookup(path, "three", out, sizeof(out)) == 1, "added after the build");
+
+    puts("[TEST] fallback");
+    snprintf(path, sizeof(path), ".:%s", b);
+    expect(pidx_lookup(path, "two", out, sizeof(out)) == -1, "relative PATH entry");
+    char* many = malloc((strlen(b) + 1) * (PIDX_MAX_DIRS + 6) + 1);
+    if (!many) {
+        perror("malloc");
+        return 1;
+    }
+    many[0] = '\0';
+    for ( int i = 0 ; i < PIDX_MAX_DIRS + 6 ; ++i ) {
+        strcat(many, i ? ":" : "");
+        strcat(many, b);
+    }
+    expect(pidx_lookup(many, "two", out, sizeof(out)) == -1, "more than PIDX_MAX_DIRS directories");
+    free(many);
+
+    puts("[TEST] many PATHs");
+    // "one" is in a, so a PATH's answer depends on where a is in it
+    for ( int i = 0 ; i < 4 * PIDX_FILES ; ++i ) {
+        char self[16];
+        snprintf(self, sizeof(self), "p%d", i);
+        char d[256];
+        make_dir(d, sizeof(d), self);
+        if (i % 2) snprintf(path, sizeof(path), "%s:%s:%s", d, a, b);
+        else snprintf(path, sizeof(path), "%s:%s:%s", d, b, a);
+        const char* want = i % 2 ? a : b;
+        for ( int k = 0 ; k < 2 ; ++k ) {
+            int r = pidx_lookup(path, "one", out, sizeof(out));
+            expect(r == -1 || (r == 1 && strncmp(out, want, strlen(want)) == 0 && out[strlen(want)] == '/'),
+                   "a shared file answers for its own PATH only");
+        }
+    }
+    int files = 0;
+    DIR* dp = opendir(root);
+    struct dirent* e;
+    while (dp && (e = readdir(dp)) != NULL) files += strncmp(e->d_name, "shell-path-", 11) == 0;
+    if (dp) closedir(dp);
+    expect(files > 0 && files <= PIDX_FILES, "at most PIDX_FILES index files");
+
+    pidx_close();
+    vars_destroy(&shell_vars);
+    cleanup();
+    if (failures) return 1;
+    puts("\nAll path index tests passed.");
+    return 0;
+}
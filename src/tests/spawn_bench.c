@@ -0,0 +1,146 @@
+// spawn_bench.c
+// Build (example):
+//   gcc -std=gnu2x -Wall -Wextra -O2 -g tests/spawn_bench.c zygote.c fdtrack.c -o spawn_bench
+//
+// Usage: spawn_bench [-n iterations] [-m megabytes] [program]
+//
+// Launches program (/bin/true by default) n times, 2000 by default, with
+// fork + execvp, posix_spawn and the zygote, and reports launch-to-exit
+// latency for each. -m first maps and touches that much memory, standing
+// in for what an interactive shell carries around (readline, history,
+// arena blocks): fork has to copy its page tables, posix_spawn (vfork) and
+// the zygote don't.
+
+#define _GNU_SOURCE // posix_spawn, clock_gettime
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <spawn.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "../zygote.h"
+
+extern char** environ;
+
+#define DEFAULT_ITERATIONS 2000
+
+enum method { M_FORK, M_SPAWN, M_ZYGOTE };
+static const char* method_names[] = { "fork+exec", "posix_spawn", "zygote" };
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int cmp_double(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static pid_t launch(enum method m, char** argv) {
+    static const int fds[] = { 0, 1, 2 };
+    pid_t pid = -1;
+    switch (m) {
+        case M_FORK:
+            pid = fork();
+            if (pid == 0) {
+                execvp(argv[0], argv);
+                _exit(127);
+            }
+            break;
+        case M_SPAWN: {
+            int rc = posix_spawnp(&pid, argv[0], NULL, NULL, argv, environ);
+            if (rc != 0) {
+                errno = rc;
+                pid = -1;
+            }
+            break;
+        }
+        case M_ZYGOTE:
+            pid = zygote_spawn(NULL, argv, environ, fds, fds, 3);
+            break;
+    }
+    return pid;
+}
+
+static int bench(enum method m, char** argv, long n, double* samples) {
+    double start = now_us();
+    for ( long i = 0 ; i < n ; ++i ) {
+        double t0 = now_us();
+        pid_t pid = launch(m, argv);
+        if (pid < 0) {
+            perror(method_names[m]);
+            return -1;
+        }
+        int status;
+        while (waitpid(pid, &status, 0) < 0) {
+            if (errno != EINTR) {
+                perror("waitpid");
+                return -1;
+            }
+        }
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "%s: %s failed (status %d)\n", method_names[m], argv[0], status);
+            return -1;
+        }
+        samples[i] = now_us() - t0;
+    }
+    double total = now_us() - start;
+
+    qsort(samples, (size_t)n, sizeof(double), cmp_double);
+    printf("%-12s n=%ld total=%.1fms mean=%.1fus min=%.1fus p50=%.1fus p99=%.1fus\n",
+           method_names[m], n, total / 1e3, total / n, samples[0], samples[n / 2],
+           samples[(size_t)(n * 0.99)]);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    long n = DEFAULT_ITERATIONS;
+    long mb = 0;
+    int i = 1;
+    for ( ; i + 1 < argc && argv[i][0] == '-' ; i += 2 ) {
+        if (strcmp(argv[i], "-n") == 0) n = atol(argv[i + 1]);
+        else if (strcmp(argv[i], "-m") == 0) mb = atol(argv[i + 1]);
+        else break;
+    }
+    if (n <= 0 || mb < 0 || (i < argc && argv[i][0] == '-')) {
+        fprintf(stderr, "usage: %s [-n iterations] [-m megabytes] [program]\n", argv[0]);
+        return 2;
+    }
+    char* prog_argv[] = { i < argc ? argv[i] : "/bin/true", NULL };
+
+    // started while this process is small, like the shell does
+    if (zygote_start() < 0) {
+        perror("zygote");
+        return 1;
+    }
+    if (mb > 0) {
+        size_t len = (size_t)mb << 20;
+        char* ballast = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ballast == MAP_FAILED) {
+            perror("mmap");
+            return 1;
+        }
+        for ( size_t off = 0 ; off < len ; off += 4096 ) ballast[off] = 1;
+    }
+
+    double* samples = malloc((size_t)n * sizeof(double));
+    if (!samples) {
+        perror("malloc");
+        return 1;
+    }
+    printf("%s, %ld MB touched in the parent\n", prog_argv[0], mb);
+    int status = 0;
+    for ( enum method m = M_FORK ; m <= M_ZYGOTE ; ++m ) {
+        if (bench(m, prog_argv, n, samples) < 0) status = 1;
+    }
+    free(samples);
+    zygote_stop();
+    return status;
+}
@@ -0,0 +1,107 @@
+// startup_bench.c
+// Build (example):
+//   gcc -std=gnu2x -Wall -Wextra -O2 -g tests/startup_bench.c -o startup_bench
+//
+// Usage: startup_bench [-n iterations] [-s script] shell [shell ...]
+//
+// Spawns `shell -c true` (or `shell script`) n times, 10000 by default, for
+// every binary given and reports start-to-exit latency, so builds can be
+// compared side by side. The shell's stdout goes to /dev/null.
+
+#define _GNU_SOURCE // posix_spawn, clock_gettime
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+extern char** environ;
+
+#define DEFAULT_ITERATIONS 10000
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int cmp_double(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static int bench(const char* shell, const char* script, long n, double* samples) {
+    char* argv_c[] = { (char*)shell, "-c", "true", NULL };
+    char* argv_s[] = { (char*)shell, (char*)script, NULL };
+    char** argv = script ? argv_s : argv_c;
+
+    posix_spawn_file_actions_t fa;
+    posix_spawn_file_actions_init(&fa);
+    posix_spawn_file_actions_addopen(&fa, 1, "/dev/null", O_WRONLY, 0);
+
+    int ret = -1;
+    double start = now_us();
+    for ( long i = 0 ; i < n ; ++i ) {
+        double t0 = now_us();
+        pid_t pid;
+        int rc = posix_spawn(&pid, shell, &fa, NULL, argv, environ);
+        if (rc != 0) {
+            fprintf(stderr, "%s: %s\n", shell, strerror(rc));
+            goto out;
+        }
+        int status;
+        while (waitpid(pid, &status, 0) < 0) {
+            if (errno != EINTR) {
+                perror("waitpid");
+                goto out;
+            }
+        }
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "%s: %s failed (status %d)\n", shell, script ? script : "-c true", status);
+            goto out;
+        }
+        samples[i] = now_us() - t0;
+    }
+    double total = now_us() - start;
+    ret = 0;
+
+    qsort(samples, (size_t)n, sizeof(double), cmp_double);
+    printf("%-40s n=%ld total=%.1fms mean=%.1fus min=%.1fus p50=%.1fus p99=%.1fus\n",
+           shell, n, total / 1e3, total / n, samples[0], samples[n / 2],
+           samples[(size_t)(n * 0.99)]);
+out:
+    posix_spawn_file_actions_destroy(&fa);
+    return ret;
+}
+
+int main(int argc, char** argv) {
+    long n = DEFAULT_ITERATIONS;
+    const char* script = NULL;
+    int i = 1;
+    for ( ; i + 1 < argc && argv[i][0] == '-' ; i += 2 ) {
+        if (strcmp(argv[i], "-n") == 0) n = atol(argv[i + 1]);
+        else if (strcmp(argv[i], "-s") == 0) script = argv[i + 1];
+        else break;
+    }
+    if (i >= argc || n <= 0) {
+        fprintf(stderr, "usage: %s [-n iterations] [-s script] shell [shell ...]\n", argv[0]);
+        return 2;
+    }
+
+    double* samples = malloc((size_t)n * sizeof(double));
+    if (!samples) {
+        perror("malloc");
+        return 1;
+    }
+    int status = 0;
+    for ( ; i < argc ; ++i ) {
+        if (bench(argv[i], script, n, samples) < 0) status = 1;
+    }
+    free(samples);
+    return status;
+}
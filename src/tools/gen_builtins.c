@@ -0,0 +1,137 @@
+// Generates builtins_table.h from builtins.def: a perfect hash table that
+// maps every builtin name to its entry with one hash and one memcmp.
+//
+// slot = (hash_bytes(name) * BUILTIN_SEED) >> (64 - BUILTIN_TABLE_BITS)
+//
+// The table has at least twice as many slots as builtins, and seeds are
+// tried until no two names share a slot.
+//
+// Usage: gen_builtins builtins.def builtins_table.h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "../hash.h"
+
+#define MAX_BUILTINS 256
+#define MAX_SEED_TRIES 1000000
+
+struct entry {
+    char name[64];
+    char fn[64];
+    char flags[128];
+};
+
+static struct entry entries[MAX_BUILTINS];
+static size_t nentries;
+
+// BUILTIN("name", fn, flags)
+static int parse_line(const char* line, struct entry* e) {
+    while (*line == ' ' || *line == '\t') line++;
+    if (strncmp(line, "BUILTIN(", 8) != 0) return 0;
+    return sscanf(line + 8, " \"%63[^\"]\" , %63[A-Za-z0-9_] , %127[^)] )",
+                  e->name, e->fn, e->flags) == 3 ? 1 : -1;
+}
+
+static uint64_t next_seed(uint64_t* state) {
+    // splitmix64, seeds must be odd for the multiply to be a bijection
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return (z ^ (z >> 31)) | 1;
+}
+
+static size_t slot_of(const char* name, uint64_t seed, unsigned bits) {
+    return (size_t)((hash_bytes(name, strlen(name)) * seed) >> (64 - bits));
+}
+
+static int try_seed(uint64_t seed, unsigned bits, int* used) {
+    size_t size = (size_t)1 << bits;
+    memset(used, 0, size * sizeof(int));
+    for ( size_t i = 0 ; i < nentries ; ++i ) {
+        size_t s = slot_of(entries[i].name, seed, bits);
+        if (used[s]) return 0;
+        used[s] = 1;
+    }
+    return 1;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s builtins.def builtins_table.h\n", argv[0]);
+        return 2;
+    }
+    FILE* in = fopen(argv[1], "r");
+    if (!in) {
+        perror(argv[1]);
+        return 1;
+    }
+    char line[512];
+    int lineno = 0;
+    while (fgets(line, sizeof(line), in)) {
+        lineno++;
+        if (nentries == MAX_BUILTINS) {
+            fprintf(stderr, "%s: more than %d builtins\n", argv[1], MAX_BUILTINS);
+            return 1;
+        }
+        int rc = parse_line(line, &entries[nentries]);
+        if (rc < 0) {
+            fprintf(stderr, "%s:%d: malformed BUILTIN line\n", argv[1], lineno);
+            return 1;
+        }
+        if (rc == 0) continue;
+        for ( size_t i = 0 ; i < nentries ; ++i ) {
+            if (strcmp(entries[i].name, entries[nentries].name) == 0) {
+                fprintf(stderr, "%s:%d: duplicate builtin %s\n", argv[1], lineno, entries[i].name);
+                return 1;
+            }
+        }
+        nentries++;
+    }
+    fclose(in);
+
+    unsigned bits = 1;
+    while (((size_t)1 << bits) < 2 * nentries) bits++;
+
+    int* used = NULL;
+    uint64_t seed = 0;
+    uint64_t state = 0;
+    for (;; bits++) {
+        free(used);
+        used = malloc(((size_t)1 << bits) * sizeof(int));
+        if (!used) {
+            perror("malloc");
+            return 1;
+        }
+        int found = 0;
+        for ( int t = 0 ; t < MAX_SEED_TRIES && !found ; ++t ) {
+            seed = next_seed(&state);
+            found = try_seed(seed, bits, used);
+        }
+        if (found) break;
+    }
+    free(used);
+
+    FILE* out = fopen(argv[2], "w");
+    if (!out) {
+        perror(argv[2]);
+        return 1;
+    }
+    fprintf(out, "// generated by tools/gen_builtins from builtins.def, do not edit\n\n");
+    fprintf(out, "#define BUILTIN_TABLE_BITS %u\n", bits);
+    fprintf(out, "#define BUILTIN_SEED 0x%016llxull\n\n", (unsigned long long)seed);
+    fprintf(out, "static const struct builtin builtin_table[1 << BUILTIN_TABLE_BITS] = {\n");
+    for ( size_t i = 0 ; i < nentries ; ++i ) {
+        struct entry* e = &entries[i];
+        fprintf(out, "    [%zu] = { \"%s\", %zu, %s, %s },\n",
+                slot_of(e->name, seed, bits), e->name, strlen(e->name), e->fn, e->flags);
+    }
+    fprintf(out, "};\n");
+    if (fclose(out) != 0) {
+        perror(argv[2]);
+        return 1;
+    }
+    return 0;
+}
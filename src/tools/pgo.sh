@@ -0,0 +1,46 @@
+#!/bin/sh
+# Builds the shell three ways, debug (-O0, what used to ship), release (-O3,
+# LTO) and profile-guided release, then compares them with the startup
+# benchmark and the training scripts.
+#
+# Usage: pgo.sh <source dir> <work dir>
+
+set -e
+src=$1
+out=$2
+if [ -z "$src" ] || [ -z "$out" ]; then
+    echo "usage: $0 <source dir> <work dir>" >&2
+    exit 2
+fi
+jobs=$(nproc 2>/dev/null || echo 4)
+
+echo "== debug build"
+cmake -S "$src" -B "$out/debug" -DCMAKE_BUILD_TYPE=Debug -DSHELL_PGO= > /dev/null
+cmake --build "$out/debug" -j "$jobs" --target shell
+
+echo "== release build"
+cmake -S "$src" -B "$out/release" -DCMAKE_BUILD_TYPE=Release -DSHELL_PGO= > /dev/null
+cmake --build "$out/release" -j "$jobs" --target shell startup_bench
+
+echo "== instrumented build"
+cmake -S "$src" -B "$out/pgo" -DCMAKE_BUILD_TYPE=Release -DSHELL_PGO=GEN > /dev/null
+cmake --build "$out/pgo" -j "$jobs" --target shell
+find "$out/pgo" -name '*.gcda' -delete
+
+echo "== training"
+sh "$src/src/tools/pgo_train.sh" "$out/pgo/shell" "$out/train"
+
+echo "== optimized build"
+cmake -S "$src" -B "$out/pgo" -DSHELL_PGO=USE > /dev/null
+cmake --build "$out/pgo" -j "$jobs" --target shell
+
+# the training scripts use paths relative to their own directory
+cd "$out/train"
+bench="$out/release/startup_bench"
+shells="$out/debug/shell $out/release/shell $out/pgo/shell"
+echo "== startup (debug, release, pgo)"
+$bench -n 5000 $shells
+echo "== tokenizer corpus (debug, release, pgo)"
+$bench -n 50 -s tokenize.sh $shells
+echo "== spawn loop (debug, release, pgo)"
+$bench -n 50 -s spawn.sh $shells
@@ -0,0 +1,64 @@
+#!/bin/sh
+# Training workload for profile-guided builds, also used as a benchmark.
+#
+# Usage: pgo_train.sh <shell> <work dir>
+#
+# Writes tokenize.sh (a large script exercising the tokenizer, parser and
+# expansions, builtins only) and spawn.sh (external commands and pipelines) into the work
+# dir, runs both, a `shell -c true` loop and, when script(1) is around to
+# provide a terminal, a few interactive completions.
+
+set -e
+shell=$1
+work=$2
+if [ -z "$shell" ] || [ -z "$work" ]; then
+    echo "usage: $0 <shell> <work dir>" >&2
+    exit 2
+fi
+# absolute, the rest runs inside the work dir
+shell=$(cd "$(dirname "$shell")" && pwd)/$(basename "$shell")
+mkdir -p "$work"
+cd "$work"
+mkdir -p globdir
+touch globdir/a.c globdir/b.c globdir/c.h globdir/d.txt
+
+i=0
+: > tokenize.sh
+while [ $i -lt 400 ]; do
+    cat >> tokenize.sh <<'BLOCK'
+X=value; export Y="quoted $X"; Z='single $X'
+echo plain words "double $X ${Y}" 'single' mixed"quo"'tes'\ escaped > /dev/null
+echo $(echo nested $(echo deeper)) `echo back` > /dev/null
+for f in globdir/*.c globdir/?.h; do echo "$f"; done > /dev/null
+if true && ! false || false; then echo yes; else echo no; fi > /dev/null
+while false; do :; done; until true; do :; done
+{ echo group; echo more; } 2>&1 >/dev/null
+: <<EOT
+heredoc $X ${Y}
+EOT
+echo a 2>/dev/null 3>&1 >/dev/null; unset Z
+cd globdir; cd - > /dev/null; type echo cd > /dev/null
+BLOCK
+    i=$((i + 1))
+done
+
+cat > spawn.sh <<'BLOCK'
+for i in 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20; do
+    /bin/true; true; echo $i | cat > /dev/null
+    ls globdir | sort | head -n 2 > /dev/null
+    ( echo sub ) > /dev/null
+done
+BLOCK
+
+"$shell" tokenize.sh
+"$shell" spawn.sh
+n=0
+while [ $n -lt 300 ]; do
+    "$shell" -c true
+    n=$((n + 1))
+done
+
+if command -v script > /dev/null 2>&1; then
+    printf 'ech\t hi\nexpo\t A=1\nty\t ls\npw\t\nexit\n' |
+        script -qec "$shell" /dev/null > /dev/null 2>&1 || true
+fi
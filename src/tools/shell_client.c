@@ -0,0 +1,153 @@
+// Runs a command line on a `shell --server SOCKET` instance in place of
+// `sh -c`: the command gets this process's stdin, stdout, stderr and
+// working directory (passed as fds, see server.h), and its exit status
+// becomes ours.
+//
+// Usage: shell_client SOCKET command [name [arg ...]]
+//
+// name and the args become $0, $1 ... like with sh -c. SIGINT, SIGTERM
+// and SIGHUP are passed on to the command while it runs.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+#include "../server.h"
+
+static int sock = -1;
+
+// send(2) is async-signal-safe, and 4 bytes go out whole
+static void forward(int sig) {
+    int32_t n = sig;
+    int err = errno;
+    send(sock, &n, sizeof(n), MSG_NOSIGNAL | MSG_DONTWAIT);
+    errno = err;
+}
+
+static int connect_to(const char* path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    return fd;
+}
+
+static int send_all(int fd, const char* buf, size_t n) {
+    while (n > 0) {
+        ssize_t w = send(fd, buf, n, MSG_NOSIGNAL);
+        if (w < 0 && errno == EINTR) continue;
+        if (w < 0) return -1;
+        buf += w;
+        n -= (size_t)w;
+    }
+    return 0;
+}
+
+// the header with our fds, then the strings
+static int send_request(int sock, char** strs, int nstrs) {
+    size_t len = 0;
+    for ( int i = 0 ; i < nstrs ; ++i ) len += strlen(strs[i]) + 1;
+    if (len > SERVER_MAX_REQ) {
+        errno = E2BIG;
+        return -1;
+    }
+    char* body = malloc(len);
+    if (!body) return -1;
+    size_t off = 0;
+    for ( int i = 0 ; i < nstrs ; ++i ) {
+        size_t n = strlen(strs[i]) + 1;
+        memcpy(body + off, strs[i], n);
+        off += n;
+    }
+
+    // a closed 0-2 can't be passed, the command gets /dev/null instead
+    int fds[SERVER_NFDS];
+    for ( int k = 0 ; k < 3 ; ++k ) {
+        fds[k] = fcntl(k, F_GETFD) < 0 ? open("/dev/null", O_RDWR | O_CLOEXEC) : k;
+    }
+    fds[3] = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    struct server_req req = { .magic = SERVER_MAGIC, .len = (uint32_t)len };
+    union {
+        char buf[CMSG_SPACE(sizeof(fds))];
+        struct cmsghdr align;
+    } ctl;
+    memset(&ctl, 0, sizeof(ctl));
+    struct iovec iov = { .iov_base = &req, .iov_len = sizeof(req) };
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = ctl.buf,
+        .msg_controllen = sizeof(ctl.buf),
+    };
+    struct cmsghdr* c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(c), fds, sizeof(fds));
+
+    int rc = -1;
+    for ( int k = 0 ; k < SERVER_NFDS ; ++k ) {
+        if (fds[k] < 0) goto out;
+    }
+    ssize_t w;
+    do {
+        w = sendmsg(sock, &msg, MSG_NOSIGNAL);
+    } while (w < 0 && errno == EINTR);
+    // a stream socket takes the 8 byte header whole or not at all
+    if (w == (ssize_t)sizeof(req)) rc = send_all(sock, body, len);
+out:
+    free(body);
+    return rc;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s SOCKET command [name [arg ...]]\n", argv[0]);
+        return 2;
+    }
+    sock = connect_to(argv[1]);
+    if (sock < 0) {
+        perror(argv[1]);
+        return 127;
+    }
+    if (send_request(sock, argv + 2, argc - 2) < 0) {
+        perror("shell_client: request");
+        return 127;
+    }
+    struct sigaction sa = { .sa_handler = forward };
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGHUP, &sa, NULL);
+
+    int32_t status;
+    size_t got = 0;
+    while (got < sizeof(status)) {
+        ssize_t r = recv(sock, (char*)&status + got, sizeof(status) - got, 0);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) {
+            fprintf(stderr, "shell_client: server closed the connection\n");
+            return 127;
+        }
+        got += (size_t)r;
+    }
+    return (int)status;
+}
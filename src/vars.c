@@ -0,0 +1,260 @@
+#include "vars.h"
+#include "hash.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+static char tombstone_mark;
+#define VAR_TOMBSTONE (&tombstone_mark)
+
+/* lookup */
+
+int vars_valid_name(const char* name, size_t len) {
+    if (len == 0) return 0;
+    for ( size_t i = 0 ; i < len ; ++i ) {
+        char c = name[i];
+        int alpha = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+        int digit = (c >= '0' && c <= '9');
+        if (!alpha && !(digit && i > 0)) return 0;
+    }
+    return 1;
+}
+
+static int name_eq(const struct var* v, const char* name, size_t len) {
+    return strncmp(v->name, name, len) == 0 && v->name[len] == '\0';
+}
+
+// the slot holding name, or NULL (and *insert is the slot it would go in)
+static struct var* find(struct var_table* t, const char* name, size_t len,
+                        uint64_t h, struct var** insert) {
+    struct var* first_free = NULL;
+    size_t pos = h & t->mask;
+    for (;;) {
+        struct var* v = &t->slots[pos];
+        if (v->name == NULL) {
+            if (insert) *insert = first_free ? first_free : v;
+            return NULL;
+        }
+        if (v->name == VAR_TOMBSTONE) {
+            if (!first_free) first_free = v;
+        }
+        else if (v->hash == h && name_eq(v, name, len)) {
+            return v;
+        }
+        pos = (pos + 1) & t->mask;
+    }
+}
+
+static int rehash(struct var_table* t, size_t new_slots) {
+    struct var* v = calloc(new_slots, sizeof(struct var));
+    if (!v) return -1;
+
+    size_t mask = new_slots - 1;
+    for ( size_t i = 0 ; t->slots && i <= t->mask ; ++i ) {
+        struct var* old = &t->slots[i];
+        if (old->name == NULL || old->name == VAR_TOMBSTONE) continue;
+        size_t pos = old->hash & mask;
+        while (v[pos].name) pos = (pos + 1) & mask;
+        v[pos] = *old;
+    }
+    free(t->slots);
+    t->slots = v;
+    t->mask = mask;
+    t->ntomb = 0;
+    return 0;
+}
+
+/* init / destroy */
+
+struct var_table shell_vars;
+
+int vars_init(struct var_table* t, char** environ_in) {
+    memset(t, 0, sizeof(*t));
+    if (rehash(t, VARS_DEFAULT_SLOTS) < 0) return -1;
+    t->env_dirty = 1;
+
+    for ( char** e = environ_in ; e && *e ; ++e ) {
+        const char* eq = strchr(*e, '=');
+        if (!eq) continue;
+        size_t len = (size_t)(eq - *e);
+        if (!vars_valid_name(*e, len)) continue;
+        if (vars_set_n(t, *e, len, eq + 1, VAR_EXPORT) < 0) return -1;
+    }
+    return 0;
+}
+
+void vars_destroy(struct var_table* t) {
+    for ( size_t i = 0 ; t->slots && i <= t->mask ; ++i ) {
+        struct var* v = &t->slots[i];
+        if (v->name == NULL || v->name == VAR_TOMBSTONE) continue;
+        free(v->name);
+        free(v->value);
+    }
+    free(t->slots);
+    free(t->envp);
+    memset(t, 0, sizeof(*t));
+}
+
+/* get / set */
+
+const char* vars_get_n(struct var_table* t, const char* name, size_t len) {
+    struct var* v = find(t, name, len, hash_bytes(name, len), NULL);
+    return v ? v->value : NULL;
+}
+
+const char* vars_get(struct var_table* t, const char* name) {
+    return vars_get_n(t, name, strlen(name));
+}
+
+unsigned vars_flags(struct var_table* t, const char* name) {
+    size_t len = strlen(name);
+    struct var* v = find(t, name, len, hash_bytes(name, len), NULL);
+    return v ? v->flags : 0;
+}
+
+// value == NULL only changes flags (export of an unset name)
+int vars_set_n(struct var_table* t, const char* name, size_t len,
+               const char* value, unsigned flags) {
+    if (!vars_valid_name(name, len)) {
+        errno = EINVAL;
+        return -1;
+    }
+    // keep used + deleted slots under 3/4
+    if ((t->nvars + t->ntomb + 1) * 4 > (t->mask + 1) * 3) {
+        size_t slots = t->mask + 1;
+        if ((t->nvars + 1) * 2 > slots) slots *= 2;
+        if (rehash(t, slots) < 0) return -1;
+    }
+
+    uint64_t h = hash_bytes(name, len);
+    struct var* insert = NULL;
+    struct var* v = find(t, name, len, h, &insert);
+
+    char* copy = value ? strdup(value) : NULL;
+    if (value && !copy) return -1;
+
+    if (!v) {
+        char* name_copy = strndup(name, len);
+        if (!name_copy) {
+            free(copy);
+            return -1;
+        }
+        if (insert->name == VAR_TOMBSTONE) t->ntomb--;
+        v = insert;
+        v->hash = h;
+        v->name = name_copy;
+        v->value = NULL;
+        v->flags = 0;
+        t->nvars++;
+    }
+    if (value) {
+        free(v->value);
+        v->value = copy;
+    }
+    unsigned old_flags = v->flags;
+    v->flags |= flags;
+    if ((v->flags & VAR_EXPORT) && (value || old_flags != v->flags)) t->env_dirty = 1;
+    return 0;
+}
+
+int vars_set(struct var_table* t, const char* name, const char* value, unsigned flags) {
+    return vars_set_n(t, name, strlen(name), value, flags);
+}
+
+int vars_export(struct var_table* t, const char* name) {
+    return vars_set(t, name, NULL, VAR_EXPORT);
+}
+
+int vars_unset(struct var_table* t, const char* name) {
+    size_t len = strlen(name);
+    struct var* v = find(t, name, len, hash_bytes(name, len), NULL);
+    if (!v) return 0;
+    if (v->flags & VAR_EXPORT) t->env_dirty = 1;
+    free(v->name);
+    free(v->value);
+    v->name = VAR_TOMBSTONE;
+    v->value = NULL;
+    v->flags = 0;
+    t->nvars--;
+    t->ntomb++;
+    return 0;
+}
+
+/* environment */
+
+// one allocation holds both the pointer array and the NAME=value strings
+char** vars_envp(struct var_table* t) {
+    if (!t->env_dirty && t->envp) return t->envp;
+
+    size_t count = 0;
+    size_t bytes = 0;
+    for ( size_t i = 0 ; i <= t->mask ; ++i ) {
+        struct var* v = &t->slots[i];
+        if (v->name == NULL || v->name == VAR_TOMBSTONE) continue;
+        if (!(v->flags & VAR_EXPORT) || !v->value) continue;
+        count++;
+        bytes += strlen(v->name) + strlen(v->value) + 2;
+    }
+
+    size_t need = (count + 1) * sizeof(char*) + bytes;
+    if (need > t->envp_cap) {
+        char** envp = realloc(t->envp, need);
+        if (!envp) return t->envp;
+        t->envp = envp;
+        t->envp_cap = need;
+    }
+
+    char* p = (char*)(t->envp + count + 1);
+    size_t k = 0;
+    for ( size_t i = 0 ; i <= t->mask ; ++i ) {
+        struct var* v = &t->slots[i];
+        if (v->name == NULL || v->name == VAR_TOMBSTONE) continue;
+        if (!(v->flags & VAR_EXPORT) || !v->value) continue;
+        t->envp[k++] = p;
+        size_t nlen = strlen(v->name);
+        size_t vlen = strlen(v->value);
+        memcpy(p, v->name, nlen);
+        p[nlen] = '=';
+        memcpy(p + nlen + 1, v->value, vlen + 1);
+        p += nlen + vlen + 2;
+    }
+    t->envp[k] = NULL;
+    t->env_dirty = 0;
+    return t->envp;
+}
+
+void vars_set_args(struct var_table* t, char** args, size_t nargs) {
+    t->args = args;
+    t->nargs = nargs;
+}
+
+static int cmp_var_name(const void* a, const void* b) {
+    const struct var* x = *(const struct var* const*)a;
+    const struct var* y = *(const struct var* const*)b;
+    return strcmp(x->name, y->name);
+}
+
+// prints NAME=value for every var carrying all of flags, sorted by name
+void vars_print(struct var_table* t, unsigned flags) {
+    struct var** list = malloc((t->nvars + 1) * sizeof(struct var*));
+    if (!list) {
+        perror("malloc");
+        return;
+    }
+    size_t n = 0;
+    for ( size_t i = 0 ; i <= t->mask ; ++i ) {
+        struct var* v = &t->slots[i];
+        if (v->name == NULL || v->name == VAR_TOMBSTONE) continue;
+        if ((v->flags & flags) != flags) continue;
+        list[n++] = v;
+    }
+    qsort(list, n, sizeof(struct var*), cmp_var_name);
+    for ( size_t i = 0 ; i < n ; ++i ) {
+        if (flags & VAR_EXPORT) printf("export ");
+        if (list[i]->value) printf("%s='%s'\n", list[i]->name, list[i]->value);
+        else printf("%s\n", list[i]->name);
+    }
+    free(list);
+}
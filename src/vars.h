@@ -0,0 +1,52 @@
+#ifndef VARS_H
+#define VARS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define VARS_DEFAULT_SLOTS 256 // power of two
+
+#define VAR_EXPORT 0x1
+
+// open addressing, linear probing. The hash sits next to the pointers so a
+// probe sequence only touches the slot array until the hash matches.
+struct var {
+    uint64_t hash;
+    char* name;  // NULL: empty, VAR_TOMBSTONE: deleted
+    char* value;
+    unsigned flags;
+};
+
+struct var_table {
+    struct var* slots;
+    size_t mask;
+    size_t nvars;
+    size_t ntomb;
+
+    // environment for execve, rebuilt only after an exported var changed
+    char** envp;
+    size_t envp_cap;
+    int env_dirty;
+
+    // positional parameters $0 $1 ... (not owned)
+    char** args;
+    size_t nargs;
+};
+
+extern struct var_table shell_vars;
+
+int vars_init(struct var_table* t, char** environ_in);
+void vars_destroy(struct var_table* t);
+const char* vars_get(struct var_table* t, const char* name);
+const char* vars_get_n(struct var_table* t, const char* name, size_t len);
+unsigned vars_flags(struct var_table* t, const char* name);
+int vars_set(struct var_table* t, const char* name, const char* value, unsigned flags);
+int vars_set_n(struct var_table* t, const char* name, size_t len, const char* value, unsigned flags);
+int vars_export(struct var_table* t, const char* name);
+int vars_unset(struct var_table* t, const char* name);
+char** vars_envp(struct var_table* t);
+void vars_set_args(struct var_table* t, char** args, size_t nargs);
+void vars_print(struct var_table* t, unsigned flags);
+int vars_valid_name(const char* name, size_t len);
+
+#endif
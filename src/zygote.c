@@ -0,0 +1,307 @@
+#define _GNU_SOURCE // MSG_CMSG_CLOEXEC, CLONE_PARENT
+#include "zygote.h"
+#include "fdtrack.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+extern char** environ;
+
+// a request is one SOCK_SEQPACKET message: this header, targets[nfds],
+// then the file to exec, nargv argv strings and nenv environment strings,
+// NUL-terminated,
+// with the fds as SCM_RIGHTS. The reply is an int32_t pid or -errno.
+struct zygote_req {
+    uint32_t nargv;
+    uint32_t nenv;
+    uint32_t nfds;
+    uint32_t len; // bytes after the header
+};
+
+static int zygote_sock = -1; // the shell's end
+static pid_t zygote_pid = -1;
+static pid_t zygote_owner;   // CLONE_PARENT children belong to this process only
+
+/* the zygote */
+
+// in the clone()d command: fds into place, then exec
+static void run_child(const char* file, char** argv, char** envp, int* fds,
+                      const int* targets, int n) {
+    int high = 3;
+    for ( int k = 0 ; k < n ; ++k ) {
+        if (targets[k] >= high) high = targets[k] + 1;
+    }
+    // out of the way of every target first, so no dup2 clobbers a later source
+    for ( int k = 0 ; k < n ; ++k ) {
+        fds[k] = fcntl(fds[k], F_DUPFD_CLOEXEC, high);
+        if (fds[k] < 0) _exit(127);
+    }
+    for ( int fd = 0 ; fd < 3 ; ++fd ) {
+        int wanted = 0;
+        for ( int k = 0 ; k < n ; ++k ) wanted |= (targets[k] == fd);
+        if (!wanted) close(fd);
+    }
+    for ( int k = 0 ; k < n ; ++k ) {
+        if (dup2(fds[k], targets[k]) < 0) _exit(127);
+    }
+    environ = envp;
+    execvp(file, argv);
+    perror("execvp");
+    _exit(127);
+}
+
+// splits buf into targets, the file and the two string vectors,
+// NULL-terminated
+static int parse_req(char* buf, size_t len, char** file, char*** argv, char*** envp,
+                     int** targets) {
+    struct zygote_req* req = (struct zygote_req*)buf;
+    if (len < sizeof(*req) || req->len != len - sizeof(*req) || req->nargv == 0 ||
+        req->nfds > ZYGOTE_MAX_FDS) {
+        return -1;
+    }
+    char* p = buf + sizeof(*req);
+    char* end = buf + len;
+    *targets = (int*)p;
+    p += req->nfds * sizeof(int);
+    char* nul = p < end ? memchr(p, '\0', (size_t)(end - p)) : NULL;
+    if (!nul) return -1;
+    *file = p;
+    p = nul + 1;
+
+    char** v = malloc((req->nargv + req->nenv + 2) * sizeof(char*));
+    if (!v) return -1;
+    size_t nv = 0;
+    for ( uint32_t i = 0 ; i < req->nargv + req->nenv ; ++i ) {
+        char* nul = p < end ? memchr(p, '\0', (size_t)(end - p)) : NULL;
+        if (!nul) {
+            free(v);
+            return -1;
+        }
+        v[nv++] = p;
+        if (i + 1 == req->nargv) v[nv++] = NULL;
+        p = nul + 1;
+    }
+    v[nv] = NULL;
+    *argv = v;
+    *envp = v + req->nargv + 1;
+    return 0;
+}
+
+static void zygote_main(int sock) {
+    // only what a request brings reaches a command
+    int null = open("/dev/null", O_RDWR);
+    for ( int fd = 0 ; fd < 3 ; ++fd ) dup2(null, fd);
+    if (null > 2) close(null);
+
+    static char buf[ZYGOTE_MAX_REQ] __attribute__((aligned(sizeof(int))));
+    for (;;) {
+        union {
+            char buf[CMSG_SPACE(sizeof(int) * ZYGOTE_MAX_FDS)];
+            struct cmsghdr align;
+        } ctl;
+        struct iovec iov = { .iov_base = buf, .iov_len = sizeof(buf) };
+        struct msghdr msg = {
+            .msg_iov = &iov,
+            .msg_iovlen = 1,
+            .msg_control = ctl.buf,
+            .msg_controllen = sizeof(ctl.buf),
+        };
+        ssize_t r = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) _exit(0); // the shell is gone
+
+        int fds[ZYGOTE_MAX_FDS];
+        int nfds = 0;
+        for ( struct cmsghdr* c = CMSG_FIRSTHDR(&msg) ; c ; c = CMSG_NXTHDR(&msg, c) ) {
+            if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) continue;
+            int n = (int)((c->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+            memcpy(fds + nfds, CMSG_DATA(c), (size_t)n * sizeof(int));
+            nfds += n;
+        }
+
+        char* file;
+        char** argv;
+        char** envp;
+        int* targets;
+        int32_t reply = -EPROTO;
+        if (!(msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) &&
+            parse_req(buf, (size_t)r, &file, &argv, &envp, &targets) == 0) {
+            if ((uint32_t)nfds == ((struct zygote_req*)buf)->nfds) {
+                // the command becomes the shell's child, not ours
+                pid_t pid = (pid_t)syscall(SYS_clone, CLONE_PARENT | SIGCHLD, NULL, NULL, NULL, NULL);
+                if (pid == 0) run_child(file, argv, envp, fds, targets, nfds);
+                reply = pid < 0 ? -errno : pid;
+            }
+            free(argv);
+        }
+        for ( int k = 0 ; k < nfds ; ++k ) close(fds[k]);
+        send(sock, &reply, sizeof(reply), MSG_NOSIGNAL);
+    }
+}
+
+/* the shell's side */
+
+int zygote_start(void) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0) return -1;
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(sv[0]);
+        zygote_main(sv[1]);
+    }
+    close(sv[1]);
+    if (pid < 0) {
+        close(sv[0]);
+        return -1;
+    }
+    int high = fcntl(sv[0], F_DUPFD_CLOEXEC, ZYGOTE_FD_MIN);
+    if (high >= 0) {
+        close(sv[0]);
+        sv[0] = high;
+    }
+    zygote_sock = fd_track(sv[0], "zygote");
+    zygote_pid = pid;
+    zygote_owner = getpid();
+    return 0;
+}
+
+void zygote_stop(void) {
+    if (zygote_sock < 0) return;
+    // the zygote exits on EOF, even while a forked subshell still has the fd
+    shutdown(zygote_sock, SHUT_RDWR);
+    fd_close(zygote_sock);
+    zygote_sock = -1;
+    if (getpid() == zygote_owner) waitpid(zygote_pid, NULL, 0);
+    zygote_pid = -1;
+}
+
+// forked subshells still see the socket but can't use it: the commands
+// would become children of the main shell
+int zygote_active(void) {
+    return zygote_sock >= 0 && getpid() == zygote_owner;
+}
+
+int zygote_fd(void) {
+    return zygote_sock;
+}
+
+// the request zygote_prepare built: file, argv and envp, sent after the
+// header and targets
+static char req_buf[ZYGOTE_MAX_REQ];
+static size_t req_len;
+static uint32_t req_nargv, req_nenv;
+
+int zygote_prepare(const char* file, char* const argv[], char* const envp[]) {
+    if (!zygote_active()) return -1;
+    // room for the header and every target, whatever nfds turns out to be
+    size_t room = sizeof(req_buf) - sizeof(struct zygote_req) - ZYGOTE_MAX_FDS * sizeof(int);
+    if (!file) file = argv[0];
+    size_t len = strlen(file) + 1;
+    if (len > room) {
+        errno = E2BIG;
+        return -1;
+    }
+    memcpy(req_buf, file, len);
+    uint32_t counts[2] = { 0, 0 };
+    char* const* vecs[2] = { argv, envp };
+    for ( int v = 0 ; v < 2 ; ++v ) {
+        for ( char* const* s = vecs[v] ; s && *s ; ++s ) {
+            size_t n = strlen(*s) + 1;
+            if (len + n > room) {
+                errno = E2BIG;
+                return -1;
+            }
+            memcpy(req_buf + len, *s, n);
+            len += n;
+            counts[v]++;
+        }
+    }
+    req_len = len;
+    req_nargv = counts[0];
+    req_nenv = counts[1];
+    return 0;
+}
+
+pid_t zygote_spawn_prepared(const int* fds, const int* targets, int nfds) {
+    if (!zygote_active() || nfds > ZYGOTE_MAX_FDS) return -1;
+
+    union {
+        struct zygote_req req;
+        char buf[sizeof(struct zygote_req) + ZYGOTE_MAX_FDS * sizeof(int)];
+    } head;
+    size_t hlen = sizeof(head.req) + (size_t)nfds * sizeof(int);
+    head.req = (struct zygote_req){
+        .nargv = req_nargv,
+        .nenv = req_nenv,
+        .nfds = (uint32_t)nfds,
+        .len = (uint32_t)(hlen - sizeof(head.req) + req_len),
+    };
+    memcpy(head.buf + sizeof(head.req), targets, (size_t)nfds * sizeof(int));
+
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * ZYGOTE_MAX_FDS)];
+        struct cmsghdr align;
+    } ctl;
+    memset(&ctl, 0, sizeof(ctl));
+    // one SOCK_SEQPACKET message, however many pieces it is sent from
+    struct iovec iov[2] = {
+        { .iov_base = head.buf, .iov_len = hlen },
+        { .iov_base = req_buf, .iov_len = req_len },
+    };
+    struct msghdr msg = {
+        .msg_iov = iov,
+        .msg_iovlen = 2,
+        .msg_control = ctl.buf,
+        .msg_controllen = CMSG_SPACE(sizeof(int) * (size_t)nfds),
+    };
+    if (nfds > 0) {
+        struct cmsghdr* c = CMSG_FIRSTHDR(&msg);
+        c->cmsg_level = SOL_SOCKET;
+        c->cmsg_type = SCM_RIGHTS;
+        c->cmsg_len = CMSG_LEN(sizeof(int) * (size_t)nfds);
+        memcpy(CMSG_DATA(c), fds, sizeof(int) * (size_t)nfds);
+    }
+    else {
+        msg.msg_control = NULL;
+        msg.msg_controllen = 0;
+    }
+
+    ssize_t r;
+    do {
+        r = sendmsg(zygote_sock, &msg, MSG_NOSIGNAL);
+    } while (r < 0 && errno == EINTR);
+    int32_t reply;
+    if (r == (ssize_t)(hlen + req_len)) {
+        do {
+            r = recv(zygote_sock, &reply, sizeof(reply), 0);
+        } while (r < 0 && errno == EINTR);
+    }
+    if (r != (ssize_t)sizeof(reply)) {
+        // the fd was taken over by an exec redirection: that closed our end
+        if (errno == ENOTSOCK) zygote_sock = -1;
+        // a dead zygote is not retried, everything forks from here on
+        zygote_stop();
+        return -1;
+    }
+    if (reply < 0) {
+        errno = -reply;
+        return -1;
+    }
+    return (pid_t)reply;
+}
+
+pid_t zygote_spawn(const char* file, char* const argv[], char* const envp[],
+                   const int* fds, const int* targets, int nfds) {
+    if (zygote_prepare(file, argv, envp) < 0) return -1;
+    return zygote_spawn_prepared(fds, targets, nfds);
+}
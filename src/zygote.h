@@ -0,0 +1,39 @@
+#ifndef ZYGOTE_H
+#define ZYGOTE_H
+
+#include <sys/types.h>
+
+#define ZYGOTE_MAX_FDS 16           // fds one spawned command can be given
+#define ZYGOTE_MAX_REQ (64 * 1024)  // argv and environment, bigger ones fork
+#define ZYGOTE_ENV "SHELL_ZYGOTE"   // set (and not "0") to start one
+#define ZYGOTE_FD_MIN 255           // the socket is parked where redirections rarely go
+
+// fork() copies the page tables of everything the shell has mapped by
+// then: readline, history, the command cache, arena blocks. The zygote is
+// a helper forked first thing at startup, while the shell is still tiny,
+// that launches commands for it: it gets argv, the environment and the
+// fds to install over a socket, and clone()s with CLONE_PARENT, so the
+// command is a child of the shell (waitpid works as usual) forked from an
+// address space of a few pages.
+
+int zygote_start(void);
+void zygote_stop(void);
+int zygote_active(void);
+// the shell's end of the socket, -1 without a zygote. A command that
+// redirects this fd has to fork: the request would go to its target.
+int zygote_fd(void);
+
+// starts file (argv[0], searched in envp's PATH, when NULL) with fds[i]
+// installed as targets[i], every other fd closed or close-on-exec. Returns
+// the pid, or -1 when the zygote can't take the request and the caller
+// has to fork.
+pid_t zygote_spawn(const char* file, char* const argv[], char* const envp[],
+                   const int* fds, const int* targets, int nfds);
+// zygote_spawn in two steps, for a caller that has to set up the fds in
+// between: zygote_prepare returns -1 (E2BIG for a request too big) before
+// anything is done, zygote_spawn_prepared sends the last one prepared and
+// only fails when the zygote died or couldn't clone.
+int zygote_prepare(const char* file, char* const argv[], char* const envp[]);
+pid_t zygote_spawn_prepared(const int* fds, const int* targets, int nfds);
+
+#endif